@@ -50,6 +50,11 @@ extern "C" {
 #define ARGON2_MIN_THREADS UINT32_C(1)
 #define ARGON2_MAX_THREADS UINT32_C(0xFFFFFF)
 
+/* Thread count that lets the library choose: as many as the process has
+ * CPUs free of library workers, counting its affinity mask and cgroup CPU
+ * quota, and no more than the lanes */
+#define ARGON2_THREADS_AUTO UINT32_C(0)
+
 /* Number of synchronization points between lanes per pass */
 #define ARGON2_SYNC_POINTS UINT32_C(4)
 
@@ -83,6 +88,10 @@ extern "C" {
 #define ARGON2_MIN_SALT_LENGTH UINT32_C(8)
 #define ARGON2_MAX_SALT_LENGTH UINT32_C(0xFFFFFFFF)
 
+/* Largest salt and hash in bytes held by an argon2_encoded_params */
+#define ARGON2_ENCODED_MAX_SALT_LENGTH UINT32_C(64)
+#define ARGON2_ENCODED_MAX_OUTLEN UINT32_C(64)
+
 /* Minimum and maximum key length in bytes */
 #define ARGON2_MIN_SECRET UINT32_C(0)
 #define ARGON2_MAX_SECRET UINT32_C(0xFFFFFFFF)
@@ -91,6 +100,35 @@ extern "C" {
 #define ARGON2_DEFAULT_FLAGS UINT32_C(0)
 #define ARGON2_FLAG_CLEAR_PASSWORD (UINT32_C(1) << 0)
 #define ARGON2_FLAG_CLEAR_SECRET (UINT32_C(1) << 1)
+/* Map the memory with huge pages when possible instead of using malloc. Has
+ * no effect with a custom allocate_cbk; see argon2_memory_backing. */
+#define ARGON2_FLAG_HUGE_PAGES (UINT32_C(1) << 2)
+/* Workspace flag: wipe the memory of an argon2_workspace when it is released
+ * to its pool, on a background worker thread, or when it is destroyed,
+ * instead of at the end of every hash. */
+#define ARGON2_FLAG_DEFER_WIPE (UINT32_C(1) << 3)
+/* On NUMA machines, place the memory of each lane on the node of the thread
+ * filling it and keep that thread on the node's CPUs. Needs threads > 1,
+ * and is only supported on Linux. */
+#define ARGON2_FLAG_NUMA (UINT32_C(1) << 4)
+/* Fill in the argon2_stats pointed to by the stats field of the context,
+ * at a cost of a few clock reads per slice. */
+#define ARGON2_FLAG_STATS (UINT32_C(1) << 5)
+/* Take the reference blocks of the data-independent segments from the
+ * argon2_index_cache pointed to by the index_cache field of the context,
+ * when it was built for the same type, passes, lanes and memory. */
+#define ARGON2_FLAG_INDEX_CACHE (UINT32_C(1) << 6)
+/* Pin each thread filling the memory to one CPU, chosen as the affinity
+ * field of the context says, and give it the same lanes in every slice and
+ * pass, so that the blocks it wrote last are still in that CPU's caches.
+ * Needs threads > 1, and is only supported on Linux. Takes the place of
+ * the node pinning of ARGON2_FLAG_NUMA. */
+#define ARGON2_FLAG_AFFINITY (UINT32_C(1) << 7)
+/* Write the blocks of the first pass with non-temporal stores, which skip
+ * the read for ownership and leave the caches to the blocks being
+ * referenced. Meant for memory many times the size of the last-level cache;
+ * the hash is the same. Only the x86 kernels support it. */
+#define ARGON2_FLAG_STREAM_STORES (UINT32_C(1) << 8)
 
 /* Global flag to determine if we are wiping internal memory buffers. This flag
  * is defined in core.c and deafults to 1 (wipe internal memory). */
@@ -154,7 +192,18 @@ typedef enum Argon2_ErrorCodes {
 
     ARGON2_DECODING_LENGTH_FAIL = -34,
 
-    ARGON2_VERIFY_MISMATCH = -35
+    ARGON2_VERIFY_MISMATCH = -35,
+
+    ARGON2_KERNEL_UNAVAILABLE = -36,
+
+    ARGON2_ASYNC_QUEUE_FULL = -37,
+    ARGON2_ASYNC_CANCELLED = -38,
+
+    ARGON2_CALIBRATION_FAIL = -39,
+
+    ARGON2_MEMORY_BUDGET_EXCEEDED = -40,
+
+    ARGON2_HASH_UNFINISHED = -41
 } argon2_error_codes;
 
 /* Memory allocator types --- for external allocation */
@@ -163,6 +212,41 @@ typedef void (*deallocate_fptr)(uint8_t *memory, size_t bytes_to_allocate);
 
 /* Argon2 external data structures */
 
+/* Number of passes argon2_stats times one by one */
+#define ARGON2_STATS_PASSES 8
+
+/* Reference block offsets for repeated Argon2i/Argon2id hashes, see below */
+typedef struct Argon2_index_cache argon2_index_cache;
+
+/*
+ * Where the time of one hash went, filled in when the context has
+ * ARGON2_FLAG_STATS. Times are wall-clock nanoseconds; waits are summed
+ * over the threads. argon2_hash_batch() leaves pass_ns at zero. A library
+ * built with ARGON2_NO_STATS never touches the structure.
+ */
+typedef struct Argon2_stats {
+    uint64_t total_ns;        /* the whole hash, including validation */
+    uint64_t allocate_ns;     /* obtaining the memory (and NUMA binding) */
+    uint64_t initial_hash_ns; /* hashing the inputs into H0 */
+    uint64_t first_blocks_ns; /* the first two blocks of every lane, made
+                                 in fill_ns instead with threads > 1 */
+    uint64_t fill_ns;         /* all passes over the memory */
+    uint64_t pass_ns[ARGON2_STATS_PASSES]; /* each pass of fill_ns, the
+                                             passes past the last slot
+                                             added to it */
+    uint64_t wait_ns;     /* threads waiting on slices of the other lanes */
+    uint64_t join_ns;     /* the caller waiting for the other threads */
+    uint64_t finalize_ns; /* the tag, and wiping and releasing the memory */
+    uint64_t wipe_ns;     /* wiping and releasing the memory, in finalize;
+                             with threads > 1 the lanes are wiped at the
+                             end of fill_ns */
+    uint64_t bytes_allocated; /* 0 if a workspace held the memory */
+    uint64_t bytes_wiped;     /* 0 if the wipe was deferred or disabled */
+    const char *kernel;       /* fill kernel, as argon2_kernel_name() */
+    uint32_t memory_backing;  /* argon2_memory_backing of the memory */
+    uint32_t threads;         /* threads that filled the memory */
+} argon2_stats;
+
 /*
  *****
  * Context: structure to hold Argon2 inputs:
@@ -207,7 +291,7 @@ typedef struct Argon2_Context {
     uint32_t t_cost;  /* number of passes */
     uint32_t m_cost;  /* amount of memory requested (KB) */
     uint32_t lanes;   /* number of lanes */
-    uint32_t threads; /* maximum number of threads */
+    uint32_t threads; /* maximum number of threads, or ARGON2_THREADS_AUTO */
 
     uint32_t version; /* version number */
 
@@ -215,8 +299,40 @@ typedef struct Argon2_Context {
     deallocate_fptr free_cbk;   /* pointer to memory deallocator */
 
     uint32_t flags; /* array of bool options */
+
+    uint32_t memory_backing; /* set by the hash: argon2_memory_backing */
+
+    argon2_stats *stats; /* receives stats with ARGON2_FLAG_STATS */
+
+    /* read with ARGON2_FLAG_INDEX_CACHE */
+    const argon2_index_cache *index_cache;
+
+    /* read with ARGON2_FLAG_AFFINITY */
+    uint32_t affinity;   /* argon2_affinity */
+    const uint32_t *cpus; /* CPUs of ARGON2_AFFINITY_LIST */
+    uint32_t cpu_count;  /* entries in @cpus */
 } argon2_context;
 
+/*
+ * How ARGON2_FLAG_AFFINITY picks the CPU of each thread, among the CPUs the
+ * calling thread may run on. Threads beyond the CPUs start over at the
+ * first one.
+ */
+typedef enum Argon2_affinity {
+    ARGON2_AFFINITY_COMPACT = 0, /* thread i on the i-th CPU */
+    ARGON2_AFFINITY_SCATTER = 1, /* threads evenly spaced over the CPUs */
+    ARGON2_AFFINITY_LIST = 2     /* thread i on cpus[i % cpu_count] */
+} argon2_affinity;
+
+/* How the memory of a hash was obtained, reported in memory_backing */
+typedef enum Argon2_memory_backing {
+    ARGON2_BACKING_DEFAULT = 0, /* malloc, or allocate_cbk when set */
+    ARGON2_BACKING_PAGES = 1,   /* mapped, regular pages */
+    ARGON2_BACKING_THP = 2,     /* mapped, transparent huge pages requested */
+    ARGON2_BACKING_HUGE_2M = 3, /* mapped, explicit 2 MiB (large) pages */
+    ARGON2_BACKING_HUGE_1G = 4  /* mapped, explicit 1 GiB pages */
+} argon2_memory_backing;
+
 /* Argon2 primitive type */
 typedef enum Argon2_type {
   Argon2_d = 0,
@@ -246,6 +362,249 @@ ARGON2_PUBLIC const char *argon2_type2string(argon2_type type, int uppercase);
  */
 ARGON2_PUBLIC int argon2_ctx(argon2_context *context, argon2_type type);
 
+/*
+ * Function that performs argon2_ctx() on several independent contexts, all
+ * on the calling thread. Hashes run two at a time, their memory filling
+ * interleaved so one hash's memory accesses overlap the other's
+ * computation. This raises throughput per core, mostly for Argon2d and
+ * Argon2id; the outputs are the same as with argon2_ctx().
+ * @param  contexts  Array of @count contexts, threads is ignored
+ * @param  count  Number of contexts
+ * @param  type  Argon2 type shared by all contexts
+ * @param  results  NULL, or array receiving the error code of each context
+ * @return ARGON2_OK if all hashes succeeded, otherwise the first error code
+ */
+ARGON2_PUBLIC int argon2_hash_batch(argon2_context *contexts, size_t count,
+                                    argon2_type type, int *results);
+
+/*
+ * Resumable hashing: argon2_ctx() in steps of a few slices, a slice being
+ * a quarter of a pass, so that a scheduler can run short hashes between
+ * the steps of long ones. The result is the same as with argon2_ctx().
+ * The context must stay valid until argon2_finish(); its stats count the
+ * time between the steps too.
+ */
+typedef struct Argon2_state argon2_state;
+
+/* Returned by argon2_step() while the hash has slices left */
+#define ARGON2_STEP_PENDING 1
+
+/*
+ * Starts a hash: validates @context, allocates the memory and fills the
+ * first blocks
+ * @param  state  Receives the hash in progress, or NULL on error
+ * @return Error code if smth is wrong, ARGON2_OK otherwise
+ */
+ARGON2_PUBLIC int argon2_begin(argon2_state **state, argon2_context *context,
+                               argon2_type type);
+
+/*
+ * Fills up to @budget_slices more slices, with up to the threads of the
+ * context
+ * @return ARGON2_STEP_PENDING if slices are left, ARGON2_OK once the memory
+ * is filled, an error code otherwise
+ */
+ARGON2_PUBLIC int argon2_step(argon2_state *state, uint32_t budget_slices);
+
+/* Number of slices argon2_step() has left to fill, for schedulers */
+ARGON2_PUBLIC uint64_t argon2_slices_left(const argon2_state *state);
+
+/*
+ * Ends a hash: writes the tag to the output of the context, then wipes and
+ * frees the memory and @state. A hash with slices left is abandoned
+ * instead, without output.
+ * @return ARGON2_HASH_UNFINISHED if the hash had slices left, ARGON2_OK
+ * otherwise
+ */
+ARGON2_PUBLIC int argon2_finish(argon2_state *state);
+
+/*
+ * Workspace: memory for the hashes of a long-running caller, allocated and
+ * faulted in once instead of at every hash. A workspace serves one hash at
+ * a time; an argon2_workspace_pool hands workspaces out to several threads.
+ */
+typedef struct Argon2_workspace argon2_workspace;
+typedef struct Argon2_workspace_pool argon2_workspace_pool;
+
+/*
+ * Creates a workspace for hashes of up to @m_cost kibibytes running on up to
+ * @threads threads
+ * @param  flags  ARGON2_FLAG_HUGE_PAGES maps the memory with large pages,
+ * ARGON2_FLAG_DEFER_WIPE postpones its wiping
+ * @return The workspace, or NULL if it could not be allocated
+ */
+ARGON2_PUBLIC argon2_workspace *argon2_workspace_create(uint32_t m_cost,
+                                                        uint32_t threads,
+                                                        uint32_t flags);
+
+/* Wipes and frees a workspace, which must not be in use. NULL is ignored. */
+ARGON2_PUBLIC void argon2_workspace_destroy(argon2_workspace *workspace);
+
+/*
+ * Function that performs argon2_ctx() in the memory of @workspace, which is
+ * wiped but kept for the next hash. The allocation callbacks of @context are
+ * not called, unless the hash needs more memory than @workspace holds, in
+ * which case it allocates as argon2_ctx() does.
+ * @param  workspace  A workspace not in use by another hash, or NULL
+ * @return Error code if smth is wrong, ARGON2_OK otherwise
+ */
+ARGON2_PUBLIC int argon2_ctx_workspace(argon2_context *context,
+                                       argon2_type type,
+                                       argon2_workspace *workspace);
+
+/*
+ * Creates a thread-safe pool of @count workspaces, each as created by
+ * argon2_workspace_create(@m_cost, @threads, @flags)
+ * @return The pool, or NULL if a workspace could not be allocated
+ */
+ARGON2_PUBLIC argon2_workspace_pool *
+argon2_workspace_pool_create(uint32_t count, uint32_t m_cost,
+                             uint32_t threads, uint32_t flags);
+
+/* Destroys a pool and its workspaces, which must all have been released.
+ * NULL is ignored. */
+ARGON2_PUBLIC void argon2_workspace_pool_destroy(argon2_workspace_pool *pool);
+
+/*
+ * Takes a workspace out of @pool, waiting until one is released if all are
+ * in use. Builds with ARGON2_NO_THREADS return NULL instead of waiting.
+ */
+ARGON2_PUBLIC argon2_workspace *
+argon2_workspace_acquire(argon2_workspace_pool *pool);
+
+/* Gives a workspace taken by argon2_workspace_acquire() back to @pool */
+ARGON2_PUBLIC void argon2_workspace_release(argon2_workspace_pool *pool,
+                                           argon2_workspace *workspace);
+
+/*
+ * Memory governor: a fixed budget of memory, allocated and faulted in
+ * once, out of which concurrent hashes of any size take their memory.
+ * Hashes that do not fit wait for others to finish, in arrival order, or
+ * fail, so that the memory of a process stays bounded under load.
+ */
+typedef struct Argon2_memory_governor argon2_memory_governor;
+
+/*
+ * Creates a thread-safe governor of @budget kibibytes
+ * @param  flags  ARGON2_FLAG_HUGE_PAGES maps the memory with large pages
+ * @return The governor, or NULL if the memory could not be allocated
+ */
+ARGON2_PUBLIC argon2_memory_governor *argon2_governor_create(uint32_t budget,
+                                                            uint32_t flags);
+
+/* Frees a governor, which no hash may be using. NULL is ignored. */
+ARGON2_PUBLIC void argon2_governor_destroy(argon2_memory_governor *governor);
+
+/*
+ * Function that performs argon2_ctx() in memory of @governor, wiped when
+ * the hash ends. The allocation callbacks of @context are not called.
+ * @param  governor  The governor, or NULL to allocate as argon2_ctx() does
+ * @param  wait  Non-zero to wait while the budget is taken by other hashes,
+ * zero to fail at once. Builds with ARGON2_NO_THREADS never wait.
+ * @return Error code if smth is wrong, ARGON2_MEMORY_BUDGET_EXCEEDED if the
+ * hash needs more memory than is left (or than the whole budget, even with
+ * @wait), ARGON2_OK otherwise
+ */
+ARGON2_PUBLIC int argon2_ctx_governed(argon2_context *context,
+                                      argon2_type type,
+                                      argon2_memory_governor *governor,
+                                      int wait);
+
+/*
+ * Index cache: the reference blocks of the data-independent segments
+ * depend only on the parameters, so a server hashing many passwords with
+ * the same t_cost, m_cost and lanes can compute them once. The segments
+ * then skip the generation of their address blocks. A cache is read-only
+ * once built and can be shared by any number of threads.
+ */
+
+/*
+ * Builds the index cache of Argon2i or Argon2id hashes with the given costs
+ * and lanes (m_cost in kibibytes, rounded as the hash rounds it). It takes
+ * 4 bytes per block of Argon2i memory times @t_cost, or per block of half
+ * a pass for Argon2id.
+ * @return The cache, or NULL for Argon2d, invalid parameters, or when the
+ * memory could not be allocated
+ */
+ARGON2_PUBLIC argon2_index_cache *argon2_index_cache_create(argon2_type type,
+                                                            uint32_t t_cost,
+                                                            uint32_t m_cost,
+                                                            uint32_t lanes);
+
+/* Frees a cache, which no hash may be using. NULL is ignored. */
+ARGON2_PUBLIC void argon2_index_cache_destroy(argon2_index_cache *cache);
+
+/*
+ * Asynchronous hashing: a queue of argon2_ctx() calls run by worker threads
+ * of the library, for callers such as event loops that must not block.
+ * Finished hashes are collected with argon2_async_poll(), which runs their
+ * callbacks on the polling thread; argon2_async_fd() tells when to poll.
+ */
+typedef struct Argon2_async argon2_async;
+
+/* Called by argon2_async_poll() for each finished hash, with the context
+ * given to argon2_async_submit() and the result of argon2_ctx(), or
+ * ARGON2_ASYNC_CANCELLED */
+typedef void (*argon2_async_callback)(argon2_context *context, int result,
+                                      void *user);
+
+/*
+ * Creates an asynchronous hashing queue. As @workers hashes may run at
+ * once, a queued hash fills with at most the CPU count divided by @workers
+ * threads (at least 1), whatever the threads of its context;
+ * ARGON2_THREADS_AUTO takes what the running hashes leave.
+ * @param  workers  Number of hashes run at the same time, at least 1
+ * @param  capacity  Number of hashes submitted but not yet collected by
+ * argon2_async_poll() beyond which argon2_async_submit() refuses more
+ * @return The queue, or NULL on failure or if built with ARGON2_NO_THREADS
+ */
+ARGON2_PUBLIC argon2_async *argon2_async_create(uint32_t workers,
+                                                uint32_t capacity);
+
+/*
+ * Cancels the hashes that have not started, waits for the running ones,
+ * calls the callbacks of all hashes not collected yet and frees @async.
+ * NULL is ignored.
+ */
+ARGON2_PUBLIC void argon2_async_destroy(argon2_async *async);
+
+/*
+ * Queues argon2_ctx(@context, @type). @context, and the buffers it points
+ * to, must stay valid until @callback is called.
+ * @param  id  NULL, or receives an identifier for argon2_async_cancel()
+ * @return ARGON2_OK if queued, ARGON2_ASYNC_QUEUE_FULL if @capacity hashes
+ * are already outstanding
+ */
+ARGON2_PUBLIC int argon2_async_submit(argon2_async *async,
+                                      argon2_context *context,
+                                      argon2_type type,
+                                      argon2_async_callback callback,
+                                      void *user, uint64_t *id);
+
+/*
+ * Cancels a hash that has not started yet. Its callback still runs, from
+ * argon2_async_poll(), with ARGON2_ASYNC_CANCELLED.
+ * @return ARGON2_OK if cancelled, ARGON2_INCORRECT_PARAMETER if the hash is
+ * already running, finished or unknown
+ */
+ARGON2_PUBLIC int argon2_async_cancel(argon2_async *async, uint64_t id);
+
+/*
+ * Runs the callbacks of the hashes finished since the last call
+ * @param  wait  If nonzero and nothing has finished yet, waits until a hash
+ * finishes, unless none is outstanding
+ * @return Number of callbacks run
+ */
+ARGON2_PUBLIC uint32_t argon2_async_poll(argon2_async *async, int wait);
+
+/*
+ * Returns a file descriptor that becomes readable whenever hashes finish,
+ * for use with poll(), epoll or select(); argon2_async_poll() drains it.
+ * It is an eventfd on Linux and a pipe on other Unix systems.
+ * @return The descriptor, or -1 when not available (Windows)
+ */
+ARGON2_PUBLIC int argon2_async_fd(const argon2_async *async);
+
 /**
  * Hashes a password with Argon2i, producing an encoded hash
  * @param t_cost Number of iterations
@@ -327,6 +686,32 @@ ARGON2_PUBLIC int argon2_hash(const uint32_t t_cost, const uint32_t m_cost,
                               const size_t encodedlen, argon2_type type,
                               const uint32_t version);
 
+/*
+ * argon2_hash() in the memory of @workspace (or of its own allocation if
+ * NULL or too small). The tag is written straight to @hash, or kept on
+ * the stack while it is encoded if @hash is NULL and @hashlen is at most
+ * ARGON2_ENCODED_MAX_OUTLEN, so that nothing but the block memory is ever
+ * allocated. @hash must not overlap the password or salt.
+ */
+ARGON2_PUBLIC int argon2_hash_workspace(
+    const uint32_t t_cost, const uint32_t m_cost, const uint32_t parallelism,
+    const void *pwd, const size_t pwdlen, const void *salt,
+    const size_t saltlen, void *hash, const size_t hashlen, char *encoded,
+    const size_t encodedlen, argon2_type type, const uint32_t version,
+    argon2_workspace *workspace);
+
+/*
+ * argon2_hash_workspace() with @lanes lanes filled by up to @threads
+ * threads, which may be ARGON2_THREADS_AUTO. Only the lanes affect the
+ * result.
+ */
+ARGON2_PUBLIC int argon2_hash_threads(
+    const uint32_t t_cost, const uint32_t m_cost, const uint32_t lanes,
+    const uint32_t threads, const void *pwd, const size_t pwdlen,
+    const void *salt, const size_t saltlen, void *hash, const size_t hashlen,
+    char *encoded, const size_t encodedlen, argon2_type type,
+    const uint32_t version, argon2_workspace *workspace);
+
 /**
  * Verifies a password against an encoded string
  * Encoded string is restricted as in validate_inputs()
@@ -347,6 +732,42 @@ ARGON2_PUBLIC int argon2id_verify(const char *encoded, const void *pwd,
 ARGON2_PUBLIC int argon2_verify(const char *encoded, const void *pwd,
                                 const size_t pwdlen, argon2_type type);
 
+/*
+ * The parameters, salt and hash of an encoded string, decoded once so that
+ * they can be cached with a user record and verified against repeatedly
+ * without parsing the string again. Plain data: it may be copied freely.
+ */
+typedef struct Argon2_encoded_params {
+    argon2_type type;
+    uint32_t version;
+    uint32_t m_cost;
+    uint32_t t_cost;
+    uint32_t lanes;
+    uint32_t saltlen;
+    uint32_t outlen;
+    uint8_t salt[ARGON2_ENCODED_MAX_SALT_LENGTH];
+    uint8_t hash[ARGON2_ENCODED_MAX_OUTLEN];
+} argon2_encoded_params;
+
+/*
+ * Decodes @encoded, a string as produced by argon2_hash() for @type, into
+ * @params. Does not allocate memory.
+ * @return ARGON2_OK, or ARGON2_DECODING_FAIL if the string is malformed or
+ * its salt or hash is longer than ARGON2_ENCODED_MAX_SALT_LENGTH and
+ * ARGON2_ENCODED_MAX_OUTLEN; other codes if the parameters are invalid
+ */
+ARGON2_PUBLIC int argon2_encoded_parse(argon2_encoded_params *params,
+                                       const char *encoded, argon2_type type);
+
+/*
+ * Verifies a password against parameters decoded by argon2_encoded_parse().
+ * Only the memory of the hash itself is allocated.
+ * @return ARGON2_OK if the password matches, ARGON2_VERIFY_MISMATCH if not,
+ * another error code otherwise
+ */
+ARGON2_PUBLIC int argon2_verify_params(const argon2_encoded_params *params,
+                                       const void *pwd, const size_t pwdlen);
+
 /**
  * Argon2d: Version of Argon2 that picks memory blocks depending
  * on the password and salt. Only for side-channel-free
@@ -410,6 +831,42 @@ ARGON2_PUBLIC int argon2id_verify_ctx(argon2_context *context,
 ARGON2_PUBLIC int argon2_verify_ctx(argon2_context *context, const char *hash,
                                     argon2_type type);
 
+/**
+ * Stops the worker threads that the library keeps parked between
+ * multi-threaded hashes and releases their resources. Workers are created
+ * again on demand by later hashes. Must not be called while a hash or the
+ * wipe of a released workspace is in progress in another thread, nor while
+ * an argon2_async queue exists. Does nothing if built with ARGON2_NO_THREADS.
+ */
+ARGON2_PUBLIC void argon2_pool_shutdown(void);
+
+/**
+ * Get the name of the fill kernel used for hashing: "ref", "sse2", "ssse3",
+ * "xop", "avx2", "avx512f" or "neon". Unless a kernel was forced, the first call
+ * picks the fastest one the CPU supports, or the one named by the
+ * ARGON2_KERNEL environment variable if that is supported.
+ * @return  The kernel name
+ */
+ARGON2_PUBLIC const char *argon2_kernel_name(void);
+
+/**
+ * Get the name of a fill kernel built into the library, whether or not this
+ * CPU supports it, e.g. to try each with argon2_select_kernel()
+ * @param index  0 for "ref", then 1, 2, ... for the others
+ * @return  The kernel name, or NULL if @index is past the last kernel
+ */
+ARGON2_PUBLIC const char *argon2_builtin_kernel(uint32_t index);
+
+/**
+ * Force the fill kernel used by subsequent hashes, e.g. for benchmarking.
+ * Hashes already in progress keep their kernel.
+ * @param name  Kernel name as returned by argon2_kernel_name(), or NULL to
+ * go back to automatic selection
+ * @return  ARGON2_OK if successful, ARGON2_KERNEL_UNAVAILABLE if the kernel
+ * is not built in or not supported by this CPU
+ */
+ARGON2_PUBLIC int argon2_select_kernel(const char *name);
+
 /**
  * Get the associated error message for given error code
  * @return  The error message associated with the given error code
@@ -430,6 +887,45 @@ ARGON2_PUBLIC size_t argon2_encodedlen(uint32_t t_cost, uint32_t m_cost,
                                        uint32_t parallelism, uint32_t saltlen,
                                        uint32_t hashlen, argon2_type type);
 
+/**
+ * Encodes the hashes of @count contexts, each as argon2_hash() would, into
+ * one buffer: the strings follow each other, each with its terminating zero
+ * @param encoded  Buffer of @encodedlen characters
+ * @param contexts  Array of @count contexts holding the hashes in out
+ * @param type  Argon2 type shared by all contexts
+ * @param offsets  NULL, or array receiving where each string starts
+ * @return ARGON2_OK, ARGON2_ENCODING_FAIL if @encoded is too small, or the
+ * error of the first context whose parameters are invalid
+ */
+ARGON2_PUBLIC int argon2_encode_batch(char *encoded, size_t encodedlen,
+                                      argon2_context *contexts, size_t count,
+                                      argon2_type type, size_t *offsets);
+
+/* Parameters found by argon2_calibrate() */
+typedef struct Argon2_calibration {
+    uint32_t t_cost;     /* number of passes */
+    uint32_t m_cost;     /* memory in KiB, a multiple of 4 * lanes */
+    uint32_t lanes;      /* lanes, each filled by its own thread */
+    uint32_t threads;    /* threads, equal to lanes */
+    uint64_t latency_ns; /* median time of a hash with these parameters */
+} argon2_calibration;
+
+/**
+ * Finds the strongest parameters whose hashes take at most @target_ms on
+ * this machine, timing real argon2_ctx() calls. Memory comes first: the
+ * whole @max_memory_kib budget is used if one pass fits in the time, and
+ * the remaining time goes to more passes; otherwise the memory shrinks
+ * until one pass fits. The search takes a few dozen times @target_ms, and
+ * should run on an otherwise idle machine.
+ * @param max_threads  Cores a hash may use, which sets lanes and threads
+ * @return ARGON2_OK, ARGON2_CALIBRATION_FAIL if even the smallest memory
+ * takes longer than @target_ms, or the error of a hash
+ */
+ARGON2_PUBLIC int argon2_calibrate(argon2_type type, uint32_t target_ms,
+                                   uint32_t max_memory_kib,
+                                   uint32_t max_threads,
+                                   argon2_calibration *params);
+
 #if defined(__cplusplus)
 }
 #endif
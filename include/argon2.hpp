@@ -0,0 +1,205 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#ifndef ARGON2_HPP
+#define ARGON2_HPP
+
+/*
+ * Optional C++17 wrapper for services that hash with one fixed set of
+ * parameters. The parameters are template arguments, checked when the
+ * template is instantiated, and every hash runs in a workspace owned by the
+ * object. Functions return the error codes of the C API.
+ *
+ * Hashing writes to the workspace, so the hashing functions are not const
+ * and an Argon2 object is not thread-safe: give each thread its own.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+#include "argon2.h"
+
+namespace argon2 {
+
+/* Owns an argon2_workspace, see argon2_workspace_create() */
+class workspace {
+  public:
+    workspace() = default;
+    workspace(std::uint32_t m_cost, std::uint32_t threads,
+              std::uint32_t flags = ARGON2_DEFAULT_FLAGS)
+        : ws_(argon2_workspace_create(m_cost, threads, flags)) {}
+    workspace(const workspace &) = delete;
+    workspace &operator=(const workspace &) = delete;
+    workspace(workspace &&other) noexcept
+        : ws_(std::exchange(other.ws_, nullptr)) {}
+    workspace &operator=(workspace &&other) noexcept {
+        if (this != &other) {
+            argon2_workspace_destroy(ws_);
+            ws_ = std::exchange(other.ws_, nullptr);
+        }
+        return *this;
+    }
+    ~workspace() { argon2_workspace_destroy(ws_); }
+
+    /* NULL if it could not be created, in which case hashes allocate */
+    argon2_workspace *get() const noexcept { return ws_; }
+    explicit operator bool() const noexcept { return ws_ != nullptr; }
+
+  private:
+    argon2_workspace *ws_ = nullptr;
+};
+
+template <argon2_type T, std::uint32_t M, std::uint32_t P,
+          std::uint32_t Iters,
+          std::uint32_t Version = ARGON2_VERSION_NUMBER>
+struct Argon2 {
+    static_assert(T == Argon2_d || T == Argon2_i || T == Argon2_id,
+                  "unknown Argon2 type");
+    static_assert(Version == ARGON2_VERSION_10 ||
+                      Version == ARGON2_VERSION_13,
+                  "unknown Argon2 version");
+    static_assert(P >= ARGON2_MIN_LANES && P <= ARGON2_MAX_LANES,
+                  "parallelism out of range");
+    static_assert(Iters >= ARGON2_MIN_TIME, "too few iterations");
+    static_assert(M >= 2 * ARGON2_SYNC_POINTS * P,
+                  "less than 8 KiB of memory per lane");
+
+    static constexpr argon2_type type = T;
+    static constexpr std::uint32_t version = Version;
+    static constexpr std::uint32_t m_cost = M;
+    static constexpr std::uint32_t lanes = P;
+    static constexpr std::uint32_t t_cost = Iters;
+
+    /* The memory geometry the hash will use, as prepare_instance() does it */
+    static constexpr std::uint32_t segment_length =
+        M / (P * ARGON2_SYNC_POINTS);
+    static constexpr std::uint32_t lane_length =
+        segment_length * ARGON2_SYNC_POINTS;
+    static constexpr std::uint32_t memory_blocks = lane_length * P;
+    static constexpr std::size_t memory_bytes =
+        std::size_t(memory_blocks) * 1024; /* ARGON2_BLOCK_SIZE */
+
+    /* Allocates the workspace, filled by up to P threads */
+    Argon2() : ws_(M, P) {}
+    explicit Argon2(std::uint32_t workspace_flags)
+        : ws_(M, P, workspace_flags) {}
+
+    const argon2::workspace &workspace() const noexcept { return ws_; }
+
+    /* Writes a raw hash of @outlen bytes to @out */
+    int hash(void *out, std::size_t outlen, const void *pwd,
+             std::size_t pwdlen, const void *salt,
+             std::size_t saltlen) {
+        return argon2_hash_workspace(Iters, M, P, pwd, pwdlen, salt, saltlen,
+                                     out, outlen, nullptr, 0, T, Version,
+                                     ws_.get());
+    }
+
+    /* Writes the encoded string of a @hashlen byte hash to @encoded */
+    int hash_encoded(char *encoded, std::size_t encodedlen,
+                     std::size_t hashlen, const void *pwd, std::size_t pwdlen,
+                     const void *salt, std::size_t saltlen) {
+        return argon2_hash_workspace(Iters, M, P, pwd, pwdlen, salt, saltlen,
+                                     nullptr, hashlen, encoded, encodedlen, T,
+                                     Version, ws_.get());
+    }
+
+    /* Size of the buffer hash_encoded() needs, terminating zero included */
+    static std::size_t encoded_length(std::uint32_t saltlen,
+                                      std::uint32_t hashlen) {
+        return argon2_encodedlen(Iters, M, P, saltlen, hashlen, T);
+    }
+
+    /*
+     * Verifies @pwd against @encoded. Strings with this object's parameters
+     * are recomputed in its workspace; others are verified as
+     * argon2_verify() does.
+     */
+    int verify(const char *encoded, const void *pwd, std::size_t pwdlen) {
+        argon2_encoded_params params;
+        std::uint8_t out[ARGON2_ENCODED_MAX_OUTLEN];
+        int ret = argon2_encoded_parse(&params, encoded, T);
+
+        if (ret != ARGON2_OK) {
+            /* e.g. a salt or hash too long for the params */
+            return argon2_verify(encoded, pwd, pwdlen, T);
+        }
+        if (params.version != Version || params.m_cost != M ||
+            params.lanes != P || params.t_cost != Iters) {
+            return argon2_verify_params(&params, pwd, pwdlen);
+        }
+
+        ret = argon2_hash_workspace(Iters, M, P, pwd, pwdlen, params.salt,
+                                    params.saltlen, out, params.outlen,
+                                    nullptr, 0, T, Version, ws_.get());
+        if (ret == ARGON2_OK &&
+            !equal(out, params.hash, params.outlen)) {
+            ret = ARGON2_VERIFY_MISMATCH;
+        }
+        wipe(out, sizeof(out));
+        wipe(params.hash, sizeof(params.hash));
+        return ret;
+    }
+
+#if defined(__cpp_lib_span)
+    int hash(std::span<std::uint8_t> out, std::span<const std::uint8_t> pwd,
+             std::span<const std::uint8_t> salt) {
+        return hash(out.data(), out.size(), pwd.data(), pwd.size(),
+                    salt.data(), salt.size());
+    }
+
+    int hash_encoded(std::span<char> encoded, std::size_t hashlen,
+                     std::span<const std::uint8_t> pwd,
+                     std::span<const std::uint8_t> salt) {
+        return hash_encoded(encoded.data(), encoded.size(), hashlen,
+                            pwd.data(), pwd.size(), salt.data(), salt.size());
+    }
+
+    int verify(const char *encoded, std::span<const std::uint8_t> pwd) {
+        return verify(encoded, pwd.data(), pwd.size());
+    }
+#endif
+
+  private:
+    /* Compares in a time that does not depend on where @a and @b differ */
+    static bool equal(const std::uint8_t *a, const std::uint8_t *b,
+                      std::size_t len) {
+        std::uint8_t diff = 0;
+        for (std::size_t i = 0; i < len; ++i) {
+            diff |= std::uint8_t(a[i] ^ b[i]);
+        }
+        return diff == 0;
+    }
+
+    static void wipe(void *v, std::size_t len) {
+        volatile std::uint8_t *p = static_cast<volatile std::uint8_t *>(v);
+        while (len--) {
+            *p++ = 0;
+        }
+    }
+
+    argon2::workspace ws_;
+};
+
+} /* namespace argon2 */
+
+#endif
@@ -16,30 +16,38 @@ do
   fi
 
   i=0
-  for version in 16 19
+  for kernel in ref sse2 ssse3 xop avx2 avx512f neon
   do
-    for type in i d id
+    if ! ARGON2_KERNEL=$kernel ./genkat > /dev/null 2>&1
+    then
+      continue
+    fi
+
+    for version in 16 19
     do
-      i=$(($i+1))
-
-      printf "argon2$type v=$version: "
-
-      if [ 19 -eq $version ]
-      then
-        kats="kats/argon2"$type
-      else
-        kats="kats/argon2"$type"_v"$version
-      fi
-
-      ./genkat $type $version > tmp
-      if diff tmp $kats
-      then
-        printf "OK"
-      else
-        printf "ERROR"
-        exit $i
-      fi
-      printf "\n"
+      for type in i d id
+      do
+        i=$(($i+1))
+
+        printf "argon2$type v=$version ($kernel): "
+
+        if [ 19 -eq $version ]
+        then
+          kats="kats/argon2"$type
+        else
+          kats="kats/argon2"$type"_v"$version
+        fi
+
+        ARGON2_KERNEL=$kernel ./genkat $type $version > tmp
+        if diff tmp $kats
+        then
+          printf "OK"
+        else
+          printf "ERROR"
+          exit $i
+        fi
+        printf "\n"
+      done
     done
   done
 done
@@ -36,65 +36,182 @@ const char *argon2_type2string(argon2_type type, int uppercase) {
     return NULL;
 }
 
+/* Validates @context and fills in @instance up to its first blocks, in the
+ * memory of @workspace if not NULL and large enough */
+static int begin_instance(argon2_context *context, argon2_type type,
+                          argon2_workspace *workspace,
+                          argon2_instance_t *instance) {
+    /* 1. Validate all inputs and align the memory size */
+    int result = prepare_instance(instance, context, type, workspace);
+
+    if (ARGON2_OK != result) {
+        return result;
+    }
+
+    /* 2. Initialization: Hashing inputs, allocating memory, filling first
+     * blocks
+     */
+    return initialize(instance, context);
+}
+
 int argon2_ctx(argon2_context *context, argon2_type type) {
-    /* 1. Validate all inputs */
-    int result = validate_inputs(context);
-    uint32_t memory_blocks, segment_length;
+    return argon2_ctx_workspace(context, type, NULL);
+}
+
+int argon2_ctx_workspace(argon2_context *context, argon2_type type,
+                         argon2_workspace *workspace) {
     argon2_instance_t instance;
+    int result = begin_instance(context, type, workspace, &instance);
 
     if (ARGON2_OK != result) {
         return result;
     }
 
-    if (Argon2_d != type && Argon2_i != type && Argon2_id != type) {
-        return ARGON2_INCORRECT_TYPE;
+    /* 4. Filling memory */
+    result = fill_memory_blocks(&instance);
+
+    if (ARGON2_OK != result) {
+        return result;
     }
+    /* 5. Finalization */
+    finalize(context, &instance);
 
-    /* 2. Align memory size */
-    /* Minimum memory_blocks = 8L blocks, where L is the number of lanes */
-    memory_blocks = context->m_cost;
+    return ARGON2_OK;
+}
 
-    if (memory_blocks < 2 * ARGON2_SYNC_POINTS * context->lanes) {
-        memory_blocks = 2 * ARGON2_SYNC_POINTS * context->lanes;
-    }
+int argon2_hash_batch(argon2_context *contexts, size_t count,
+                      argon2_type type, int *results) {
+    argon2_instance_t instances[ARGON2_BATCH_INSTANCES];
+    argon2_instance_t *group[ARGON2_BATCH_INSTANCES];
+    size_t ids[ARGON2_BATCH_INSTANCES];
+    size_t next = 0, i;
+    uint32_t n;
+    int ret = ARGON2_OK;
+    int result;
 
-    segment_length = memory_blocks / (context->lanes * ARGON2_SYNC_POINTS);
-    /* Ensure that all segments have equal length */
-    memory_blocks = segment_length * (context->lanes * ARGON2_SYNC_POINTS);
+    if (contexts == NULL && count != 0) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
 
-    instance.version = context->version;
-    instance.memory = NULL;
-    instance.passes = context->t_cost;
-    instance.memory_blocks = memory_blocks;
-    instance.segment_length = segment_length;
-    instance.lane_length = segment_length * ARGON2_SYNC_POINTS;
-    instance.lanes = context->lanes;
-    instance.threads = context->threads;
-    instance.type = type;
+    while (next < count) {
+        /* Start the next few hashes, skipping invalid ones */
+        for (n = 0; n < ARGON2_BATCH_INSTANCES && next < count; ++next) {
+            result = begin_instance(&contexts[next], type, NULL,
+                                    &instances[n]);
+            if (results != NULL) {
+                results[next] = result;
+            }
+            if (ARGON2_OK != result) {
+                if (ARGON2_OK == ret) {
+                    ret = result;
+                }
+                continue;
+            }
+            group[n] = &instances[n];
+            ids[n] = next;
+            ++n;
+        }
+        if (n == 0) {
+            continue;
+        }
 
-    if (instance.threads > instance.lanes) {
-        instance.threads = instance.lanes;
+        result = fill_memory_blocks_batch(group, n);
+        for (i = 0; i < n; ++i) {
+            if (ARGON2_OK == result) {
+                finalize(&contexts[ids[i]], &instances[i]);
+            } else {
+                free_memory(&contexts[ids[i]], (uint8_t *)instances[i].memory,
+                            instances[i].memory_blocks, sizeof(block));
+                if (results != NULL) {
+                    results[ids[i]] = result;
+                }
+            }
+        }
+        if (ARGON2_OK != result && ARGON2_OK == ret) {
+            ret = result;
+        }
     }
 
-    /* 3. Initialization: Hashing inputs, allocating memory, filling first
-     * blocks
-     */
-    result = initialize(&instance, context);
+    return ret;
+}
 
+/* A hash in progress, see argon2_begin() */
+struct Argon2_state {
+    argon2_context *context;
+    argon2_instance_t instance;
+    uint64_t next; /* next slice to fill */
+    uint64_t end;  /* slices of the whole hash */
+};
+
+int argon2_begin(argon2_state **state, argon2_context *context,
+                 argon2_type type) {
+    argon2_state *begun;
+    int result;
+
+    if (state == NULL) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+    *state = NULL;
+
+    begun = (argon2_state *)malloc(sizeof(*begun));
+    if (begun == NULL) {
+        return ARGON2_MEMORY_ALLOCATION_ERROR;
+    }
+    result = begin_instance(context, type, NULL, &begun->instance);
     if (ARGON2_OK != result) {
+        free(begun);
         return result;
     }
+    begun->context = context;
+    begun->next = 0;
+    begun->end = (uint64_t)begun->instance.passes * ARGON2_SYNC_POINTS;
 
-    /* 4. Filling memory */
-    result = fill_memory_blocks(&instance);
+    *state = begun;
+    return ARGON2_OK;
+}
 
+int argon2_step(argon2_state *state, uint32_t budget_slices) {
+    uint64_t end;
+    int result;
+
+    if (state == NULL) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+
+    end = state->end - state->next < budget_slices
+              ? state->end
+              : state->next + budget_slices;
+    result = fill_memory_slices(&state->instance, state->next, end);
     if (ARGON2_OK != result) {
         return result;
     }
-    /* 5. Finalization */
-    finalize(context, &instance);
+    state->next = end;
 
-    return ARGON2_OK;
+    return state->next < state->end ? ARGON2_STEP_PENDING : ARGON2_OK;
+}
+
+uint64_t argon2_slices_left(const argon2_state *state) {
+    return state != NULL ? state->end - state->next : 0;
+}
+
+int argon2_finish(argon2_state *state) {
+    int result = ARGON2_OK;
+
+    if (state == NULL) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+
+    if (state->next == state->end) {
+        finalize(state->context, &state->instance);
+    } else {
+        free_memory(state->context, (uint8_t *)state->instance.memory,
+                    state->instance.memory_blocks, sizeof(block));
+        result = ARGON2_HASH_UNFINISHED;
+    }
+    clear_internal_memory(state, sizeof(*state));
+    free(state);
+
+    return result;
 }
 
 int argon2_hash(const uint32_t t_cost, const uint32_t m_cost,
@@ -104,8 +221,36 @@ int argon2_hash(const uint32_t t_cost, const uint32_t m_cost,
                 const size_t encodedlen, argon2_type type,
                 const uint32_t version){
 
+    return argon2_hash_workspace(t_cost, m_cost, parallelism, pwd, pwdlen,
+                                 salt, saltlen, hash, hashlen, encoded,
+                                 encodedlen, type, version, NULL);
+}
+
+int argon2_hash_workspace(const uint32_t t_cost, const uint32_t m_cost,
+                          const uint32_t parallelism, const void *pwd,
+                          const size_t pwdlen, const void *salt,
+                          const size_t saltlen, void *hash,
+                          const size_t hashlen, char *encoded,
+                          const size_t encodedlen, argon2_type type,
+                          const uint32_t version,
+                          argon2_workspace *workspace) {
+
+    return argon2_hash_threads(t_cost, m_cost, parallelism, parallelism, pwd,
+                               pwdlen, salt, saltlen, hash, hashlen, encoded,
+                               encodedlen, type, version, workspace);
+}
+
+int argon2_hash_threads(const uint32_t t_cost, const uint32_t m_cost,
+                        const uint32_t lanes, const uint32_t threads,
+                        const void *pwd, const size_t pwdlen,
+                        const void *salt, const size_t saltlen, void *hash,
+                        const size_t hashlen, char *encoded,
+                        const size_t encodedlen, argon2_type type,
+                        const uint32_t version, argon2_workspace *workspace) {
+
     argon2_context context;
     int result;
+    uint8_t tag[ARGON2_ENCODED_MAX_OUTLEN];
     uint8_t *out;
 
     if (pwdlen > ARGON2_MAX_PWD_LENGTH) {
@@ -124,56 +269,52 @@ int argon2_hash(const uint32_t t_cost, const uint32_t m_cost,
         return ARGON2_OUTPUT_TOO_SHORT;
     }
 
-    out = malloc(hashlen);
-    if (!out) {
-        return ARGON2_MEMORY_ALLOCATION_ERROR;
+    /* The tag goes where it is wanted, or where it can be encoded from */
+    if (hash) {
+        out = (uint8_t *)hash;
+    } else if (hashlen <= sizeof(tag)) {
+        out = tag;
+    } else {
+        out = malloc(hashlen);
+        if (!out) {
+            return ARGON2_MEMORY_ALLOCATION_ERROR;
+        }
     }
 
-    context.out = (uint8_t *)out;
+    memset(&context, 0, sizeof(context));
+    context.out = out;
     context.outlen = (uint32_t)hashlen;
     context.pwd = CONST_CAST(uint8_t *)pwd;
     context.pwdlen = (uint32_t)pwdlen;
     context.salt = CONST_CAST(uint8_t *)salt;
     context.saltlen = (uint32_t)saltlen;
-    context.secret = NULL;
-    context.secretlen = 0;
-    context.ad = NULL;
-    context.adlen = 0;
     context.t_cost = t_cost;
     context.m_cost = m_cost;
-    context.lanes = parallelism;
-    context.threads = parallelism;
-    context.allocate_cbk = NULL;
-    context.free_cbk = NULL;
+    context.lanes = lanes;
+    context.threads = threads;
     context.flags = ARGON2_DEFAULT_FLAGS;
     context.version = version;
 
-    result = argon2_ctx(&context, type);
-
-    if (result != ARGON2_OK) {
-        clear_internal_memory(out, hashlen);
-        free(out);
-        return result;
-    }
-
-    /* if raw hash requested, write it */
-    if (hash) {
-        memcpy(hash, out, hashlen);
-    }
+    result = argon2_ctx_workspace(&context, type, workspace);
 
     /* if encoding requested, write it */
-    if (encoded && encodedlen) {
+    if (result == ARGON2_OK && encoded && encodedlen) {
         if (encode_string(encoded, encodedlen, &context, type) != ARGON2_OK) {
-            clear_internal_memory(out, hashlen); /* wipe buffers if error */
-            clear_internal_memory(encoded, encodedlen);
+            clear_internal_memory(encoded, encodedlen); /* wipe if error */
+            result = ARGON2_ENCODING_FAIL;
+        }
+    }
+
+    if (out != hash) {
+        clear_internal_memory(out, hashlen);
+        if (out != tag) {
             free(out);
-            return ARGON2_ENCODING_FAIL;
         }
+    } else if (result != ARGON2_OK) {
+        clear_internal_memory(out, hashlen); /* no raw hash on error */
     }
-    clear_internal_memory(out, hashlen);
-    free(out);
 
-    return ARGON2_OK;
+    return result;
 }
 
 int argon2i_hash_encoded(const uint32_t t_cost, const uint32_t m_cost,
@@ -246,8 +387,9 @@ static int argon2_compare(const uint8_t *b1, const uint8_t *b2, size_t len) {
     return (int)((1 & ((d - 1) >> 8)) - 1);
 }
 
-int argon2_verify(const char *encoded, const void *pwd, const size_t pwdlen,
-                  argon2_type type) {
+/* Verifies strings whose salt or hash do not fit an argon2_encoded_params */
+static int verify_allocated(const char *encoded, const void *pwd,
+                            const size_t pwdlen, argon2_type type) {
 
     argon2_context ctx;
     uint8_t *desired_result = NULL;
@@ -257,14 +399,6 @@ int argon2_verify(const char *encoded, const void *pwd, const size_t pwdlen,
     size_t encoded_len;
     uint32_t max_field_len;
 
-    if (pwdlen > ARGON2_MAX_PWD_LENGTH) {
-        return ARGON2_PWD_TOO_LONG;
-    }
-
-    if (encoded == NULL) {
-        return ARGON2_DECODING_FAIL;
-    }
-
     encoded_len = strlen(encoded);
     if (encoded_len > UINT32_MAX) {
         return ARGON2_DECODING_FAIL;
@@ -312,6 +446,105 @@ fail:
     return ret;
 }
 
+int argon2_encoded_parse(argon2_encoded_params *params,
+                         const char *encoded, argon2_type type) {
+    argon2_context ctx;
+    int ret;
+
+    if (params == NULL || encoded == NULL) {
+        return ARGON2_DECODING_FAIL;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.salt = params->salt;
+    ctx.saltlen = ARGON2_ENCODED_MAX_SALT_LENGTH;
+    ctx.out = params->hash;
+    ctx.outlen = ARGON2_ENCODED_MAX_OUTLEN;
+
+    ret = decode_string(&ctx, encoded, type);
+    if (ret != ARGON2_OK) {
+        return ret;
+    }
+
+    params->type = type;
+    params->version = ctx.version;
+    params->m_cost = ctx.m_cost;
+    params->t_cost = ctx.t_cost;
+    params->lanes = ctx.lanes;
+    params->saltlen = ctx.saltlen;
+    params->outlen = ctx.outlen;
+
+    return ARGON2_OK;
+}
+
+int argon2_verify_params(const argon2_encoded_params *params, const void *pwd,
+                         const size_t pwdlen) {
+    argon2_context ctx;
+    uint8_t out[ARGON2_ENCODED_MAX_OUTLEN];
+    int ret;
+
+    if (params == NULL) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+
+    if (pwdlen > ARGON2_MAX_PWD_LENGTH) {
+        return ARGON2_PWD_TOO_LONG;
+    }
+
+    if (params->saltlen > ARGON2_ENCODED_MAX_SALT_LENGTH) {
+        return ARGON2_SALT_TOO_LONG;
+    }
+
+    if (params->outlen > ARGON2_ENCODED_MAX_OUTLEN) {
+        return ARGON2_OUTPUT_TOO_LONG;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.out = out;
+    ctx.outlen = params->outlen;
+    ctx.pwd = (uint8_t *)pwd;
+    ctx.pwdlen = (uint32_t)pwdlen;
+    ctx.salt = (uint8_t *)params->salt;
+    ctx.saltlen = params->saltlen;
+    ctx.t_cost = params->t_cost;
+    ctx.m_cost = params->m_cost;
+    ctx.lanes = params->lanes;
+    ctx.threads = params->lanes;
+    ctx.version = params->version;
+    ctx.flags = ARGON2_DEFAULT_FLAGS;
+
+    ret = argon2_verify_ctx(&ctx, (const char *)params->hash, params->type);
+    clear_internal_memory(out, sizeof(out));
+
+    return ret;
+}
+
+int argon2_verify(const char *encoded, const void *pwd, const size_t pwdlen,
+                  argon2_type type) {
+    argon2_encoded_params params;
+    int ret;
+
+    if (pwdlen > ARGON2_MAX_PWD_LENGTH) {
+        return ARGON2_PWD_TOO_LONG;
+    }
+
+    if (encoded == NULL) {
+        return ARGON2_DECODING_FAIL;
+    }
+
+    /* Salts and hashes of usual sizes are decoded on the stack; only longer
+     * ones, which fail to decode into params, take the allocating path */
+    ret = argon2_encoded_parse(&params, encoded, type);
+    if (ret == ARGON2_DECODING_FAIL) {
+        return verify_allocated(encoded, pwd, pwdlen, type);
+    }
+    if (ret != ARGON2_OK) {
+        return ret;
+    }
+
+    return argon2_verify_params(&params, pwd, pwdlen);
+}
+
 int argon2i_verify(const char *encoded, const void *pwd, const size_t pwdlen) {
 
     return argon2_verify(encoded, pwd, pwdlen, Argon2_i);
@@ -439,11 +672,51 @@ const char *argon2_error_message(int error_code) {
         return "Some of encoded parameters are too long or too short";
     case ARGON2_VERIFY_MISMATCH:
         return "The password does not match the supplied hash";
+    case ARGON2_KERNEL_UNAVAILABLE:
+        return "The requested fill kernel is not available";
+    case ARGON2_ASYNC_QUEUE_FULL:
+        return "Too many asynchronous hashes are outstanding";
+    case ARGON2_ASYNC_CANCELLED:
+        return "The asynchronous hash was cancelled";
+    case ARGON2_CALIBRATION_FAIL:
+        return "No parameters meet the target time";
+    case ARGON2_MEMORY_BUDGET_EXCEEDED:
+        return "Not enough memory left in the budget";
+    case ARGON2_HASH_UNFINISHED:
+        return "Hash finished before all its slices were filled";
     default:
         return "Unknown error code";
     }
 }
 
+int argon2_encode_batch(char *encoded, size_t encodedlen,
+                        argon2_context *contexts, size_t count,
+                        argon2_type type, size_t *offsets) {
+    const argon2_kernel_t *kernel;
+    size_t i, pos = 0;
+    int ret;
+
+    if (count > 0 && (encoded == NULL || contexts == NULL)) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+
+    /* One kernel lookup for the whole batch */
+    kernel = current_kernel();
+    for (i = 0; i < count; ++i) {
+        ret = encode_string_kernel(encoded + pos, encodedlen - pos,
+                                   &contexts[i], type, kernel);
+        if (ret != ARGON2_OK) {
+            return ret;
+        }
+        if (offsets != NULL) {
+            offsets[i] = pos;
+        }
+        pos += strlen(encoded + pos) + 1;
+    }
+
+    return ARGON2_OK;
+}
+
 size_t argon2_encodedlen(uint32_t t_cost, uint32_t m_cost, uint32_t parallelism,
                          uint32_t saltlen, uint32_t hashlen, argon2_type type) {
   return strlen("$$v=$m=,t=,p=$$") + strlen(argon2_type2string(type, 0)) +
@@ -0,0 +1,440 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE /* pipe, fcntl and eventfd with -std=c89 */
+#endif
+
+#include <stdlib.h>
+
+#include "argon2.h"
+#include "pool.h"
+#include "thread.h"
+
+#if !defined(ARGON2_NO_THREADS)
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#endif
+
+/* A submitted hash, kept in one of the lists of its queue */
+typedef struct Argon2_async_job {
+    argon2_context *context;
+    argon2_type type;
+    argon2_async_callback callback;
+    void *user;
+    uint64_t id;
+    int result;
+    struct Argon2_async_job *next;
+} argon2_async_job;
+
+struct Argon2_async {
+    argon2_async_job *jobs;      /* @capacity slots */
+    argon2_async_job *free_jobs; /* slots not in use */
+    argon2_async_job *pending_head, *pending_tail; /* FIFO of queued jobs */
+    argon2_async_job *done_head, *done_tail; /* FIFO of uncollected jobs */
+    uint32_t outstanding; /* jobs submitted and not collected yet */
+    uint64_t last_id;
+    argon2_pool_task *tasks; /* one task per worker */
+    uint32_t live;           /* workers that have not returned yet */
+    uint32_t threads; /* most threads of one hash: the CPUs over workers */
+    int stopping;
+    int fds[2]; /* notification descriptor: read end, write end */
+    argon2_mutex_t mutex;
+    argon2_cond_t work; /* signalled when a job is queued or on stopping */
+    argon2_cond_t done; /* signalled when a job finishes or a worker quits */
+};
+
+/* Makes the notification descriptor readable */
+static void notify(argon2_async *async) {
+#if !defined(_WIN32)
+    if (async->fds[1] >= 0) {
+#if defined(__linux__)
+        const uint64_t one = 1;
+        if (write(async->fds[1], &one, sizeof(one)) < 0) {
+            /* the counter is already nonzero */
+        }
+#else
+        const char one = 1;
+        if (write(async->fds[1], &one, sizeof(one)) < 0) {
+            /* the pipe is full, hence readable */
+        }
+#endif
+    }
+#else
+    (void)async;
+#endif
+}
+
+/* Reads everything notify() wrote */
+static void drain(argon2_async *async) {
+#if !defined(_WIN32)
+    if (async->fds[0] >= 0) {
+        char buffer[64];
+        while (read(async->fds[0], buffer, sizeof(buffer)) > 0) {
+        }
+    }
+#else
+    (void)async;
+#endif
+}
+
+/* Appends @job to the done list. Call with the mutex held. */
+static void push_done(argon2_async *async, argon2_async_job *job) {
+    job->next = NULL;
+    if (async->done_tail != NULL) {
+        async->done_tail->next = job;
+    } else {
+        async->done_head = job;
+    }
+    async->done_tail = job;
+    notify(async);
+    argon2_cond_broadcast(&async->done);
+}
+
+static void async_worker(void *arg) {
+    argon2_async *async = arg;
+    argon2_async_job *job;
+    argon2_context local;
+    int idle = 0;
+
+    argon2_mutex_lock(&async->mutex);
+    for (;;) {
+        /* A worker waiting for jobs leaves its CPU to ARGON2_THREADS_AUTO */
+        while (async->pending_head == NULL && !async->stopping) {
+            if (!idle) {
+                argon2_pool_idle(1);
+                idle = 1;
+            }
+            argon2_cond_wait(&async->work, &async->mutex);
+        }
+        if (idle) {
+            argon2_pool_idle(0);
+            idle = 0;
+        }
+        job = async->pending_head;
+        if (job == NULL) {
+            break; /* stopping */
+        }
+        async->pending_head = job->next;
+        if (async->pending_head == NULL) {
+            async->pending_tail = NULL;
+        }
+        argon2_mutex_unlock(&async->mutex);
+
+        /* The workers hash side by side, so each keeps to its share of the
+         * CPUs; AUTO already sees the other workers in the pool counts. The
+         * cap goes into a copy, as the caller's context may be submitted
+         * again meanwhile, and only what argon2_ctx() sets is copied back */
+        local = *job->context;
+        if (local.threads != ARGON2_THREADS_AUTO &&
+            local.threads > async->threads) {
+            local.threads = async->threads;
+        }
+        job->result = argon2_ctx(&local, job->type);
+        job->context->pwdlen = local.pwdlen;
+        job->context->secretlen = local.secretlen;
+        job->context->memory_backing = local.memory_backing;
+
+        argon2_mutex_lock(&async->mutex);
+        push_done(async, job);
+    }
+    async->live--;
+    argon2_cond_broadcast(&async->done);
+    argon2_mutex_unlock(&async->mutex);
+}
+
+/* Sets up the notification descriptor, leaving -1 if there is none */
+static void open_fds(argon2_async *async) {
+    async->fds[0] = async->fds[1] = -1;
+#if defined(__linux__)
+    async->fds[0] = async->fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#elif !defined(_WIN32)
+    if (pipe(async->fds) == 0) {
+        unsigned i;
+        for (i = 0; i < 2; ++i) {
+            fcntl(async->fds[i], F_SETFL,
+                  fcntl(async->fds[i], F_GETFL) | O_NONBLOCK);
+            fcntl(async->fds[i], F_SETFD, FD_CLOEXEC);
+        }
+    } else {
+        async->fds[0] = async->fds[1] = -1;
+    }
+#endif
+}
+
+static void close_fds(argon2_async *async) {
+#if !defined(_WIN32)
+    if (async->fds[0] >= 0) {
+        close(async->fds[0]);
+    }
+    if (async->fds[1] >= 0 && async->fds[1] != async->fds[0]) {
+        close(async->fds[1]);
+    }
+#else
+    (void)async;
+#endif
+}
+
+argon2_async *argon2_async_create(uint32_t workers, uint32_t capacity) {
+    argon2_async *async;
+    uint32_t i;
+
+    if (workers == 0 || capacity == 0) {
+        return NULL;
+    }
+
+    async = calloc(1, sizeof(argon2_async));
+    if (async == NULL) {
+        return NULL;
+    }
+    async->jobs = calloc(capacity, sizeof(argon2_async_job));
+    async->tasks = calloc(workers, sizeof(argon2_pool_task));
+    if (async->jobs == NULL || async->tasks == NULL) {
+        goto fail;
+    }
+    for (i = 0; i < capacity; ++i) {
+        async->jobs[i].next = async->free_jobs;
+        async->free_jobs = &async->jobs[i];
+    }
+    for (i = 0; i < workers; ++i) {
+        async->tasks[i].func = &async_worker;
+        async->tasks[i].arg = async;
+    }
+    async->threads = argon2_cpu_count() / workers;
+    if (async->threads == 0) {
+        async->threads = 1;
+    }
+
+    if (argon2_mutex_init(&async->mutex)) {
+        goto fail;
+    }
+    if (argon2_cond_init(&async->work)) {
+        argon2_mutex_destroy(&async->mutex);
+        goto fail;
+    }
+    if (argon2_cond_init(&async->done)) {
+        argon2_cond_destroy(&async->work);
+        argon2_mutex_destroy(&async->mutex);
+        goto fail;
+    }
+    open_fds(async);
+
+    /* The workers stay on their pool threads until argon2_async_destroy */
+    async->live = workers;
+    if (argon2_pool_submit(async->tasks, workers)) {
+        close_fds(async);
+        argon2_cond_destroy(&async->done);
+        argon2_cond_destroy(&async->work);
+        argon2_mutex_destroy(&async->mutex);
+        goto fail;
+    }
+    return async;
+
+fail:
+    free(async->tasks);
+    free(async->jobs);
+    free(async);
+    return NULL;
+}
+
+void argon2_async_destroy(argon2_async *async) {
+    argon2_async_job *job;
+
+    if (async == NULL) {
+        return;
+    }
+
+    argon2_mutex_lock(&async->mutex);
+    while ((job = async->pending_head) != NULL) {
+        async->pending_head = job->next;
+        job->result = ARGON2_ASYNC_CANCELLED;
+        push_done(async, job);
+    }
+    async->pending_tail = NULL;
+    async->stopping = 1;
+    argon2_cond_broadcast(&async->work);
+    while (async->live != 0) {
+        argon2_cond_wait(&async->done, &async->mutex);
+    }
+    argon2_mutex_unlock(&async->mutex);
+
+    argon2_async_poll(async, 0);
+
+    close_fds(async);
+    argon2_cond_destroy(&async->done);
+    argon2_cond_destroy(&async->work);
+    argon2_mutex_destroy(&async->mutex);
+    free(async->tasks);
+    free(async->jobs);
+    free(async);
+}
+
+int argon2_async_submit(argon2_async *async, argon2_context *context,
+                        argon2_type type, argon2_async_callback callback,
+                        void *user, uint64_t *id) {
+    argon2_async_job *job;
+
+    if (async == NULL || context == NULL) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+
+    argon2_mutex_lock(&async->mutex);
+    job = async->free_jobs;
+    if (job == NULL || async->stopping) {
+        argon2_mutex_unlock(&async->mutex);
+        return ARGON2_ASYNC_QUEUE_FULL;
+    }
+    async->free_jobs = job->next;
+
+    job->context = context;
+    job->type = type;
+    job->callback = callback;
+    job->user = user;
+    job->id = ++async->last_id;
+    job->result = ARGON2_OK;
+    job->next = NULL;
+    if (async->pending_tail != NULL) {
+        async->pending_tail->next = job;
+    } else {
+        async->pending_head = job;
+    }
+    async->pending_tail = job;
+    async->outstanding++;
+    if (id != NULL) {
+        *id = job->id;
+    }
+    argon2_cond_signal(&async->work);
+    argon2_mutex_unlock(&async->mutex);
+
+    return ARGON2_OK;
+}
+
+int argon2_async_cancel(argon2_async *async, uint64_t id) {
+    argon2_async_job *job, *previous = NULL;
+    int ret = ARGON2_INCORRECT_PARAMETER;
+
+    if (async == NULL) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+
+    argon2_mutex_lock(&async->mutex);
+    for (job = async->pending_head; job != NULL; job = job->next) {
+        if (job->id == id) {
+            if (previous != NULL) {
+                previous->next = job->next;
+            } else {
+                async->pending_head = job->next;
+            }
+            if (async->pending_tail == job) {
+                async->pending_tail = previous;
+            }
+            job->result = ARGON2_ASYNC_CANCELLED;
+            push_done(async, job);
+            ret = ARGON2_OK;
+            break;
+        }
+        previous = job;
+    }
+    argon2_mutex_unlock(&async->mutex);
+
+    return ret;
+}
+
+uint32_t argon2_async_poll(argon2_async *async, int wait) {
+    argon2_async_job *list, *job, *last = NULL;
+    uint32_t count = 0;
+
+    if (async == NULL) {
+        return 0;
+    }
+
+    argon2_mutex_lock(&async->mutex);
+    while (wait && async->done_head == NULL && async->outstanding != 0) {
+        argon2_cond_wait(&async->done, &async->mutex);
+    }
+    drain(async);
+    list = async->done_head;
+    async->done_head = async->done_tail = NULL;
+    argon2_mutex_unlock(&async->mutex);
+
+    for (job = list; job != NULL; job = job->next) {
+        if (job->callback != NULL) {
+            job->callback(job->context, job->result, job->user);
+        }
+        last = job;
+        ++count;
+    }
+
+    if (last != NULL) {
+        argon2_mutex_lock(&async->mutex);
+        last->next = async->free_jobs;
+        async->free_jobs = list;
+        async->outstanding -= count;
+        argon2_mutex_unlock(&async->mutex);
+    }
+    return count;
+}
+
+int argon2_async_fd(const argon2_async *async) {
+    return async != NULL ? async->fds[0] : -1;
+}
+
+#else /* ARGON2_NO_THREADS */
+
+argon2_async *argon2_async_create(uint32_t workers, uint32_t capacity) {
+    (void)workers;
+    (void)capacity;
+    return NULL;
+}
+
+void argon2_async_destroy(argon2_async *async) { (void)async; }
+
+int argon2_async_submit(argon2_async *async, argon2_context *context,
+                        argon2_type type, argon2_async_callback callback,
+                        void *user, uint64_t *id) {
+    (void)async;
+    (void)context;
+    (void)type;
+    (void)callback;
+    (void)user;
+    (void)id;
+    return ARGON2_INCORRECT_PARAMETER;
+}
+
+int argon2_async_cancel(argon2_async *async, uint64_t id) {
+    (void)async;
+    (void)id;
+    return ARGON2_INCORRECT_PARAMETER;
+}
+
+uint32_t argon2_async_poll(argon2_async *async, int wait) {
+    (void)async;
+    (void)wait;
+    return 0;
+}
+
+int argon2_async_fd(const argon2_async *async) {
+    (void)async;
+    return -1;
+}
+
+#endif /* ARGON2_NO_THREADS */
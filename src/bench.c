@@ -15,97 +15,638 @@
  * software. If not, they may be obtained at the above URLs.
  */
 
+#if defined(__linux__)
+#define _GNU_SOURCE /* clock_gettime, syscall */
+#elif !defined(_WIN32)
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+#endif
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#ifdef _MSC_VER
-#include <intrin.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #endif
 
 #include "argon2.h"
+#include "core.h"
 
-static uint64_t rdtsc(void) {
-#ifdef _MSC_VER
-    return __rdtsc();
-#else
-#if defined(__amd64__) || defined(__x86_64__)
-    uint64_t rax, rdx;
-    __asm__ __volatile__("rdtsc" : "=a"(rax), "=d"(rdx) : :);
-    return (rdx << 32) | rax;
-#elif defined(__i386__) || defined(__i386) || defined(__X86__)
-    uint64_t rax;
-    __asm__ __volatile__("rdtsc" : "=A"(rax) : :);
-    return rax;
+#define BENCH_INLEN 16
+#define BENCH_OUTLEN 16
+#define MAX_LIST 32
+#define WARMUP_DEF 1
+#define REPS_DEF 5
+
+enum { FORMAT_TEXT, FORMAT_CSV, FORMAT_JSON };
+
+/* How the first pass writes its blocks, for -s */
+enum { STORES_REGULAR, STORES_STREAM };
+static const char *const store_names[] = {"regular", "stream"};
+
+/* Last-level cache misses counted with -P: the loads, and the stores,
+ * which are mostly reads for ownership */
+enum { MISS_LOADS, MISS_STORES, MISS_COUNTERS };
+
+/* Parameter grid and settings of a run */
+typedef struct bench_options {
+    uint32_t t_costs[MAX_LIST], log_m_costs[MAX_LIST], lanes[MAX_LIST];
+    unsigned n_t_costs, n_log_m_costs, n_lanes;
+    argon2_type types[3];
+    unsigned n_types;
+    const char *kernels[MAX_LIST]; /* NULL for the automatic choice */
+    unsigned n_kernels;
+    int stores[2]; /* STORES_* */
+    unsigned n_stores;
+    int count_misses;
+    unsigned warmup, reps;
+    int format;
+} bench_options;
+
+/* Median and 99th percentile of each phase over the repetitions of one
+ * point of the grid, in seconds, and the median cache misses of the fill
+ * phase, negative when they were not counted */
+typedef struct bench_result {
+    double median, p99;
+    double init, fill, final;
+    double misses[MISS_COUNTERS];
+} bench_result;
+
+static void usage(const char *cmd) {
+    printf("Usage:  %s [-h] [-t list] [-m list] [-p list] [-y list] "
+           "[-K list|all] [-s list] [-P] [-w N] [-r N] [-f text|csv|json]\n",
+           cmd);
+    printf("\tLists are comma-separated, e.g. -m 10,16,20\n");
+    printf("Parameters:\n");
+    printf("\t-t list\t\tNumbers of iterations (default 3)\n");
+    printf("\t-m list\t\tMemory usages, as log2 of KiB (default "
+           "10,12,14,16,18,20)\n");
+    printf("\t-p list\t\tParallelism, lanes = threads (default 1,2,4,8)\n");
+    printf("\t-y list\t\tArgon2 types among i, d and id (default i,d,id)\n");
+    printf("\t-K list\t\tFill kernels to compare, or all of those the CPU "
+           "supports (default: the automatic choice)\n");
+    printf("\t-s list\t\tFirst pass stores to compare among regular and "
+           "stream, see ARGON2_FLAG_STREAM_STORES (default regular)\n");
+    printf("\t-P\t\tCount the last-level cache load and store misses of "
+           "the fill phase on the calling thread (Linux perf events; the "
+           "whole fill with -p 1)\n");
+    printf("\t-w N\t\tUntimed warmup hashes per point (default %d)\n",
+           WARMUP_DEF);
+    printf("\t-r N\t\tTimed hashes per point (default %d)\n", REPS_DEF);
+    printf("\t-f format\tOutput as text, csv or json (default text)\n");
+    printf("\t-h\t\tPrint %s usage\n", cmd);
+}
+
+static void fatal(const char *error) {
+    fprintf(stderr, "Error: %s\n", error);
+    exit(1);
+}
+
+/* Wall-clock time in seconds from an arbitrary origin */
+static double now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / (double)frequency.QuadPart;
 #else
-#error "Not implemented!"
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
 #endif
+}
+
+#if defined(__linux__) && defined(SYS_perf_event_open)
+/* Opens a counter of last-level cache misses of the calling thread, for
+ * @op one of the PERF_COUNT_HW_CACHE_OP_*
+ * @return The file descriptor, or -1 if perf events are not available */
+static int open_miss_counter(unsigned op) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_LL | (op << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void open_miss_counters(int *fds) {
+    fds[MISS_LOADS] = open_miss_counter(PERF_COUNT_HW_CACHE_OP_READ);
+    fds[MISS_STORES] = open_miss_counter(PERF_COUNT_HW_CACHE_OP_WRITE);
+}
+
+static void start_miss_counters(const int *fds) {
+    unsigned c;
+    for (c = 0; c < MISS_COUNTERS; ++c) {
+        if (fds[c] >= 0) {
+            ioctl(fds[c], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[c], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+/* Stops the counters and stores their counts in @counts, -1 for those
+ * that could not be read */
+static void stop_miss_counters(const int *fds, double *counts) {
+    unsigned c;
+    for (c = 0; c < MISS_COUNTERS; ++c) {
+        uint64_t count;
+        counts[c] = -1;
+        if (fds[c] >= 0) {
+            ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fds[c], &count, sizeof(count)) == sizeof(count)) {
+                counts[c] = (double)count;
+            }
+        }
+    }
+}
+
+static void close_miss_counters(const int *fds) {
+    unsigned c;
+    for (c = 0; c < MISS_COUNTERS; ++c) {
+        if (fds[c] >= 0) {
+            close(fds[c]);
+        }
+    }
+}
+#else
+static void open_miss_counters(int *fds) {
+    fds[MISS_LOADS] = fds[MISS_STORES] = -1;
+}
+
+static void start_miss_counters(const int *fds) { (void)fds; }
+
+static void stop_miss_counters(const int *fds, double *counts) {
+    (void)fds;
+    counts[MISS_LOADS] = counts[MISS_STORES] = -1;
+}
+
+static void close_miss_counters(const int *fds) { (void)fds; }
 #endif
+
+/* Parses a comma-separated list of numbers into @list
+ * @return Number of entries */
+static unsigned parse_numbers(const char *arg, uint32_t *list,
+                              const char *what) {
+    unsigned n = 0;
+    char *end;
+
+    for (;;) {
+        unsigned long value = strtoul(arg, &end, 10);
+        if (end == arg || value > UINT32_MAX || n == MAX_LIST) {
+            fprintf(stderr, "Error: bad list for %s\n", what);
+            exit(1);
+        }
+        list[n++] = (uint32_t)value;
+        if (*end == '\0') {
+            return n;
+        }
+        if (*end != ',') {
+            fprintf(stderr, "Error: bad list for %s\n", what);
+            exit(1);
+        }
+        arg = end + 1;
+    }
+}
+
+static void parse_types(const char *arg, bench_options *options) {
+    const char *p = arg;
+
+    options->n_types = 0;
+    while (*p != '\0') {
+        size_t len = strcspn(p, ",");
+        argon2_type type;
+
+        if (len == 1 && p[0] == 'i') {
+            type = Argon2_i;
+        } else if (len == 1 && p[0] == 'd') {
+            type = Argon2_d;
+        } else if (len == 2 && strncmp(p, "id", 2) == 0) {
+            type = Argon2_id;
+        } else {
+            fatal("bad list for -y");
+        }
+        if (options->n_types == 3) {
+            fatal("bad list for -y");
+        }
+        options->types[options->n_types++] = type;
+        p += len;
+        if (*p == ',') {
+            ++p;
+        }
+    }
+    if (options->n_types == 0) {
+        fatal("bad list for -y");
+    }
+}
+
+/* Keeps the kernels of @arg (or all of them) that this CPU can run */
+static void parse_kernels(char *arg, bench_options *options) {
+    unsigned i;
+    const char *kernel;
+    char *name;
+
+    options->n_kernels = 0;
+    if (strcmp(arg, "all") == 0) {
+        for (i = 0; (kernel = argon2_builtin_kernel(i)) != NULL; ++i) {
+            if (argon2_select_kernel(kernel) == ARGON2_OK &&
+                options->n_kernels < MAX_LIST) {
+                options->kernels[options->n_kernels++] = kernel;
+            }
+        }
+    } else {
+        for (name = strtok(arg, ","); name != NULL; name = strtok(NULL, ",")) {
+            if (argon2_select_kernel(name) != ARGON2_OK) {
+                fprintf(stderr, "Error: kernel %s is not available\n", name);
+                exit(1);
+            }
+            if (options->n_kernels == MAX_LIST) {
+                fatal("bad list for -K");
+            }
+            options->kernels[options->n_kernels++] = name;
+        }
+    }
+    argon2_select_kernel(NULL);
+    if (options->n_kernels == 0) {
+        fatal("no kernel to benchmark");
+    }
+}
+
+static void parse_stores(const char *arg, bench_options *options) {
+    const char *p = arg;
+
+    options->n_stores = 0;
+    while (*p != '\0') {
+        size_t len = strcspn(p, ",");
+        int stores;
+
+        if (len == 7 && strncmp(p, "regular", 7) == 0) {
+            stores = STORES_REGULAR;
+        } else if (len == 6 && strncmp(p, "stream", 6) == 0) {
+            stores = STORES_STREAM;
+        } else {
+            fatal("bad list for -s");
+        }
+        if (options->n_stores == 2) {
+            fatal("bad list for -s");
+        }
+        options->stores[options->n_stores++] = stores;
+        p += len;
+        if (*p == ',') {
+            ++p;
+        }
+    }
+    if (options->n_stores == 0) {
+        fatal("bad list for -s");
+    }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Sorts @samples and returns the @percent-th percentile, by nearest rank */
+static double percentile(double *samples, unsigned n, unsigned percent) {
+    unsigned rank = (n * percent + 99) / 100;
+
+    qsort(samples, n, sizeof(double), compare_doubles);
+    return samples[rank == 0 ? 0 : rank - 1];
 }
 
 /*
- * Benchmarks Argon2 with salt length 16, password length 16, t_cost 3,
-   and different m_cost and threads
+ * Times @warmup + @reps hashes with the same parameters, split into the
+ * phases of argon2_ctx()
+ * @return ARGON2_OK, or the error of the first failed hash
  */
-static void benchmark() {
-#define BENCH_OUTLEN 16
-#define BENCH_INLEN 16
-    const uint32_t inlen = BENCH_INLEN;
-    const unsigned outlen = BENCH_OUTLEN;
+static int bench_point(argon2_type type, uint32_t t_cost, uint32_t m_cost,
+                       uint32_t lanes, int stores,
+                       const bench_options *options, bench_result *result) {
     unsigned char out[BENCH_OUTLEN];
-    unsigned char pwd_array[BENCH_INLEN];
-    unsigned char salt_array[BENCH_INLEN];
-#undef BENCH_INLEN
-#undef BENCH_OUTLEN
+    unsigned char pwd[BENCH_INLEN];
+    unsigned char salt[BENCH_INLEN];
+    double *samples = calloc((4 + MISS_COUNTERS) * (size_t)options->reps,
+                             sizeof(double));
+    double *total = samples, *init = samples + options->reps;
+    double *fill = init + options->reps, *final = fill + options->reps;
+    double *misses = final + options->reps; /* MISS_COUNTERS per rep */
+    int fds[MISS_COUNTERS];
+    unsigned i, c;
+    int ret = ARGON2_OK;
 
-    uint32_t t_cost = 3;
-    uint32_t m_cost;
-    uint32_t thread_test[4] = {1, 2, 4,  8};
-    argon2_type types[3] = {Argon2_i, Argon2_d, Argon2_id};
+    if (samples == NULL) {
+        fatal("could not allocate memory for samples");
+    }
+    memset(pwd, 0, sizeof(pwd));
+    memset(salt, 1, sizeof(salt));
+    fds[MISS_LOADS] = fds[MISS_STORES] = -1;
+    if (options->count_misses) {
+        open_miss_counters(fds);
+    }
 
-    memset(pwd_array, 0, inlen);
-    memset(salt_array, 1, inlen);
+    for (i = 0; i < options->warmup + options->reps; ++i) {
+        argon2_context context;
+        argon2_instance_t instance;
+        double start, initialized, filled, finalized;
+        double counts[MISS_COUNTERS];
 
-    for (m_cost = (uint32_t)1 << 10; m_cost <= (uint32_t)1 << 22; m_cost *= 2) {
-        unsigned i;
-        for (i = 0; i < 4; ++i) {
-            double run_time = 0;
-            uint32_t thread_n = thread_test[i];
+        memset(&context, 0, sizeof(context));
+        context.out = out;
+        context.outlen = sizeof(out);
+        context.pwd = pwd;
+        context.pwdlen = sizeof(pwd);
+        context.salt = salt;
+        context.saltlen = sizeof(salt);
+        context.t_cost = t_cost;
+        context.m_cost = m_cost;
+        context.lanes = lanes;
+        context.threads = lanes;
+        context.version = ARGON2_VERSION_NUMBER;
+        if (stores == STORES_STREAM) {
+            context.flags |= ARGON2_FLAG_STREAM_STORES;
+        }
 
-            unsigned j;
-            for (j = 0; j < 3; ++j) {
-                clock_t start_time, stop_time;
-                uint64_t start_cycles, stop_cycles;
-                uint64_t delta;
-                double mcycles;
-
-                argon2_type type = types[j];
-                start_time = clock();
-                start_cycles = rdtsc();
-
-                argon2_hash(t_cost, m_cost, thread_n, pwd_array, inlen,
-                            salt_array, inlen, out, outlen, NULL, 0, type,
-                            ARGON2_VERSION_NUMBER);
-
-                stop_cycles = rdtsc();
-                stop_time = clock();
-
-                delta = (stop_cycles - start_cycles) / (m_cost);
-                mcycles = (double)(stop_cycles - start_cycles) / (1UL << 20);
-                run_time += ((double)stop_time - start_time) / (CLOCKS_PER_SEC);
-
-                printf("%s %d iterations  %d MiB %d threads:  %2.2f cpb %2.2f "
-                       "Mcycles \n", argon2_type2string(type, 1), t_cost,
-                       m_cost >> 10, thread_n, (float)delta / 1024, mcycles);
+        start = now();
+        ret = prepare_instance(&instance, &context, type, NULL);
+        if (ret == ARGON2_OK) {
+            ret = initialize(&instance, &context);
+        }
+        if (ret != ARGON2_OK) {
+            break;
+        }
+        initialized = now();
+        start_miss_counters(fds);
+        ret = fill_memory_blocks(&instance);
+        stop_miss_counters(fds, counts);
+        if (ret != ARGON2_OK) {
+            free_memory(&context, (uint8_t *)instance.memory,
+                        instance.memory_blocks, sizeof(block));
+            break;
+        }
+        filled = now();
+        finalize(&context, &instance);
+        finalized = now();
+
+        if (i >= options->warmup) {
+            unsigned r = i - options->warmup;
+            total[r] = finalized - start;
+            init[r] = initialized - start;
+            fill[r] = filled - initialized;
+            final[r] = finalized - filled;
+            for (c = 0; c < MISS_COUNTERS; ++c) {
+                misses[c * options->reps + r] = counts[c];
             }
+        }
+    }
 
-            printf("%2.4f seconds\n\n", run_time);
+    if (ret == ARGON2_OK) {
+        result->median = percentile(total, options->reps, 50);
+        result->p99 = percentile(total, options->reps, 99);
+        result->init = percentile(init, options->reps, 50);
+        result->fill = percentile(fill, options->reps, 50);
+        result->final = percentile(final, options->reps, 50);
+        for (c = 0; c < MISS_COUNTERS; ++c) {
+            result->misses[c] =
+                percentile(misses + c * options->reps, options->reps, 50);
         }
     }
+    close_miss_counters(fds);
+    free(samples);
+    return ret;
+}
+
+/* Writes a miss count for the csv (@json 0) or json output */
+static void print_misses(double count, int json) {
+    if (count >= 0) {
+        printf("%.0f", count);
+    } else if (json) {
+        printf("null");
+    }
 }
 
-int main() {
-    benchmark();
+static void print_result(const bench_options *options, int first,
+                         argon2_type type, uint32_t t_cost, uint32_t m_cost,
+                         uint32_t lanes, int stores,
+                         const bench_result *result) {
+    const char *type_name = argon2_type2string(type, 1);
+    const char *kernel = argon2_kernel_name();
+    const char *store_name = store_names[stores];
+    double hashes = 1.0 / result->median;
+    double bandwidth =
+        (double)m_cost / 1024 * t_cost / result->median / lanes;
+    /* What the fill phase alone writes, over all threads */
+    double fill_bandwidth = (double)m_cost / 1024 * t_cost / result->fill;
+
+    switch (options->format) {
+    case FORMAT_CSV:
+        if (first) {
+            printf("type,kernel,stores,t_cost,m_cost_kib,lanes,threads,reps,"
+                   "median_ms,p99_ms,hashes_per_s,mib_per_s_per_core,"
+                   "init_ms,fill_ms,finalize_ms,fill_mib_per_s,"
+                   "llc_load_misses,llc_store_misses\n");
+        }
+        printf("%s,%s,%s,%u,%u,%u,%u,%u,%.4f,%.4f,%.2f,%.1f,%.4f,%.4f,%.4f,"
+               "%.1f,",
+               type_name, kernel, store_name, (unsigned)t_cost,
+               (unsigned)m_cost, (unsigned)lanes, (unsigned)lanes,
+               options->reps, result->median * 1e3, result->p99 * 1e3,
+               hashes, bandwidth, result->init * 1e3, result->fill * 1e3,
+               result->final * 1e3, fill_bandwidth);
+        print_misses(result->misses[MISS_LOADS], 0);
+        printf(",");
+        print_misses(result->misses[MISS_STORES], 0);
+        printf("\n");
+        break;
+    case FORMAT_JSON:
+        printf("%s\n  {\"type\": \"%s\", \"kernel\": \"%s\", "
+               "\"stores\": \"%s\", \"t_cost\": %u, "
+               "\"m_cost_kib\": %u, \"lanes\": %u, \"threads\": %u, "
+               "\"reps\": %u, \"median_ms\": %.4f, \"p99_ms\": %.4f, "
+               "\"hashes_per_s\": %.2f, \"mib_per_s_per_core\": %.1f, "
+               "\"init_ms\": %.4f, \"fill_ms\": %.4f, \"finalize_ms\": %.4f, "
+               "\"fill_mib_per_s\": %.1f, \"llc_load_misses\": ",
+               first ? "[" : ",", type_name, kernel, store_name,
+               (unsigned)t_cost, (unsigned)m_cost, (unsigned)lanes,
+               (unsigned)lanes, options->reps, result->median * 1e3,
+               result->p99 * 1e3, hashes, bandwidth, result->init * 1e3,
+               result->fill * 1e3, result->final * 1e3, fill_bandwidth);
+        print_misses(result->misses[MISS_LOADS], 1);
+        printf(", \"llc_store_misses\": ");
+        print_misses(result->misses[MISS_STORES], 1);
+        printf("}");
+        break;
+    default:
+        printf("%s %-7s %-7s t=%u m=%u KiB p=%u: median %.3f ms, "
+               "p99 %.3f ms, %.1f H/s, %.1f MiB/s/core (init %.3f, "
+               "fill %.3f at %.1f MiB/s, finalize %.3f ms)",
+               type_name, kernel, store_name, (unsigned)t_cost,
+               (unsigned)m_cost, (unsigned)lanes, result->median * 1e3,
+               result->p99 * 1e3, hashes, bandwidth, result->init * 1e3,
+               result->fill * 1e3, fill_bandwidth, result->final * 1e3);
+        if (options->count_misses) {
+            if (result->misses[MISS_LOADS] >= 0 &&
+                result->misses[MISS_STORES] >= 0) {
+                printf(", LLC misses %.0f loads %.0f stores",
+                       result->misses[MISS_LOADS],
+                       result->misses[MISS_STORES]);
+            } else {
+                printf(", LLC misses not available");
+            }
+        }
+        printf("\n");
+        break;
+    }
+}
+
+/* Runs the parameter grid with the current kernel and @stores */
+static void benchmark_grid(const bench_options *options, int stores,
+                           int *first) {
+    unsigned y, t, m, p;
+
+    for (y = 0; y < options->n_types; ++y) {
+        for (t = 0; t < options->n_t_costs; ++t) {
+            for (m = 0; m < options->n_log_m_costs; ++m) {
+                for (p = 0; p < options->n_lanes; ++p) {
+                    bench_result result;
+                    uint32_t m_cost = UINT32_C(1) << options->log_m_costs[m];
+                    int ret;
+
+                    memset(&result, 0, sizeof(result));
+                    ret = bench_point(options->types[y], options->t_costs[t],
+                                      m_cost, options->lanes[p], stores,
+                                      options, &result);
+                    if (ret != ARGON2_OK) {
+                        fprintf(stderr, "Skipping m=%u KiB p=%u: %s\n",
+                                (unsigned)m_cost, (unsigned)options->lanes[p],
+                                argon2_error_message(ret));
+                        continue;
+                    }
+                    print_result(options, *first, options->types[y],
+                                 options->t_costs[t], m_cost,
+                                 options->lanes[p], stores, &result);
+                    *first = 0;
+                }
+            }
+        }
+    }
+}
+
+static void benchmark(const bench_options *options) {
+    unsigned k, s;
+    int first = 1;
+
+    for (k = 0; k < options->n_kernels; ++k) {
+        argon2_select_kernel(options->kernels[k]);
+        for (s = 0; s < options->n_stores; ++s) {
+            benchmark_grid(options, options->stores[s], &first);
+        }
+    }
+    argon2_select_kernel(NULL);
+
+    if (options->format == FORMAT_JSON) {
+        printf("%s\n", first ? "[]" : "\n]");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bench_options options;
+    int i;
+
+    memset(&options, 0, sizeof(options));
+    options.t_costs[0] = 3;
+    options.n_t_costs = 1;
+    for (i = 0; i < 6; ++i) {
+        options.log_m_costs[i] = 10 + 2 * i;
+    }
+    options.n_log_m_costs = 6;
+    for (i = 0; i < 4; ++i) {
+        options.lanes[i] = UINT32_C(1) << i;
+    }
+    options.n_lanes = 4;
+    options.types[0] = Argon2_i;
+    options.types[1] = Argon2_d;
+    options.types[2] = Argon2_id;
+    options.n_types = 3;
+    options.kernels[0] = NULL;
+    options.n_kernels = 1;
+    options.stores[0] = STORES_REGULAR;
+    options.n_stores = 1;
+    options.warmup = WARMUP_DEF;
+    options.reps = REPS_DEF;
+    options.format = FORMAT_TEXT;
+
+    for (i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (!strcmp(a, "-h")) {
+            usage(argv[0]);
+            return 0;
+        }
+        if (!strcmp(a, "-P")) {
+            options.count_misses = 1;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        ++i;
+        if (!strcmp(a, "-t")) {
+            options.n_t_costs = parse_numbers(argv[i], options.t_costs, a);
+        } else if (!strcmp(a, "-m")) {
+            unsigned j;
+            options.n_log_m_costs =
+                parse_numbers(argv[i], options.log_m_costs, a);
+            for (j = 0; j < options.n_log_m_costs; ++j) {
+                if (options.log_m_costs[j] > 31) {
+                    fatal("m_cost overflow");
+                }
+            }
+        } else if (!strcmp(a, "-p")) {
+            options.n_lanes = parse_numbers(argv[i], options.lanes, a);
+        } else if (!strcmp(a, "-y")) {
+            parse_types(argv[i], &options);
+        } else if (!strcmp(a, "-K")) {
+            parse_kernels(argv[i], &options);
+        } else if (!strcmp(a, "-s")) {
+            parse_stores(argv[i], &options);
+        } else if (!strcmp(a, "-w") || !strcmp(a, "-r")) {
+            uint32_t value[MAX_LIST];
+            if (parse_numbers(argv[i], value, a) != 1) {
+                fatal("bad numeric input");
+            }
+            if (a[1] == 'w') {
+                options.warmup = value[0];
+            } else if (value[0] == 0) {
+                fatal("-r must be at least 1");
+            } else {
+                options.reps = value[0];
+            }
+        } else if (!strcmp(a, "-f")) {
+            if (!strcmp(argv[i], "text")) {
+                options.format = FORMAT_TEXT;
+            } else if (!strcmp(argv[i], "csv")) {
+                options.format = FORMAT_CSV;
+            } else if (!strcmp(argv[i], "json")) {
+                options.format = FORMAT_JSON;
+            } else {
+                fatal("unknown output format");
+            }
+        } else {
+            fatal("unknown argument");
+        }
+    }
+
+    benchmark(&options);
     return ARGON2_OK;
 }
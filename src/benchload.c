@@ -0,0 +1,746 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+/*
+ * Load generator: concurrent clients verifying passwords, to measure the
+ * throughput and tail latency of a server under load rather than the time
+ * of one hash.
+ */
+
+#if !defined(_WIN32)
+#define _XOPEN_SOURCE 600 /* clock_gettime, nanosleep, poll, getrusage */
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/resource.h>
+#endif
+
+#include "argon2.h"
+#include "thread.h"
+
+#define LOAD_PWD "load-generator password"
+#define LOAD_SALT "load-generator salt"
+#define LOAD_OUTLEN 32
+#define CLIENTS_DEF 4
+#define DURATION_DEF 10
+#define WARMUP_DEF 1
+#define BATCH_DEF 2
+#define MAX_BATCH 64
+
+enum { API_VERIFY, API_BATCH, API_ASYNC };
+enum { FORMAT_TEXT, FORMAT_CSV, FORMAT_JSON };
+
+/* Settings of a run */
+typedef struct load_options {
+    int api;
+    uint32_t clients;  /* client threads, or requests in flight for async */
+    double rate;       /* requests per second over all clients, 0 = closed */
+    double duration;   /* measured seconds */
+    double warmup;     /* seconds before measuring */
+    uint32_t batch;    /* hashes per request of the batch API */
+    uint32_t workers;  /* hashes at the same time for the async API */
+    uint32_t t_cost, m_cost, lanes, threads;
+    argon2_type type;
+    uint32_t flags;      /* ARGON2_FLAG_HUGE_PAGES, ARGON2_FLAG_NUMA */
+    int workspaces;      /* verify in an argon2_workspace_pool */
+    int format;
+} load_options;
+
+/* What every request checks the password against */
+typedef struct load_target {
+    char encoded[256];
+    argon2_encoded_params params;
+    argon2_workspace_pool *pool; /* NULL unless options.workspaces */
+} load_target;
+
+/* Latencies and counters of one client */
+typedef struct load_client {
+    const load_options *options;
+    const load_target *target;
+    uint32_t index;
+    double *latencies; /* seconds, of the measured requests */
+    size_t count, capacity;
+    uint64_t hashes, errors, dropped;
+#if !defined(ARGON2_NO_THREADS)
+    argon2_thread_handle_t handle;
+#endif
+} load_client;
+
+/* Times of the run, from now() */
+static double run_start, run_measure, run_end;
+
+static void usage(const char *cmd) {
+    printf("Usage:  %s [-h] [-a verify|batch|async] [-c N] [-R rate] "
+           "[-d seconds] [-w seconds] [-t N] [-m N] [-p N] [-T N] "
+           "[-y i|d|id] [-b N] [-j N] [-H] [-N] [-W] [-f text|csv|json]\n",
+           cmd);
+    printf("Parameters:\n");
+    printf("\t-a api\t\tverify: each client calls argon2_verify (default)\n"
+           "\t\t\tbatch: each client verifies -b hashes per request with "
+           "argon2_hash_batch\n"
+           "\t\t\tasync: -c requests in flight on an argon2_async queue\n");
+    printf("\t-c N\t\tClient threads, or async requests in flight "
+           "(default %d)\n", CLIENTS_DEF);
+    printf("\t-R rate\t\tOpen loop: requests per second over all clients, "
+           "latency counted from when each was due (default 0: closed "
+           "loop, each client sends as soon as its last request is done)\n");
+    printf("\t-d seconds\tMeasured duration (default %d)\n", DURATION_DEF);
+    printf("\t-w seconds\tUnmeasured warmup (default %d)\n", WARMUP_DEF);
+    printf("\t-t N\t\tIterations (default 3)\n");
+    printf("\t-m N\t\tMemory usage of 2^N KiB (default 16)\n");
+    printf("\t-p N\t\tLanes (default 1)\n");
+    printf("\t-T N\t\tThreads per hash, 0 for automatic (default: lanes)\n");
+    printf("\t-y type\t\tArgon2 type: i, d or id (default id)\n");
+    printf("\t-b N\t\tHashes per batch request (default %d)\n", BATCH_DEF);
+    printf("\t-j N\t\tAsync worker threads (default: -c)\n");
+    printf("\t-H\t\tHash with ARGON2_FLAG_HUGE_PAGES\n");
+    printf("\t-N\t\tHash with ARGON2_FLAG_NUMA\n");
+    printf("\t-W\t\tVerify in an argon2_workspace_pool of -c workspaces\n");
+    printf("\t-f format\tOutput as text, csv or json (default text)\n");
+    printf("\t-h\t\tPrint %s usage\n", cmd);
+}
+
+static void fatal(const char *error) {
+    fprintf(stderr, "Error: %s\n", error);
+    exit(1);
+}
+
+/* Wall-clock time in seconds from an arbitrary origin */
+static double now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void sleep_until(double when) {
+    double delay = when - now();
+
+    if (delay <= 0) {
+        return;
+    }
+#ifdef _WIN32
+    Sleep((DWORD)(delay * 1e3));
+#else
+    {
+        struct timespec ts;
+        ts.tv_sec = (time_t)delay;
+        ts.tv_nsec = (long)((delay - (double)ts.tv_sec) * 1e9);
+        nanosleep(&ts, NULL);
+    }
+#endif
+}
+
+/* Peak resident set size of the process in MiB, 0 if unknown */
+static double peak_rss_mib(void) {
+#if defined(_WIN32)
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return (double)usage.ru_maxrss / (1024 * 1024); /* bytes */
+#else
+    return (double)usage.ru_maxrss / 1024; /* KiB */
+#endif
+#endif
+}
+
+static uint32_t parse_number(const char *arg, const char *what) {
+    char *end;
+    unsigned long value = strtoul(arg, &end, 10);
+
+    if (end == arg || *end != '\0' || value > UINT32_MAX) {
+        fprintf(stderr, "Error: bad numeric input for %s\n", what);
+        exit(1);
+    }
+    return (uint32_t)value;
+}
+
+static double parse_seconds(const char *arg, const char *what) {
+    char *end;
+    double value = strtod(arg, &end);
+
+    if (end == arg || *end != '\0' || value < 0) {
+        fprintf(stderr, "Error: bad numeric input for %s\n", what);
+        exit(1);
+    }
+    return value;
+}
+
+/* Records a request that was due at @due and finished at @done */
+static void record(load_client *client, double due, double done) {
+    if (due < run_measure) {
+        return;
+    }
+    if (client->count == client->capacity) {
+        size_t capacity = client->capacity ? 2 * client->capacity : 1024;
+        double *latencies =
+            realloc(client->latencies, capacity * sizeof(double));
+        if (latencies == NULL) {
+            fatal("could not allocate memory for latencies");
+        }
+        client->latencies = latencies;
+        client->capacity = capacity;
+    }
+    client->latencies[client->count++] = done - due;
+}
+
+/* A context recomputing the hash of @target into @out */
+static void prepare_context(argon2_context *context,
+                            const load_options *options,
+                            const load_target *target, uint8_t *out) {
+    memset(context, 0, sizeof(*context));
+    context->out = out;
+    context->outlen = target->params.outlen;
+    context->pwd = (uint8_t *)LOAD_PWD;
+    context->pwdlen = (uint32_t)strlen(LOAD_PWD);
+    context->salt = (uint8_t *)target->params.salt;
+    context->saltlen = target->params.saltlen;
+    context->t_cost = target->params.t_cost;
+    context->m_cost = target->params.m_cost;
+    context->lanes = target->params.lanes;
+    context->threads = options->threads;
+    context->version = target->params.version;
+    context->flags = options->flags;
+}
+
+/* Whether a recomputed hash matches @target */
+static int matches(const load_target *target, const uint8_t *out) {
+    return memcmp(out, target->params.hash, target->params.outlen) == 0;
+}
+
+/* One verification, through the public API when nothing is tuned */
+static int verify_once(const load_client *client) {
+    const load_options *options = client->options;
+    const load_target *target = client->target;
+    argon2_context context;
+    argon2_workspace *workspace;
+    uint8_t out[ARGON2_ENCODED_MAX_OUTLEN];
+    int ret;
+
+    if (options->flags == 0 && options->threads == options->lanes &&
+        target->pool == NULL) {
+        return argon2_verify(target->encoded, LOAD_PWD, strlen(LOAD_PWD),
+                             options->type);
+    }
+
+    prepare_context(&context, options, target, out);
+    if (target->pool == NULL) {
+        return argon2_verify_ctx(&context, (const char *)target->params.hash,
+                                 options->type);
+    }
+    workspace = argon2_workspace_acquire(target->pool);
+    ret = argon2_ctx_workspace(&context, options->type, workspace);
+    argon2_workspace_release(target->pool, workspace);
+    if (ret == ARGON2_OK && !matches(target, out)) {
+        ret = ARGON2_VERIFY_MISMATCH;
+    }
+    return ret;
+}
+
+/* One request of -b verifications with argon2_hash_batch()
+ * @return The number that failed */
+static uint32_t verify_batch(const load_client *client) {
+    const load_options *options = client->options;
+    argon2_context contexts[MAX_BATCH];
+    uint8_t out[MAX_BATCH][ARGON2_ENCODED_MAX_OUTLEN];
+    int results[MAX_BATCH];
+    uint32_t i, failed = 0;
+
+    for (i = 0; i < options->batch; ++i) {
+        prepare_context(&contexts[i], options, client->target, out[i]);
+    }
+    argon2_hash_batch(contexts, options->batch, options->type, results);
+    for (i = 0; i < options->batch; ++i) {
+        if (results[i] != ARGON2_OK || !matches(client->target, out[i])) {
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/* Requests of one client until the end of the run. In open loop, request
+ * k of client i is due at (k * clients + i) / rate. */
+static void run_client(load_client *client) {
+    const load_options *options = client->options;
+    uint64_t k;
+
+    for (k = 0;; ++k) {
+        double due;
+
+        if (options->rate > 0) {
+            due = run_start +
+                  (double)(k * options->clients + client->index) /
+                      options->rate;
+            if (due >= run_end) {
+                break;
+            }
+            sleep_until(due);
+        } else {
+            due = now();
+            if (due >= run_end) {
+                break;
+            }
+        }
+
+        if (options->api == API_BATCH) {
+            uint32_t failed = verify_batch(client);
+            if (due >= run_measure) {
+                client->hashes += options->batch;
+                client->errors += failed;
+            }
+        } else {
+            int ret = verify_once(client);
+            if (due >= run_measure) {
+                client->hashes++;
+                client->errors += ret != ARGON2_OK;
+            }
+        }
+        record(client, due, now());
+    }
+}
+
+#if !defined(ARGON2_NO_THREADS)
+
+#ifdef _WIN32
+static unsigned __stdcall client_thread(void *arg)
+#else
+static void *client_thread(void *arg)
+#endif
+{
+    run_client((load_client *)arg);
+    return 0;
+}
+
+/* A request in flight on the async queue */
+typedef struct load_slot {
+    argon2_context context;
+    uint8_t out[ARGON2_ENCODED_MAX_OUTLEN];
+    double due;
+    int busy;
+    load_client *client;
+} load_slot;
+
+static void async_done(argon2_context *context, int result, void *user) {
+    load_slot *slot = (load_slot *)user;
+    load_client *client = slot->client;
+
+    (void)context;
+    if (slot->due >= run_measure) {
+        client->hashes++;
+        client->errors +=
+            result != ARGON2_OK || !matches(client->target, slot->out);
+    }
+    record(client, slot->due, now());
+    slot->busy = 0;
+}
+
+/* Submits a request due at @due in a free slot
+ * @return 0 if submitted, -1 if there was no room for it */
+static int async_submit(argon2_async *async, load_slot *slots, uint32_t count,
+                        double due) {
+    load_client *client = slots[0].client;
+    uint32_t i;
+
+    for (i = 0; i < count; ++i) {
+        if (!slots[i].busy) {
+            break;
+        }
+    }
+    if (i == count) {
+        return -1;
+    }
+    prepare_context(&slots[i].context, client->options, client->target,
+                    slots[i].out);
+    slots[i].due = due;
+    if (argon2_async_submit(async, &slots[i].context, client->options->type,
+                            async_done, &slots[i], NULL) != ARGON2_OK) {
+        return -1;
+    }
+    slots[i].busy = 1;
+    return 0;
+}
+
+/* Waits until a request finishes or @until, and collects the finished ones */
+static void async_wait(argon2_async *async, double until) {
+#ifndef _WIN32
+    int fd = argon2_async_fd(async);
+    if (fd >= 0) {
+        struct pollfd pfd;
+        double delay = until - now();
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        poll(&pfd, 1, delay > 0 ? (int)(delay * 1e3) + 1 : 0);
+        argon2_async_poll(async, 0);
+        return;
+    }
+#endif
+    if (argon2_async_poll(async, 0) == 0) {
+        sleep_until(now() + 1e-3 < until ? now() + 1e-3 : until);
+    }
+}
+
+/* The async API driven from one event-loop thread: -c requests kept in
+ * flight in closed loop, or requests sent at -R per second in open loop,
+ * up to 4 * -c in flight beyond which they are dropped */
+static void run_async(load_client *client) {
+    const load_options *options = client->options;
+    uint32_t count = options->rate > 0 ? 4 * options->clients
+                                       : options->clients;
+    load_slot *slots = calloc(count, sizeof(load_slot));
+    argon2_async *async = argon2_async_create(options->workers, count);
+    uint64_t k = 0;
+    uint32_t i;
+
+    if (slots == NULL || async == NULL) {
+        fatal("could not create the async queue");
+    }
+    for (i = 0; i < count; ++i) {
+        slots[i].client = client;
+    }
+
+    for (;;) {
+        double t = now();
+        if (t >= run_end) {
+            break;
+        }
+        if (options->rate > 0) {
+            double due = run_start + (double)k / options->rate;
+            if (due <= t) {
+                if (async_submit(async, slots, count, due) != 0 &&
+                    due >= run_measure) {
+                    client->dropped++;
+                }
+                ++k;
+                continue;
+            }
+            async_wait(async, due < run_end ? due : run_end);
+        } else {
+            while (async_submit(async, slots, count, t) == 0) {
+            }
+            argon2_async_poll(async, 1);
+        }
+    }
+    argon2_async_destroy(async); /* waits for those still in flight */
+    free(slots);
+}
+
+#endif /* ARGON2_NO_THREADS */
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* The @permille-th per mille of sorted @samples, by nearest rank */
+static double permille(const double *samples, size_t n, unsigned permille) {
+    size_t rank = (n * permille + 999) / 1000;
+
+    if (n == 0) {
+        return 0;
+    }
+    return samples[rank == 0 ? 0 : rank - 1];
+}
+
+static void report(const load_options *options, load_client *clients,
+                   uint32_t count) {
+    static const char *const apis[] = {"verify", "batch", "async"};
+    uint64_t hashes = 0, errors = 0, dropped = 0;
+    size_t n = 0, i;
+    uint32_t c;
+    double *all, requests_s, hashes_s, fill_mib_s, rss = peak_rss_mib();
+    double p50, p99, p999, max;
+
+    for (c = 0; c < count; ++c) {
+        n += clients[c].count;
+        hashes += clients[c].hashes;
+        errors += clients[c].errors;
+        dropped += clients[c].dropped;
+    }
+    all = malloc((n ? n : 1) * sizeof(double));
+    if (all == NULL) {
+        fatal("could not allocate memory for latencies");
+    }
+    for (n = 0, c = 0; c < count; ++c) {
+        for (i = 0; i < clients[c].count; ++i) {
+            all[n++] = clients[c].latencies[i];
+        }
+    }
+    qsort(all, n, sizeof(double), compare_doubles);
+
+    requests_s = (double)n / options->duration;
+    hashes_s = (double)hashes / options->duration;
+    /* Blocks written per second; each is also read once or twice */
+    fill_mib_s = hashes_s * (double)options->m_cost / 1024 * options->t_cost;
+    p50 = permille(all, n, 500) * 1e3;
+    p99 = permille(all, n, 990) * 1e3;
+    p999 = permille(all, n, 999) * 1e3;
+    max = n ? all[n - 1] * 1e3 : 0;
+
+    switch (options->format) {
+    case FORMAT_CSV:
+        printf("api,loop,clients,rate,t_cost,m_cost_kib,lanes,threads,"
+               "requests,hashes,errors,dropped,requests_per_s,hashes_per_s,"
+               "p50_ms,p99_ms,p999_ms,max_ms,fill_mib_per_s,peak_rss_mib\n");
+        printf("%s,%s,%u,%.1f,%u,%u,%u,%u,%lu,%lu,%lu,%lu,%.2f,%.2f,%.3f,"
+               "%.3f,%.3f,%.3f,%.1f,%.1f\n",
+               apis[options->api], options->rate > 0 ? "open" : "closed",
+               (unsigned)options->clients, options->rate,
+               (unsigned)options->t_cost, (unsigned)options->m_cost,
+               (unsigned)options->lanes, (unsigned)options->threads,
+               (unsigned long)n, (unsigned long)hashes,
+               (unsigned long)errors, (unsigned long)dropped, requests_s,
+               hashes_s, p50, p99, p999, max, fill_mib_s, rss);
+        break;
+    case FORMAT_JSON:
+        printf("{\"api\": \"%s\", \"loop\": \"%s\", \"clients\": %u, "
+               "\"rate\": %.1f, \"t_cost\": %u, \"m_cost_kib\": %u, "
+               "\"lanes\": %u, \"threads\": %u, \"requests\": %lu, "
+               "\"hashes\": %lu, \"errors\": %lu, \"dropped\": %lu, "
+               "\"requests_per_s\": %.2f, \"hashes_per_s\": %.2f, "
+               "\"p50_ms\": %.3f, \"p99_ms\": %.3f, \"p999_ms\": %.3f, "
+               "\"max_ms\": %.3f, \"fill_mib_per_s\": %.1f, "
+               "\"peak_rss_mib\": %.1f}\n",
+               apis[options->api], options->rate > 0 ? "open" : "closed",
+               (unsigned)options->clients, options->rate,
+               (unsigned)options->t_cost, (unsigned)options->m_cost,
+               (unsigned)options->lanes, (unsigned)options->threads,
+               (unsigned long)n, (unsigned long)hashes,
+               (unsigned long)errors, (unsigned long)dropped, requests_s,
+               hashes_s, p50, p99, p999, max, fill_mib_s, rss);
+        break;
+    default:
+        printf("%s, %s loop, %u clients", apis[options->api],
+               options->rate > 0 ? "open" : "closed",
+               (unsigned)options->clients);
+        if (options->rate > 0) {
+            printf(" at %.1f req/s", options->rate);
+        }
+        printf(", t=%u m=%u KiB p=%u threads=%u\n", (unsigned)options->t_cost,
+               (unsigned)options->m_cost, (unsigned)options->lanes,
+               (unsigned)options->threads);
+        printf("  %lu requests, %lu hashes, %lu errors, %lu dropped in "
+               "%.1f s\n",
+               (unsigned long)n, (unsigned long)hashes,
+               (unsigned long)errors, (unsigned long)dropped,
+               options->duration);
+        printf("  throughput %.2f req/s, %.2f H/s, %.1f MiB/s filled\n",
+               requests_s, hashes_s, fill_mib_s);
+        printf("  latency p50 %.3f ms, p99 %.3f ms, p999 %.3f ms, max %.3f "
+               "ms\n", p50, p99, p999, max);
+        printf("  peak RSS %.1f MiB\n", rss);
+        break;
+    }
+    free(all);
+}
+
+int main(int argc, char *argv[]) {
+    load_options options;
+    load_target target;
+    load_client *clients;
+    uint32_t c, count;
+    int i, ret, threads_specified = 0, workers_specified = 0;
+
+    memset(&options, 0, sizeof(options));
+    options.api = API_VERIFY;
+    options.clients = CLIENTS_DEF;
+    options.duration = DURATION_DEF;
+    options.warmup = WARMUP_DEF;
+    options.batch = BATCH_DEF;
+    options.t_cost = 3;
+    options.m_cost = UINT32_C(1) << 16;
+    options.lanes = 1;
+    options.type = Argon2_id;
+    options.format = FORMAT_TEXT;
+
+    for (i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (!strcmp(a, "-h")) {
+            usage(argv[0]);
+            return 0;
+        } else if (!strcmp(a, "-H")) {
+            options.flags |= ARGON2_FLAG_HUGE_PAGES;
+            continue;
+        } else if (!strcmp(a, "-N")) {
+            options.flags |= ARGON2_FLAG_NUMA;
+            continue;
+        } else if (!strcmp(a, "-W")) {
+            options.workspaces = 1;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        ++i;
+        if (!strcmp(a, "-a")) {
+            if (!strcmp(argv[i], "verify")) {
+                options.api = API_VERIFY;
+            } else if (!strcmp(argv[i], "batch")) {
+                options.api = API_BATCH;
+            } else if (!strcmp(argv[i], "async")) {
+                options.api = API_ASYNC;
+            } else {
+                fatal("unknown api");
+            }
+        } else if (!strcmp(a, "-c")) {
+            options.clients = parse_number(argv[i], a);
+        } else if (!strcmp(a, "-R")) {
+            options.rate = parse_seconds(argv[i], a);
+        } else if (!strcmp(a, "-d")) {
+            options.duration = parse_seconds(argv[i], a);
+        } else if (!strcmp(a, "-w")) {
+            options.warmup = parse_seconds(argv[i], a);
+        } else if (!strcmp(a, "-t")) {
+            options.t_cost = parse_number(argv[i], a);
+        } else if (!strcmp(a, "-m")) {
+            uint32_t log_m_cost = parse_number(argv[i], a);
+            if (log_m_cost > 31) {
+                fatal("m_cost overflow");
+            }
+            options.m_cost = UINT32_C(1) << log_m_cost;
+        } else if (!strcmp(a, "-p")) {
+            options.lanes = parse_number(argv[i], a);
+        } else if (!strcmp(a, "-T")) {
+            options.threads = parse_number(argv[i], a);
+            threads_specified = 1;
+        } else if (!strcmp(a, "-y")) {
+            if (!strcmp(argv[i], "i")) {
+                options.type = Argon2_i;
+            } else if (!strcmp(argv[i], "d")) {
+                options.type = Argon2_d;
+            } else if (!strcmp(argv[i], "id")) {
+                options.type = Argon2_id;
+            } else {
+                fatal("unknown type");
+            }
+        } else if (!strcmp(a, "-b")) {
+            options.batch = parse_number(argv[i], a);
+        } else if (!strcmp(a, "-j")) {
+            options.workers = parse_number(argv[i], a);
+            workers_specified = 1;
+        } else if (!strcmp(a, "-f")) {
+            if (!strcmp(argv[i], "text")) {
+                options.format = FORMAT_TEXT;
+            } else if (!strcmp(argv[i], "csv")) {
+                options.format = FORMAT_CSV;
+            } else if (!strcmp(argv[i], "json")) {
+                options.format = FORMAT_JSON;
+            } else {
+                fatal("unknown output format");
+            }
+        } else {
+            fatal("unknown argument");
+        }
+    }
+
+    if (options.clients == 0 || options.duration <= 0) {
+        fatal("-c and -d must be positive");
+    }
+    if (options.batch == 0 || options.batch > MAX_BATCH) {
+        fatal("-b must be between 1 and 64");
+    }
+    if (!threads_specified) {
+        options.threads = options.lanes;
+    }
+    if (!workers_specified) {
+        options.workers = options.clients;
+    }
+    if (options.workspaces && options.api != API_VERIFY) {
+        fatal("-W only applies to -a verify");
+    }
+#if defined(ARGON2_NO_THREADS)
+    fatal("bench-load needs a library built with threads");
+#endif
+
+    memset(&target, 0, sizeof(target));
+    ret = argon2_hash(options.t_cost, options.m_cost, options.lanes, LOAD_PWD,
+                      strlen(LOAD_PWD), LOAD_SALT, strlen(LOAD_SALT), NULL,
+                      LOAD_OUTLEN, target.encoded, sizeof(target.encoded),
+                      options.type, ARGON2_VERSION_NUMBER);
+    if (ret == ARGON2_OK) {
+        ret = argon2_encoded_parse(&target.params, target.encoded,
+                                   options.type);
+    }
+    if (ret != ARGON2_OK) {
+        fatal(argon2_error_message(ret));
+    }
+    if (options.workspaces) {
+        target.pool = argon2_workspace_pool_create(
+            options.clients, options.m_cost,
+            options.threads ? options.threads : options.lanes, options.flags);
+        if (target.pool == NULL) {
+            fatal("could not create the workspace pool");
+        }
+    }
+
+    count = options.api == API_ASYNC ? 1 : options.clients;
+    clients = calloc(count, sizeof(load_client));
+    if (clients == NULL) {
+        fatal("could not allocate memory for clients");
+    }
+    for (c = 0; c < count; ++c) {
+        clients[c].options = &options;
+        clients[c].target = &target;
+        clients[c].index = c;
+    }
+
+    run_start = now();
+    run_measure = run_start + options.warmup;
+    run_end = run_measure + options.duration;
+#if !defined(ARGON2_NO_THREADS)
+    if (options.api == API_ASYNC) {
+        run_async(&clients[0]);
+    } else {
+        for (c = 0; c < count; ++c) {
+            if (argon2_thread_create(&clients[c].handle, &client_thread,
+                                     &clients[c])) {
+                fatal("could not start the clients");
+            }
+        }
+        for (c = 0; c < count; ++c) {
+            argon2_thread_join(clients[c].handle);
+        }
+    }
+#endif
+
+    report(&options, clients, count);
+
+    for (c = 0; c < count; ++c) {
+        free(clients[c].latencies);
+    }
+    free(clients);
+    argon2_workspace_pool_destroy(target.pool);
+    return ARGON2_OK;
+}
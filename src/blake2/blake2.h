@@ -80,6 +80,19 @@ ARGON2_LOCAL int blake2b(void *out, size_t outlen, const void *in, size_t inlen,
 
 /* Argon2 Team - Begin Code */
 ARGON2_LOCAL int blake2b_long(void *out, size_t outlen, const void *in, size_t inlen);
+
+/* Multi-buffer hash: the unkeyed BLAKE2B_OUTBYTES-byte BLAKE2b hashes of
+ * @count (at most 4) messages of @inlen <= BLAKE2B_BLOCKBYTES bytes each,
+ * computed side by side in SIMD lanes */
+typedef void (*blake2b_hash4_fn)(uint8_t *const *out, const uint8_t *const *in,
+                                 size_t inlen, unsigned count);
+
+/* blake2b_long() of @count (at most 4) messages of @inlen bytes each, with
+ * the chains of 64-byte hashes advanced together by @hash4, or one message
+ * after the other when @hash4 is NULL */
+ARGON2_LOCAL int blake2b_long4(uint8_t *const *out, size_t outlen,
+                               const uint8_t *const *in, size_t inlen,
+                               unsigned count, blake2b_hash4_fn hash4);
 /* Argon2 Team - End Code */
 
 #if defined(__cplusplus)
@@ -387,4 +387,55 @@ fail:
     return ret;
 #undef TRY
 }
+
+int blake2b_long4(uint8_t *const *out, size_t outlen,
+                  const uint8_t *const *in, size_t inlen, unsigned count,
+                  blake2b_hash4_fn hash4) {
+    uint8_t in_buffer[4][BLAKE2B_BLOCKBYTES];
+    uint8_t out_buffer[4][BLAKE2B_OUTBYTES];
+    const uint8_t *in_ptrs[4];
+    uint8_t *out_ptrs[4];
+    size_t toproduce, pos;
+    unsigned j;
+    int ret = 0;
+
+    /* The chains only consist of single-block hashes of 64 bytes when the
+     * first message fits in a block and the last output is a full one */
+    if (hash4 == NULL || count < 2 || count > 4 ||
+        outlen <= BLAKE2B_OUTBYTES || outlen > UINT32_MAX ||
+        outlen % (BLAKE2B_OUTBYTES / 2) != 0 ||
+        inlen + sizeof(uint32_t) > BLAKE2B_BLOCKBYTES) {
+        for (j = 0; j < count && ret == 0; ++j) {
+            ret = blake2b_long(out[j], outlen, in[j], inlen);
+        }
+        return ret;
+    }
+
+    for (j = 0; j < count; ++j) {
+        store32(in_buffer[j], (uint32_t)outlen);
+        memcpy(in_buffer[j] + sizeof(uint32_t), in[j], inlen);
+        in_ptrs[j] = in_buffer[j];
+        out_ptrs[j] = out_buffer[j];
+    }
+    hash4(out_ptrs, in_ptrs, inlen + sizeof(uint32_t), count);
+
+    pos = 0;
+    toproduce = outlen;
+    while (toproduce > BLAKE2B_OUTBYTES) {
+        for (j = 0; j < count; ++j) {
+            memcpy(out[j] + pos, out_buffer[j], BLAKE2B_OUTBYTES / 2);
+            memcpy(in_buffer[j], out_buffer[j], BLAKE2B_OUTBYTES);
+        }
+        pos += BLAKE2B_OUTBYTES / 2;
+        toproduce -= BLAKE2B_OUTBYTES / 2;
+        hash4(out_ptrs, in_ptrs, BLAKE2B_OUTBYTES, count);
+    }
+    for (j = 0; j < count; ++j) {
+        memcpy(out[j] + pos, out_buffer[j], BLAKE2B_OUTBYTES);
+    }
+
+    clear_internal_memory(in_buffer, sizeof(in_buffer));
+    clear_internal_memory(out_buffer, sizeof(out_buffer));
+    return 0;
+}
 /* Argon2 Team - End Code */
@@ -29,8 +29,14 @@
 #include <x86intrin.h>
 #endif
 
-#if !defined(__AVX512F__)
-#if !defined(__AVX2__)
+/*
+ * The SSE macros follow the instruction set enabled at compile time, while
+ * the AVX2 and AVX-512 ones are only expanded inside functions built for
+ * that target, see ARGON2_TARGET in opt.c. All three sets can therefore be
+ * used from the same translation unit.
+ */
+#include <immintrin.h>
+
 #if !defined(__XOP__)
 #if defined(__SSSE3__)
 #define r16                                                                    \
@@ -178,9 +184,6 @@ static BLAKE2_INLINE __m128i fBlaMka(__m128i x, __m128i y) {
                                                                                \
         UNDIAGONALIZE(A0, B0, C0, D0, A1, B1, C1, D1);                         \
     } while ((void)0, 0)
-#else /* __AVX2__ */
-
-#include <immintrin.h>
 
 #define rotr32(x)   _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1))
 #define rotr24(x)   _mm256_shuffle_epi8(x, _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10, 3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10))
@@ -299,7 +302,7 @@ static BLAKE2_INLINE __m128i fBlaMka(__m128i x, __m128i y) {
         D1 = _mm256_permute4x64_epi64(tmp2, _MM_SHUFFLE(2,3,0,1)); \
     } while((void)0, 0);
 
-#define BLAKE2_ROUND_1(A0, A1, B0, B1, C0, C1, D0, D1) \
+#define BLAKE2_ROUND_1_AVX2(A0, A1, B0, B1, C0, C1, D0, D1) \
     do{ \
         G1_AVX2(A0, A1, B0, B1, C0, C1, D0, D1) \
         G2_AVX2(A0, A1, B0, B1, C0, C1, D0, D1) \
@@ -312,7 +315,7 @@ static BLAKE2_INLINE __m128i fBlaMka(__m128i x, __m128i y) {
         UNDIAGONALIZE_1(A0, B0, C0, D0, A1, B1, C1, D1) \
     } while((void)0, 0);
 
-#define BLAKE2_ROUND_2(A0, A1, B0, B1, C0, C1, D0, D1) \
+#define BLAKE2_ROUND_2_AVX2(A0, A1, B0, B1, C0, C1, D0, D1) \
     do{ \
         G1_AVX2(A0, A1, B0, B1, C0, C1, D0, D1) \
         G2_AVX2(A0, A1, B0, B1, C0, C1, D0, D1) \
@@ -325,21 +328,14 @@ static BLAKE2_INLINE __m128i fBlaMka(__m128i x, __m128i y) {
         UNDIAGONALIZE_2(A0, A1, B0, B1, C0, C1, D0, D1) \
     } while((void)0, 0);
 
-#endif /* __AVX2__ */
-
-#else /* __AVX512F__ */
-
-#include <immintrin.h>
-
 #define ror64(x, n) _mm512_ror_epi64((x), (n))
 
-static __m512i muladd(__m512i x, __m512i y)
-{
-    __m512i z = _mm512_mul_epu32(x, y);
-    return _mm512_add_epi64(_mm512_add_epi64(x, y), _mm512_add_epi64(z, z));
-}
+/* x + y + 2 * lo(x) * lo(y); a macro so it inherits the caller's target */
+#define muladd(x, y)                                                           \
+    _mm512_add_epi64(_mm512_add_epi64((x), (y)),                               \
+                     _mm512_slli_epi64(_mm512_mul_epu32((x), (y)), 1))
 
-#define G1(A0, B0, C0, D0, A1, B1, C1, D1) \
+#define G1_AVX512(A0, B0, C0, D0, A1, B1, C1, D1) \
     do { \
         A0 = muladd(A0, B0); \
         A1 = muladd(A1, B1); \
@@ -360,7 +356,7 @@ static __m512i muladd(__m512i x, __m512i y)
         B1 = ror64(B1, 24); \
     } while ((void)0, 0)
 
-#define G2(A0, B0, C0, D0, A1, B1, C1, D1) \
+#define G2_AVX512(A0, B0, C0, D0, A1, B1, C1, D1) \
     do { \
         A0 = muladd(A0, B0); \
         A1 = muladd(A1, B1); \
@@ -381,7 +377,7 @@ static __m512i muladd(__m512i x, __m512i y)
         B1 = ror64(B1, 63); \
     } while ((void)0, 0)
 
-#define DIAGONALIZE(A0, B0, C0, D0, A1, B1, C1, D1) \
+#define DIAGONALIZE_AVX512(A0, B0, C0, D0, A1, B1, C1, D1) \
     do { \
         B0 = _mm512_permutex_epi64(B0, _MM_SHUFFLE(0, 3, 2, 1)); \
         B1 = _mm512_permutex_epi64(B1, _MM_SHUFFLE(0, 3, 2, 1)); \
@@ -393,7 +389,7 @@ static __m512i muladd(__m512i x, __m512i y)
         D1 = _mm512_permutex_epi64(D1, _MM_SHUFFLE(2, 1, 0, 3)); \
     } while ((void)0, 0)
 
-#define UNDIAGONALIZE(A0, B0, C0, D0, A1, B1, C1, D1) \
+#define UNDIAGONALIZE_AVX512(A0, B0, C0, D0, A1, B1, C1, D1) \
     do { \
         B0 = _mm512_permutex_epi64(B0, _MM_SHUFFLE(2, 1, 0, 3)); \
         B1 = _mm512_permutex_epi64(B1, _MM_SHUFFLE(2, 1, 0, 3)); \
@@ -405,17 +401,17 @@ static __m512i muladd(__m512i x, __m512i y)
         D1 = _mm512_permutex_epi64(D1, _MM_SHUFFLE(0, 3, 2, 1)); \
     } while ((void)0, 0)
 
-#define BLAKE2_ROUND(A0, B0, C0, D0, A1, B1, C1, D1) \
+#define BLAKE2_ROUND_AVX512(A0, B0, C0, D0, A1, B1, C1, D1) \
     do { \
-        G1(A0, B0, C0, D0, A1, B1, C1, D1); \
-        G2(A0, B0, C0, D0, A1, B1, C1, D1); \
+        G1_AVX512(A0, B0, C0, D0, A1, B1, C1, D1); \
+        G2_AVX512(A0, B0, C0, D0, A1, B1, C1, D1); \
 \
-        DIAGONALIZE(A0, B0, C0, D0, A1, B1, C1, D1); \
+        DIAGONALIZE_AVX512(A0, B0, C0, D0, A1, B1, C1, D1); \
 \
-        G1(A0, B0, C0, D0, A1, B1, C1, D1); \
-        G2(A0, B0, C0, D0, A1, B1, C1, D1); \
+        G1_AVX512(A0, B0, C0, D0, A1, B1, C1, D1); \
+        G2_AVX512(A0, B0, C0, D0, A1, B1, C1, D1); \
 \
-        UNDIAGONALIZE(A0, B0, C0, D0, A1, B1, C1, D1); \
+        UNDIAGONALIZE_AVX512(A0, B0, C0, D0, A1, B1, C1, D1); \
     } while ((void)0, 0)
 
 #define SWAP_HALVES(A0, A1) \
@@ -441,31 +437,30 @@ static __m512i muladd(__m512i x, __m512i y)
         SWAP_HALVES(A0, A1); \
     } while((void)0, 0)
 
-#define BLAKE2_ROUND_1(A0, C0, B0, D0, A1, C1, B1, D1) \
+#define BLAKE2_ROUND_1_AVX512(A0, C0, B0, D0, A1, C1, B1, D1) \
     do { \
         SWAP_HALVES(A0, B0); \
         SWAP_HALVES(C0, D0); \
         SWAP_HALVES(A1, B1); \
         SWAP_HALVES(C1, D1); \
-        BLAKE2_ROUND(A0, B0, C0, D0, A1, B1, C1, D1); \
+        BLAKE2_ROUND_AVX512(A0, B0, C0, D0, A1, B1, C1, D1); \
         SWAP_HALVES(A0, B0); \
         SWAP_HALVES(C0, D0); \
         SWAP_HALVES(A1, B1); \
         SWAP_HALVES(C1, D1); \
     } while ((void)0, 0)
 
-#define BLAKE2_ROUND_2(A0, A1, B0, B1, C0, C1, D0, D1) \
+#define BLAKE2_ROUND_2_AVX512(A0, A1, B0, B1, C0, C1, D0, D1) \
     do { \
         SWAP_QUARTERS(A0, A1); \
         SWAP_QUARTERS(B0, B1); \
         SWAP_QUARTERS(C0, C1); \
         SWAP_QUARTERS(D0, D1); \
-        BLAKE2_ROUND(A0, B0, C0, D0, A1, B1, C1, D1); \
+        BLAKE2_ROUND_AVX512(A0, B0, C0, D0, A1, B1, C1, D1); \
         UNSWAP_QUARTERS(A0, A1); \
         UNSWAP_QUARTERS(B0, B1); \
         UNSWAP_QUARTERS(C0, C1); \
         UNSWAP_QUARTERS(D0, D1); \
     } while ((void)0, 0)
 
-#endif /* __AVX512F__ */
 #endif /* BLAKE_ROUND_MKA_OPT_H */
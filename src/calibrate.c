@@ -0,0 +1,183 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#include <string.h>
+
+#include "argon2.h"
+#include "core.h"
+#include "stats.h"
+
+/* Hashes timed per measurement, keeping the median */
+#define CALIBRATE_RUNS 3
+
+/* Most memory sizes, then pass counts, tried looking for the largest that
+ * fits */
+#define CALIBRATE_PROBES 8
+
+/* Times hashes with @params into @params->latency_ns. A hash taking more
+ * than twice @target_ns ends the measurement early: it no longer matters
+ * by how much the parameters miss. */
+static int measure(argon2_type type, argon2_calibration *params,
+                   uint64_t target_ns) {
+    uint8_t out[32], pwd[16], salt[16];
+    uint64_t times[CALIBRATE_RUNS], start, elapsed;
+    argon2_context context;
+    int i, j, rc;
+
+    memset(pwd, 'p', sizeof(pwd));
+    memset(salt, 's', sizeof(salt));
+    memset(&context, 0, sizeof(context));
+    context.out = out;
+    context.outlen = sizeof(out);
+    context.pwd = pwd;
+    context.pwdlen = sizeof(pwd);
+    context.salt = salt;
+    context.saltlen = sizeof(salt);
+    context.t_cost = params->t_cost;
+    context.m_cost = params->m_cost;
+    context.lanes = params->lanes;
+    context.threads = params->threads;
+    context.version = ARGON2_VERSION_NUMBER;
+
+    for (i = 0; i < CALIBRATE_RUNS; ++i) {
+        start = argon2_clock_ns();
+        rc = argon2_ctx(&context, type);
+        elapsed = argon2_clock_ns() - start;
+        if (rc != ARGON2_OK) {
+            return rc;
+        }
+        if (elapsed > 2 * target_ns) {
+            params->latency_ns = elapsed;
+            return ARGON2_OK;
+        }
+        for (j = i; j > 0 && times[j - 1] > elapsed; --j) {
+            times[j] = times[j - 1];
+        }
+        times[j] = elapsed;
+    }
+    params->latency_ns = times[CALIBRATE_RUNS / 2];
+    return ARGON2_OK;
+}
+
+int argon2_calibrate(argon2_type type, uint32_t target_ms,
+                     uint32_t max_memory_kib, uint32_t max_threads,
+                     argon2_calibration *params) {
+    const uint64_t target = (uint64_t)target_ms * 1000000;
+    argon2_calibration best, candidate;
+    uint64_t one_pass, per_pass, guess, too_many = 0;
+    uint32_t unit, min_memory, probe;
+    int found = 0, rc;
+
+    if (params == NULL || target_ms == 0 || max_threads == 0) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+
+    best.lanes = max_threads < ARGON2_MAX_LANES ? max_threads
+                                                : ARGON2_MAX_LANES;
+    best.threads = best.lanes;
+    best.t_cost = 1;
+    unit = ARGON2_SYNC_POINTS * best.lanes; /* memory is rounded to this */
+    min_memory = 2 * unit;
+    if (max_memory_kib > ARGON2_MAX_MEMORY) {
+        max_memory_kib = ARGON2_MAX_MEMORY;
+    }
+    if (max_memory_kib < min_memory) {
+        return ARGON2_MEMORY_TOO_LITTLE;
+    }
+    max_memory_kib = max_memory_kib / unit * unit;
+
+    /* 1. The most memory one pass fills in time. The time is roughly
+     * proportional to the memory, so each probe scales the memory by how
+     * far it was off, with a margin, until that gains little. */
+    candidate = best;
+    candidate.m_cost = max_memory_kib;
+    for (probe = 0; probe < CALIBRATE_PROBES; ++probe) {
+        double scaled;
+
+        rc = measure(type, &candidate, target);
+        if (rc != ARGON2_OK) {
+            return rc;
+        }
+        if (candidate.latency_ns <= target) {
+            if (!found || candidate.m_cost > best.m_cost) {
+                best = candidate;
+                found = 1;
+            }
+            if (candidate.m_cost == max_memory_kib) {
+                break;
+            }
+        } else if (candidate.m_cost == min_memory) {
+            break;
+        }
+
+        scaled = 0.95 * candidate.m_cost * target / candidate.latency_ns;
+        if (scaled > max_memory_kib) {
+            scaled = max_memory_kib;
+        }
+        candidate.m_cost = scaled < min_memory ? min_memory
+                                               : (uint32_t)scaled / unit *
+                                                     unit;
+        if (found && candidate.m_cost < best.m_cost + best.m_cost / 16) {
+            break;
+        }
+    }
+    if (!found) {
+        return ARGON2_CALIBRATION_FAIL;
+    }
+
+    /* 2. The most passes that fit. t passes take at most t times one, so
+     * the first guess is about right but low; each probe then refines the
+     * cost of a pass from a line through one pass and the probe. */
+    one_pass = best.latency_ns;
+    guess = target / one_pass;
+    if (guess < 2) {
+        guess = 2;
+    }
+    for (probe = 0; probe < CALIBRATE_PROBES && guess > best.t_cost;
+         ++probe) {
+        candidate = best;
+        candidate.t_cost =
+            guess > ARGON2_MAX_TIME ? ARGON2_MAX_TIME : (uint32_t)guess;
+        rc = measure(type, &candidate, target);
+        if (rc != ARGON2_OK) {
+            return rc;
+        }
+        if (candidate.latency_ns <= target) {
+            best = candidate;
+        } else {
+            too_many = candidate.t_cost;
+        }
+        if (best.t_cost == ARGON2_MAX_TIME) {
+            break;
+        }
+
+        per_pass = 0;
+        if (candidate.latency_ns > one_pass) {
+            per_pass = (candidate.latency_ns - one_pass) /
+                       (candidate.t_cost - 1);
+        }
+        guess = per_pass != 0 ? 1 + (target - one_pass) / per_pass
+                              : (uint64_t)best.t_cost + 1;
+        if (too_many != 0 && guess >= too_many) {
+            /* The line overshoots: bisect between what fits and what not */
+            guess = best.t_cost + (too_many - best.t_cost) / 2;
+        }
+    }
+
+    *params = best;
+    return ARGON2_OK;
+}
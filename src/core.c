@@ -25,12 +25,32 @@
 #endif
 #define VC_GE_2005(version) (version >= 1400)
 
+/*For streaming the zeroes of large wipes past the cache*/
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) ||              \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ARGON2_WIPE_STREAM
+/* Below this many bytes the wiped memory is likely still cached, and plain
+ * stores are faster */
+#define WIPE_STREAM_MIN (UINT32_C(32) << 20)
+#ifdef _MSC_VER
+#include <intrin.h>
+#define WIPE_BARRIER(v) _ReadWriteBarrier()
+#else
+#define WIPE_BARRIER(v) __asm__ __volatile__("" : : "r"(v) : "memory")
+#endif
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "core.h"
 #include "thread.h"
+#include "pool.h"
+#include "pages.h"
+#include "numa.h"
+#include "stats.h"
 #include "blake2/blake2.h"
 #include "blake2/blake2-impl.h"
 
@@ -83,12 +103,13 @@ static void store_block(void *output, const block *src) {
 
 /***************Memory functions*****************/
 
-int allocate_memory(const argon2_context *context, uint8_t **memory,
+int allocate_memory(argon2_context *context, uint8_t **memory,
                     size_t num, size_t size) {
     size_t memory_size = num*size;
     if (memory == NULL) {
         return ARGON2_MEMORY_ALLOCATION_ERROR;
     }
+    context->memory_backing = ARGON2_BACKING_DEFAULT;
 
     /* 1. Check for multiplication overflow */
     if (size != 0 && memory_size / size != num) {
@@ -98,6 +119,9 @@ int allocate_memory(const argon2_context *context, uint8_t **memory,
     /* 2. Try to allocate with appropriate allocator */
     if (context->allocate_cbk) {
         (context->allocate_cbk)(memory, memory_size);
+    } else if (context->flags & ARGON2_FLAG_HUGE_PAGES) {
+        *memory = (uint8_t *)argon2_pages_alloc(memory_size,
+                                                &context->memory_backing);
     } else {
         *memory = malloc(memory_size);
     }
@@ -109,17 +133,25 @@ int allocate_memory(const argon2_context *context, uint8_t **memory,
     return ARGON2_OK;
 }
 
-void free_memory(const argon2_context *context, uint8_t *memory,
-                 size_t num, size_t size) {
-    size_t memory_size = num*size;
-    clear_internal_memory(memory, memory_size);
+/* Gives back memory that is already wiped */
+static void release_memory(const argon2_context *context, uint8_t *memory,
+                           size_t memory_size) {
     if (context->free_cbk) {
         (context->free_cbk)(memory, memory_size);
+    } else if (context->memory_backing != ARGON2_BACKING_DEFAULT) {
+        argon2_pages_free(memory, memory_size, context->memory_backing);
     } else {
         free(memory);
     }
 }
 
+void free_memory(const argon2_context *context, uint8_t *memory,
+                 size_t num, size_t size) {
+    size_t memory_size = num*size;
+    clear_internal_memory_nt(memory, memory_size);
+    release_memory(context, memory, memory_size);
+}
+
 void NOT_OPTIMIZED secure_wipe_memory(void *v, size_t n) {
 #if defined(_MSC_VER) && VC_GE_2005(_MSC_VER)
     SecureZeroMemory(v, n);
@@ -141,18 +173,59 @@ void clear_internal_memory(void *v, size_t n) {
   }
 }
 
+void clear_internal_memory_nt(void *v, size_t n) {
+#if defined(ARGON2_WIPE_STREAM)
+    const __m128i zero = _mm_setzero_si128();
+    uint8_t *head = (uint8_t *)v;
+    size_t head_len = (size_t)((16 - ((uintptr_t)head & 15)) & 15);
+    __m128i *body;
+    size_t i, body_len;
+
+    if (n < WIPE_STREAM_MIN) {
+        clear_internal_memory(v, n);
+        return;
+    }
+    if (!FLAG_clear_internal_memory || v == NULL) {
+        return;
+    }
+    body = (__m128i *)(head + head_len);
+    body_len = (n - head_len) / sizeof(__m128i);
+
+    secure_wipe_memory(head, head_len);
+    for (i = 0; i < body_len; ++i) {
+        _mm_stream_si128(body + i, zero);
+    }
+    _mm_sfence();
+    WIPE_BARRIER(body); /* the stores are not dead, even before a free() */
+    secure_wipe_memory(body + body_len,
+                       n - head_len - body_len * sizeof(__m128i));
+#else
+    clear_internal_memory(v, n);
+#endif
+}
+
 void finalize(const argon2_context *context, argon2_instance_t *instance) {
     if (context != NULL && instance != NULL) {
+        argon2_stats *stats = instance->stats;
+        uint64_t started = STATS_NOW(stats), wipe_started;
+        uint64_t bytes = (uint64_t)instance->memory_blocks * sizeof(block);
         block blockhash;
         uint32_t l;
 
-        copy_block(&blockhash, instance->memory + instance->lane_length - 1);
-
-        /* XOR the last blocks */
-        for (l = 1; l < instance->lanes; ++l) {
-            uint32_t last_block_in_lane =
-                l * instance->lane_length + (instance->lane_length - 1);
-            xor_block(&blockhash, instance->memory + last_block_in_lane);
+        if (instance->folded) {
+            /* The workers XORed the last blocks, see fold_lanes() */
+            copy_block(&blockhash, &instance->last_blocks);
+            clear_internal_memory(instance->last_blocks.v, ARGON2_BLOCK_SIZE);
+        } else {
+            copy_block(&blockhash,
+                       instance->memory + instance->lane_length - 1);
+
+            /* XOR the last blocks */
+            for (l = 1; l < instance->lanes; ++l) {
+                uint32_t last_block_in_lane =
+                    l * instance->lane_length + (instance->lane_length - 1);
+                xor_block(&blockhash, instance->memory + last_block_in_lane);
+            }
         }
 
         /* Hash the result */
@@ -170,8 +243,34 @@ void finalize(const argon2_context *context, argon2_instance_t *instance) {
         print_tag(context->out, context->outlen);
 #endif
 
-        free_memory(context, (uint8_t *)instance->memory,
-                    instance->memory_blocks, sizeof(block));
+        wipe_started = STATS_NOW(stats);
+        if (instance->workspace != NULL) {
+            /* Keep the memory mapped for the next hash */
+            argon2_workspace *workspace = instance->workspace;
+            if (workspace->flags & ARGON2_FLAG_DEFER_WIPE) {
+                if (workspace->dirty < instance->memory_blocks) {
+                    workspace->dirty = instance->memory_blocks;
+                }
+                bytes = 0;
+            } else if (!instance->folded) {
+                clear_internal_memory_nt(
+                    instance->memory, instance->memory_blocks * sizeof(block));
+            }
+        } else if (instance->folded) {
+            release_memory(context, (uint8_t *)instance->memory,
+                           (size_t)instance->memory_blocks * sizeof(block));
+        } else {
+            free_memory(context, (uint8_t *)instance->memory,
+                        instance->memory_blocks, sizeof(block));
+        }
+
+        if (STATS_ON(stats)) {
+            STATS_LAP(stats, wipe_ns, wipe_started);
+            STATS_LAP(stats, finalize_ns, started);
+            stats->bytes_wiped = FLAG_clear_internal_memory ? bytes : 0;
+            stats->memory_backing = context->memory_backing;
+            stats->total_ns = started - stats->total_ns;
+        }
     }
 }
 
@@ -245,111 +344,620 @@ uint32_t index_alpha(const argon2_instance_t *instance,
     return absolute_position;
 }
 
-/* Single-threaded version for p=1 case */
-static int fill_memory_blocks_st(argon2_instance_t *instance) {
-    uint32_t r, s, l;
-
-    for (r = 0; r < instance->passes; ++r) {
-        for (s = 0; s < ARGON2_SYNC_POINTS; ++s) {
-            for (l = 0; l < instance->lanes; ++l) {
-                argon2_position_t position = {r, l, (uint8_t)s, 0};
-                fill_segment(instance, position);
-            }
+/*
+ * Kernel selection: the first kernel in preference order that the CPU
+ * supports, unless ARGON2_KERNEL or argon2_select_kernel() name another.
+ * The choice is made once and read under kernel_lock, which also guards the
+ * cached CPU features in opt.c.
+ */
+static const argon2_kernel_t *selected_kernel = NULL;
+#if !defined(ARGON2_NO_THREADS)
+static argon2_mutex_t kernel_lock = ARGON2_MUTEX_INITIALIZER;
+#endif
+
+static int kernel_usable(const argon2_kernel_t *kernel, const char *name) {
+    if (name != NULL && strcmp(kernel->name, name) != 0) {
+        return 0;
+    }
+    return kernel->supported == NULL || kernel->supported();
+}
+
+/* Returns the best usable kernel called @name (any name if NULL), or NULL */
+static const argon2_kernel_t *find_kernel(const char *name) {
+#if defined(ARGON2_KERNELS_X86) || defined(ARGON2_KERNELS_ARM)
+    const argon2_kernel_t *const *kernel;
+#endif
+
+#if defined(ARGON2_KERNELS_X86)
+    for (kernel = argon2_kernels_x86; *kernel != NULL; ++kernel) {
+        if (kernel_usable(*kernel, name)) {
+            return *kernel;
+        }
+    }
+#endif
+#if defined(ARGON2_KERNELS_ARM)
+    for (kernel = argon2_kernels_arm; *kernel != NULL; ++kernel) {
+        if (kernel_usable(*kernel, name)) {
+            return *kernel;
+        }
+    }
+#endif
+    return kernel_usable(&argon2_kernel_ref, name) ? &argon2_kernel_ref
+                                                   : NULL;
+}
+
+const argon2_kernel_t *current_kernel(void) {
+    const argon2_kernel_t *kernel;
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_lock(&kernel_lock);
+#endif
+    if (selected_kernel == NULL) {
+        const char *name = getenv("ARGON2_KERNEL");
+        if (name != NULL) {
+            selected_kernel = find_kernel(name);
+        }
+        if (selected_kernel == NULL) {
+            selected_kernel = find_kernel(NULL);
+        }
+    }
+    kernel = selected_kernel;
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_unlock(&kernel_lock);
+#endif
+    return kernel;
+}
+
+const char *argon2_kernel_name(void) { return current_kernel()->name; }
+
+const char *argon2_builtin_kernel(uint32_t index) {
+#if defined(ARGON2_KERNELS_X86) || defined(ARGON2_KERNELS_ARM)
+    const argon2_kernel_t *const *kernel;
+#endif
+
+    if (index == 0) {
+        return argon2_kernel_ref.name;
+    }
+    --index;
+#if defined(ARGON2_KERNELS_X86)
+    for (kernel = argon2_kernels_x86; *kernel != NULL; ++kernel, --index) {
+        if (index == 0) {
+            return (*kernel)->name;
+        }
+    }
+#endif
+#if defined(ARGON2_KERNELS_ARM)
+    for (kernel = argon2_kernels_arm; *kernel != NULL; ++kernel, --index) {
+        if (index == 0) {
+            return (*kernel)->name;
+        }
+    }
+#endif
+    return NULL;
+}
+
+int argon2_select_kernel(const char *name) {
+    const argon2_kernel_t *kernel = NULL;
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_lock(&kernel_lock);
+#endif
+    if (name == NULL) {
+        selected_kernel = NULL;
+    } else {
+        kernel = find_kernel(name);
+        if (kernel != NULL) {
+            selected_kernel = kernel;
+        }
+    }
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_unlock(&kernel_lock);
+#endif
+    if (name != NULL && kernel == NULL) {
+        return ARGON2_KERNEL_UNAVAILABLE;
+    }
+    return ARGON2_OK;
+}
+
+void fill_segment(const argon2_instance_t *instance,
+                  argon2_position_t position) {
+    if (instance == NULL) {
+        return;
+    }
+    instance->kernel->fill_segment(instance, position);
+}
+
+/* Makes the first two blocks of lanes @lane, @lane + @stride, ... up to
+ * @lanes of them, from H0 in @blockhash */
+static void fill_first_blocks_lanes(const uint8_t *blockhash,
+                                    const argon2_instance_t *instance,
+                                    uint32_t lane, uint32_t lanes,
+                                    uint32_t stride) {
+    /* Make the first and second block in each lane as G(H0||0||i) or
+       G(H0||1||i), four of them at a time */
+    uint8_t seeds[4][ARGON2_PREHASH_SEED_LENGTH];
+    uint8_t blockhash_bytes[4][ARGON2_BLOCK_SIZE];
+    const uint8_t *in[4];
+    uint8_t *out[4];
+    uint32_t first, j, count;
+    const uint32_t total = 2 * lanes;
+
+    for (j = 0; j < 4; ++j) {
+        memcpy(seeds[j], blockhash, ARGON2_PREHASH_DIGEST_LENGTH);
+        in[j] = seeds[j];
+        out[j] = blockhash_bytes[j];
+    }
+
+    for (first = 0; first < total; first += count) {
+        count = total - first < 4 ? total - first : 4;
+        for (j = 0; j < count; ++j) {
+            store32(seeds[j] + ARGON2_PREHASH_DIGEST_LENGTH, (first + j) % 2);
+            store32(seeds[j] + ARGON2_PREHASH_DIGEST_LENGTH + 4,
+                    lane + (first + j) / 2 * stride);
+        }
+        blake2b_long4(out, ARGON2_BLOCK_SIZE, in, ARGON2_PREHASH_SEED_LENGTH,
+                      count, instance->kernel->blake2b_hash4);
+        for (j = 0; j < count; ++j) {
+            uint32_t l = lane + (first + j) / 2 * stride;
+            load_block(&instance->memory[(size_t)l * instance->lane_length +
+                                         (first + j) % 2],
+                       blockhash_bytes[j]);
+        }
+    }
+    clear_internal_memory(seeds, sizeof(seeds));
+    clear_internal_memory(blockhash_bytes, sizeof(blockhash_bytes));
+}
+
+/*
+ * Fills the segments at @position and in the @count - 1 lanes after every
+ * @stride lanes, up to ARGON2_LANE_INTERLEAVE of them at a time, so that
+ * the reference block fetches of one lane overlap the compressions of the
+ * others. The segments of one slice are independent, so the blocks come
+ * out the same as when filled one by one. Data-independent segments
+ * already prefetch their reference blocks and are filled one by one.
+ * The first segment of a lane only references that lane, so the first
+ * blocks left to the fill are made here, by the thread about to use them.
+ */
+static void fill_lane_segments(const argon2_instance_t *instance,
+                               argon2_position_t position, uint32_t count,
+                               uint32_t stride) {
+    const argon2_instance_t *instances[ARGON2_LANE_INTERLEAVE];
+    argon2_position_t positions[ARGON2_LANE_INTERLEAVE];
+    uint32_t i, n;
+    int data_independent_addressing =
+        (instance->type == Argon2_i) ||
+        (instance->type == Argon2_id && (position.pass == 0) &&
+         (position.slice < ARGON2_SYNC_POINTS / 2));
+
+    if (instance->first_blocks_pending && position.pass == 0 &&
+        position.slice == 0) {
+        fill_first_blocks_lanes(instance->seed, instance, position.lane,
+                                count, stride);
+    }
+
+    for (i = 0; i < ARGON2_LANE_INTERLEAVE; ++i) {
+        instances[i] = instance;
+    }
+    while (count > 1 && !data_independent_addressing) {
+        n = count < ARGON2_LANE_INTERLEAVE ? count : ARGON2_LANE_INTERLEAVE;
+        for (i = 0; i < n; ++i) {
+            positions[i] = position;
+            position.lane += stride;
         }
+        instance->kernel->fill_segments(instances, positions, n);
+        count -= n;
+    }
+    for (; count > 0; --count) {
+        fill_segment(instance, position);
+        position.lane += stride;
+    }
+}
+
+/* Single-threaded version for p=1 case */
+static int fill_memory_blocks_st(argon2_instance_t *instance, uint64_t first,
+                                 uint64_t end) {
+    uint64_t started = STATS_NOW(instance->stats);
+    uint64_t slice;
+
+    for (slice = first; slice < end; ++slice) {
+        argon2_position_t position;
+
+        position.pass = (uint32_t)(slice / ARGON2_SYNC_POINTS);
+        position.lane = 0;
+        position.slice = (uint8_t)(slice % ARGON2_SYNC_POINTS);
+        position.index = 0;
+        fill_lane_segments(instance, position, instance->lanes, 1);
+
+        if (position.slice == ARGON2_SYNC_POINTS - 1) {
 #ifdef GENKAT
-        internal_kat(instance, r); /* Print all memory blocks */
+            internal_kat(instance, position.pass); /* Print all memory blocks */
 #endif
+            STATS_LAP(instance->stats, pass_ns[STATS_PASS(position.pass)],
+                      started);
+        }
+    }
+    if (end % ARGON2_SYNC_POINTS != 0) {
+        /* Stopped within a pass, which the next fill goes on with */
+        STATS_LAP(instance->stats,
+                  pass_ns[STATS_PASS(end / ARGON2_SYNC_POINTS)], started);
     }
     return ARGON2_OK;
 }
 
 #if !defined(ARGON2_NO_THREADS)
 
-#ifdef _WIN32
-static unsigned __stdcall fill_segment_thr(void *thread_data)
-#else
-static void *fill_segment_thr(void *thread_data)
-#endif
-{
-    argon2_thread_data *my_data = thread_data;
-    fill_segment(my_data->instance_ptr, my_data->pos);
-    argon2_thread_exit();
-    return 0;
+/* State shared by the workers of one multi-threaded fill */
+struct Argon2_fill_job {
+    argon2_barrier_t barrier; /* all workers meet here after every slice */
+    argon2_mutex_t mutex;     /* protects the counters below */
+    argon2_cond_t done;       /* signalled when @running drops to zero */
+    argon2_cond_t progress;   /* broadcast whenever a slice is complete */
+    uint32_t running;         /* pooled workers that have not finished yet */
+    uint64_t first_slice, end_slice; /* the slices of this fill */
+    uint64_t next;     /* next segment to hand out, see fill_queue() */
+    uint64_t finished; /* segments filled so far, from the hash start */
+    uint64_t total;    /* segments filled at the end of this fill */
+    uint64_t pass_started; /* start of the current pass, for the stats */
+    argon2_numa_mask allowed; /* CPUs of the caller, with pin_cpus */
+    uint32_t allowed_count;
+    int fold; /* the fill ends the hash, see fold_lanes() */
+    int wipe; /* and the lanes are wiped then, rather than deferred */
+};
+
+/* NUMA node of worker @w and of the lanes it fills, with ARGON2_FLAG_NUMA */
+static uint32_t worker_node(const argon2_instance_t *instance, uint32_t w) {
+    return (uint32_t)((uint64_t)w * instance->numa_nodes / instance->threads);
 }
 
-/* Multi-threaded version for p > 1 case */
-static int fill_memory_blocks_mt(argon2_instance_t *instance) {
-    uint32_t r, s;
-    argon2_thread_handle_t *thread = NULL;
-    argon2_thread_data *thr_data = NULL;
-    int rc = ARGON2_OK;
+/* Binds the memory of every lane to the node of the worker filling it */
+static void bind_lanes(argon2_instance_t *instance) {
+    uint32_t nodes = argon2_numa_nodes();
+    uint32_t l;
 
-    /* 1. Allocating space for threads */
-    thread = calloc(instance->lanes, sizeof(argon2_thread_handle_t));
-    if (thread == NULL) {
-        rc = ARGON2_MEMORY_ALLOCATION_ERROR;
-        goto fail;
+    if (nodes < 2) {
+        return;
     }
+    instance->numa_nodes = nodes < instance->threads ? nodes
+                                                     : instance->threads;
+    for (l = 0; l < instance->lanes; ++l) {
+        argon2_numa_bind(instance->memory + (size_t)l * instance->lane_length,
+                         (size_t)instance->lane_length * sizeof(block),
+                         worker_node(instance, l % instance->threads));
+    }
+}
 
-    thr_data = calloc(instance->lanes, sizeof(argon2_thread_data));
-    if (thr_data == NULL) {
-        rc = ARGON2_MEMORY_ALLOCATION_ERROR;
-        goto fail;
+/* CPU of worker @w with ARGON2_FLAG_AFFINITY
+ * @return The CPU, or ARGON2_NUMA_MAX_CPUS if the worker is not pinned */
+static uint32_t worker_cpu(const argon2_instance_t *instance,
+                           const struct Argon2_fill_job *job, uint32_t w) {
+    const uint32_t n = job->allowed_count;
+    uint32_t k;
+
+    if (instance->affinity == ARGON2_AFFINITY_LIST) {
+        return instance->cpus[w % instance->cpu_count];
+    }
+    if (n == 0) {
+        return ARGON2_NUMA_MAX_CPUS;
     }
+    if (instance->affinity == ARGON2_AFFINITY_SCATTER &&
+        instance->threads <= n) {
+        k = (uint32_t)((uint64_t)w * n / instance->threads);
+    } else {
+        k = w % n;
+    }
+    return argon2_cpu_nth(&job->allowed, k);
+}
 
-    for (r = 0; r < instance->passes; ++r) {
-        for (s = 0; s < ARGON2_SYNC_POINTS; ++s) {
-            uint32_t l;
+/*
+ * Once the last slice of the hash is filled, XORs the last blocks of lanes
+ * @lane, @lane + threads, ... into instance->last_blocks and wipes those
+ * lanes, so that the memory is wiped where it was filled and finalize() is
+ * left with a single block to hash
+ */
+static void fold_lanes(argon2_instance_t *instance,
+                       struct Argon2_fill_job *job, uint32_t lane) {
+    const size_t lane_bytes = (size_t)instance->lane_length * sizeof(block);
+    block partial;
+    uint32_t l;
 
-            /* 2. Calling threads */
-            for (l = 0; l < instance->lanes; ++l) {
-                argon2_position_t position;
+    init_block_value(&partial, 0);
+    for (l = lane; l < instance->lanes; l += instance->threads) {
+        block *first = instance->memory + (size_t)l * instance->lane_length;
+        xor_block(&partial, first + instance->lane_length - 1);
+        if (job->wipe) {
+            clear_internal_memory_nt(first, lane_bytes);
+        }
+    }
 
-                /* 2.1 Join a thread if limit is exceeded */
-                if (l >= instance->threads) {
-                    if (argon2_thread_join(thread[l - instance->threads])) {
-                        rc = ARGON2_THREAD_FAIL;
-                        goto fail;
-                    }
-                }
+    argon2_mutex_lock(&job->mutex);
+    xor_block(&instance->last_blocks, &partial);
+    argon2_mutex_unlock(&job->mutex);
+    clear_internal_memory(partial.v, ARGON2_BLOCK_SIZE);
+}
 
-                /* 2.2 Create thread */
-                position.pass = r;
-                position.lane = l;
-                position.slice = (uint8_t)s;
-                position.index = 0;
-                thr_data[l].instance_ptr =
-                    instance; /* preparing the thread input */
-                memcpy(&(thr_data[l].pos), &position,
-                       sizeof(argon2_position_t));
-                if (argon2_thread_create(&thread[l], &fill_segment_thr,
-                                         (void *)&thr_data[l])) {
-                    rc = ARGON2_THREAD_FAIL;
-                    goto fail;
-                }
+/* Fills lanes pos.lane, pos.lane + threads, ... of every slice of the job,
+ * waiting for the other workers at the end of each slice */
+static void fill_lanes(const argon2_thread_data *my_data) {
+    argon2_instance_t *instance = my_data->instance_ptr;
+    argon2_stats *stats = instance->stats;
+    argon2_numa_mask saved;
+    uint64_t slice, waiting, waited = 0;
+    int pinned = 0;
+    uint32_t count;
+
+    if (instance->pin_cpus) {
+        pinned = argon2_cpu_pin(worker_cpu(instance, my_data->job,
+                                           my_data->pos.lane),
+                                &saved) == 0;
+    } else if (instance->numa_nodes > 1) {
+        pinned = argon2_numa_pin(worker_node(instance, my_data->pos.lane),
+                                 &saved) == 0;
+    }
 
-                /* fill_segment(instance, position); */
-                /*Non-thread equivalent of the lines above */
-            }
+    /* Lanes pos.lane, pos.lane + threads, ... */
+    count = (instance->lanes - my_data->pos.lane + instance->threads - 1) /
+            instance->threads;
+    for (slice = my_data->job->first_slice; slice < my_data->job->end_slice;
+         ++slice) {
+        argon2_position_t position;
+
+        position.pass = (uint32_t)(slice / ARGON2_SYNC_POINTS);
+        position.lane = my_data->pos.lane;
+        position.slice = (uint8_t)(slice % ARGON2_SYNC_POINTS);
+        position.index = 0;
+        fill_lane_segments(instance, position, count, instance->threads);
+        waiting = STATS_NOW(stats);
+        argon2_barrier_wait(&my_data->job->barrier);
+        if (STATS_ON(stats)) {
+            waited += argon2_clock_ns() - waiting;
+        }
+        if (position.slice != ARGON2_SYNC_POINTS - 1) {
+            continue;
+        }
 
-            /* 3. Joining remaining threads */
-            for (l = instance->lanes - instance->threads; l < instance->lanes;
-                 ++l) {
-                if (argon2_thread_join(thread[l])) {
-                    rc = ARGON2_THREAD_FAIL;
-                    goto fail;
-                }
-            }
+#ifdef GENKAT
+        if (my_data->pos.lane == 0) {
+            internal_kat(instance, position.pass); /* Print all memory blocks */
+        }
+        argon2_barrier_wait(&my_data->job->barrier);
+#endif
+        if (my_data->pos.lane == 0) {
+            STATS_LAP(stats, pass_ns[STATS_PASS(position.pass)],
+                      my_data->job->pass_started);
+        }
+    }
+
+    if (my_data->job->fold) {
+        fold_lanes(instance, my_data->job, my_data->pos.lane);
+    }
+    if (pinned) {
+        argon2_numa_unpin(&saved);
+    }
+    if (STATS_ON(stats)) {
+        argon2_mutex_lock(&my_data->job->mutex);
+        stats->wait_ns += waited;
+        argon2_mutex_unlock(&my_data->job->mutex);
+    }
+}
+
+/*
+ * Fills segments in the order (pass, slice, lane) as they are handed out
+ * by the job, so that a worker finishing early takes on the next segment
+ * instead of waiting for the others. A segment of slice n is only started
+ * once the segments of all slices before n are filled. When there are
+ * more lanes than threads, the segments go out in runs of adjacent lanes
+ * of one slice, as long as that leaves every worker a run.
+ */
+static void fill_queue(const argon2_thread_data *my_data) {
+    argon2_instance_t *instance = my_data->instance_ptr;
+    struct Argon2_fill_job *job = my_data->job;
+    argon2_stats *stats = instance->stats;
+    const uint32_t lanes = instance->lanes;
+    uint32_t run = lanes / instance->threads;
+
+    if (run > ARGON2_LANE_INTERLEAVE) {
+        run = ARGON2_LANE_INTERLEAVE;
+    } else if (run == 0) {
+        run = 1;
+    }
+
+    argon2_mutex_lock(&job->mutex);
+    while (job->next < job->total) {
+        uint64_t segment = job->next;
+        uint64_t slices = segment / lanes; /* slices before this segment */
+        uint32_t count = lanes - (uint32_t)(segment % lanes);
+        argon2_position_t position;
+
+        if (count > run) {
+            count = run; /* runs never cross into the next slice */
         }
+        job->next += count;
 
+        if (job->finished < slices * lanes) {
+            uint64_t waiting = STATS_NOW(stats);
+            while (job->finished < slices * lanes) {
+                argon2_cond_wait(&job->progress, &job->mutex);
+            }
+            STATS_LAP(stats, wait_ns, waiting);
+        }
+        argon2_mutex_unlock(&job->mutex);
+
+        position.pass = (uint32_t)(slices / ARGON2_SYNC_POINTS);
+        position.lane = (uint32_t)(segment % lanes);
+        position.slice = (uint8_t)(slices % ARGON2_SYNC_POINTS);
+        position.index = 0;
+        fill_lane_segments(instance, position, count, 1);
+
+        argon2_mutex_lock(&job->mutex);
+        job->finished += count;
+        if (job->finished % lanes == 0) {
+            if (job->finished % (ARGON2_SYNC_POINTS * lanes) == 0) {
 #ifdef GENKAT
-        internal_kat(instance, r); /* Print all memory blocks */
+                /* Print all memory blocks */
+                internal_kat(instance, position.pass);
 #endif
+                STATS_LAP(stats, pass_ns[STATS_PASS(position.pass)],
+                          job->pass_started);
+            }
+            argon2_cond_broadcast(&job->progress);
+        }
+    }
+    if (job->fold && job->finished < job->total) {
+        /* The lanes of this worker may still be referenced */
+        uint64_t waiting = STATS_NOW(stats);
+        while (job->finished < job->total) {
+            argon2_cond_wait(&job->progress, &job->mutex);
+        }
+        STATS_LAP(stats, wait_ns, waiting);
+    }
+    argon2_mutex_unlock(&job->mutex);
+
+    if (job->fold) {
+        fold_lanes(instance, job, my_data->pos.lane);
+    }
+}
+
+/* The share of one worker: fixed lanes under ARGON2_FLAG_NUMA or
+ * ARGON2_FLAG_AFFINITY, so that they stay on the worker's node or CPU, or
+ * segments from the queue otherwise */
+static void fill_worker(const argon2_thread_data *my_data) {
+    if (my_data->instance_ptr->numa_nodes > 1 ||
+        my_data->instance_ptr->pin_cpus) {
+        fill_lanes(my_data);
+    } else {
+        fill_queue(my_data);
     }
+}
+
+static void fill_lanes_thr(void *thread_data) {
+    argon2_thread_data *my_data = thread_data;
+    struct Argon2_fill_job *job = my_data->job;
+
+    fill_worker(my_data);
+
+    argon2_mutex_lock(&job->mutex);
+    if (--job->running == 0) {
+        argon2_cond_signal(&job->done);
+    }
+    argon2_mutex_unlock(&job->mutex);
+}
+
+/* Multi-threaded version for p > 1 case */
+static int fill_memory_blocks_mt(argon2_instance_t *instance, uint64_t first,
+                                 uint64_t end) {
+    struct Argon2_fill_job job;
+    argon2_thread_data *thr_data = NULL;
+    argon2_pool_task *tasks = NULL;
+    uint64_t joining;
+    uint32_t w;
+    int rc = ARGON2_OK;
+
+    /* 1. Allocating space for the workers, worker 0 being this thread */
+    if (instance->workspace != NULL &&
+        instance->threads <= instance->workspace->threads) {
+        thr_data = instance->workspace->thr_data;
+        tasks = instance->workspace->tasks;
+    } else {
+        thr_data = calloc(instance->threads, sizeof(argon2_thread_data));
+        if (thr_data == NULL) {
+            rc = ARGON2_MEMORY_ALLOCATION_ERROR;
+            goto fail;
+        }
+
+        tasks = calloc(instance->threads, sizeof(argon2_pool_task));
+        if (tasks == NULL) {
+            rc = ARGON2_MEMORY_ALLOCATION_ERROR;
+            goto fail;
+        }
+    }
+
+    if (argon2_barrier_init(&job.barrier, instance->threads)) {
+        rc = ARGON2_THREAD_FAIL;
+        goto fail;
+    }
+    if (argon2_mutex_init(&job.mutex)) {
+        argon2_barrier_destroy(&job.barrier);
+        rc = ARGON2_THREAD_FAIL;
+        goto fail;
+    }
+    if (argon2_cond_init(&job.done)) {
+        argon2_mutex_destroy(&job.mutex);
+        argon2_barrier_destroy(&job.barrier);
+        rc = ARGON2_THREAD_FAIL;
+        goto fail;
+    }
+    if (argon2_cond_init(&job.progress)) {
+        argon2_cond_destroy(&job.done);
+        argon2_mutex_destroy(&job.mutex);
+        argon2_barrier_destroy(&job.barrier);
+        rc = ARGON2_THREAD_FAIL;
+        goto fail;
+    }
+    job.running = instance->threads - 1;
+    job.first_slice = first;
+    job.end_slice = end;
+    job.next = first * instance->lanes;
+    job.finished = job.next;
+    job.total = end * instance->lanes;
+    job.pass_started = STATS_NOW(instance->stats);
+    job.allowed_count = 0;
+    if (instance->pin_cpus && instance->affinity != ARGON2_AFFINITY_LIST) {
+        job.allowed_count = argon2_cpu_allowed(&job.allowed);
+    }
+    job.fold = end == (uint64_t)instance->passes * ARGON2_SYNC_POINTS;
+    job.wipe = instance->workspace == NULL ||
+               !(instance->workspace->flags & ARGON2_FLAG_DEFER_WIPE);
+    if (job.fold) {
+        init_block_value(&instance->last_blocks, 0);
+    }
+
+    for (w = 0; w < instance->threads; ++w) {
+        thr_data[w].instance_ptr = instance; /* preparing the thread input */
+        thr_data[w].job = &job;
+        thr_data[w].pos.pass = 0;
+        thr_data[w].pos.lane = w;
+        thr_data[w].pos.slice = 0;
+        thr_data[w].pos.index = 0;
+        tasks[w].func = &fill_lanes_thr;
+        tasks[w].arg = &thr_data[w];
+    }
+
+    /* 2. Handing workers 1..threads-1 to the persistent pool */
+    if (argon2_pool_submit(tasks + 1, instance->threads - 1)) {
+        rc = ARGON2_THREAD_FAIL;
+        goto destroy;
+    }
+
+    /* 3. Taking the share of worker 0 on the calling thread */
+    fill_worker(&thr_data[0]);
+
+    /* 4. Waiting for the pooled workers to let go of the job */
+    joining = STATS_NOW(instance->stats);
+    argon2_mutex_lock(&job.mutex);
+    while (job.running != 0) {
+        argon2_cond_wait(&job.done, &job.mutex);
+    }
+    argon2_mutex_unlock(&job.mutex);
+    STATS_LAP(instance->stats, join_ns, joining);
+    instance->folded = job.fold;
+    if (end % ARGON2_SYNC_POINTS != 0) {
+        /* Stopped within a pass, which the next fill goes on with */
+        STATS_LAP(instance->stats,
+                  pass_ns[STATS_PASS(end / ARGON2_SYNC_POINTS)],
+                  job.pass_started);
+    }
+
+destroy:
+    argon2_cond_destroy(&job.progress);
+    argon2_cond_destroy(&job.done);
+    argon2_mutex_destroy(&job.mutex);
+    argon2_barrier_destroy(&job.barrier);
 
 fail:
-    if (thread != NULL) {
-        free(thread);
+    if (instance->workspace != NULL && thr_data != NULL &&
+        thr_data == instance->workspace->thr_data) {
+        return rc; /* borrowed from the workspace */
+    }
+    if (tasks != NULL) {
+        free(tasks);
     }
     if (thr_data != NULL) {
         free(thr_data);
@@ -359,16 +967,114 @@ fail:
 
 #endif /* ARGON2_NO_THREADS */
 
+/* Wipes H0 once the first slice no longer needs it */
+static void clear_first_seed(argon2_instance_t *instance) {
+    if (instance->first_blocks_pending) {
+        clear_internal_memory(instance->seed, sizeof(instance->seed));
+        instance->first_blocks_pending = 0;
+    }
+}
+
 int fill_memory_blocks(argon2_instance_t *instance) {
 	if (instance == NULL || instance->lanes == 0) {
 	    return ARGON2_INCORRECT_PARAMETER;
     }
+    return fill_memory_slices(instance, 0,
+                              (uint64_t)instance->passes * ARGON2_SYNC_POINTS);
+}
+
+int fill_memory_slices(argon2_instance_t *instance, uint64_t first,
+                       uint64_t end) {
+    uint64_t started;
+    int rc;
+
+    if (instance == NULL || instance->lanes == 0 || first > end ||
+        end > (uint64_t)instance->passes * ARGON2_SYNC_POINTS) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+    if (first == end) {
+        return ARGON2_OK;
+    }
+    started = STATS_NOW(instance->stats);
 #if defined(ARGON2_NO_THREADS)
-    return fill_memory_blocks_st(instance);
+    rc = fill_memory_blocks_st(instance, first, end);
 #else
-    return instance->threads == 1 ?
-			fill_memory_blocks_st(instance) : fill_memory_blocks_mt(instance);
+    rc = instance->threads == 1 ? fill_memory_blocks_st(instance, first, end)
+                                : fill_memory_blocks_mt(instance, first, end);
 #endif
+    STATS_LAP(instance->stats, fill_ns, started);
+    if (first == 0) {
+        clear_first_seed(instance);
+    }
+    return rc;
+}
+
+int fill_memory_blocks_batch(argon2_instance_t *const *instances,
+                             uint32_t count) {
+    const argon2_instance_t *active[ARGON2_MAX_INTERLEAVE];
+    argon2_position_t positions[ARGON2_MAX_INTERLEAVE];
+    argon2_position_t next[ARGON2_MAX_INTERLEAVE];
+    const argon2_kernel_t *kernel;
+    uint64_t started = 0;
+    uint32_t i, n;
+
+    if (instances == NULL || count == 0 || count > ARGON2_MAX_INTERLEAVE) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+    for (i = 0; i < count; ++i) {
+        if (instances[i] == NULL || instances[i]->lanes == 0) {
+            return ARGON2_INCORRECT_PARAMETER;
+        }
+        memset(&next[i], 0, sizeof(next[i]));
+    }
+    /* Any kernel gives the same result, so use one for the whole batch */
+    kernel = instances[0]->kernel;
+    for (i = 0; i < count && started == 0; ++i) {
+        started = STATS_NOW(instances[i]->stats);
+    }
+    /* The batch fills on this thread, whatever the threads of a context */
+    for (i = 0; i < count; ++i) {
+        if (instances[i]->first_blocks_pending) {
+            fill_first_blocks(instances[i]->seed, instances[i]);
+            clear_first_seed(instances[i]);
+        }
+    }
+
+    /* Each round fills the next segment (in single-thread order) of every
+     * instance that still has one */
+    for (;;) {
+        n = 0;
+        for (i = 0; i < count; ++i) {
+            if (next[i].pass == instances[i]->passes) {
+                continue;
+            }
+            active[n] = instances[i];
+            positions[n] = next[i];
+            ++n;
+
+            if (++next[i].lane == instances[i]->lanes) {
+                next[i].lane = 0;
+                if (++next[i].slice == ARGON2_SYNC_POINTS) {
+                    next[i].slice = 0;
+                    ++next[i].pass;
+                }
+            }
+        }
+        if (n == 0) {
+            break;
+        }
+        kernel->fill_segments(active, positions, n);
+    }
+
+    /* The fills overlap, so each instance is charged the whole batch */
+    for (i = 0; i < count; ++i) {
+        if (STATS_ON(instances[i]->stats)) {
+            uint64_t start = started;
+            STATS_LAP(instances[i]->stats, fill_ns, start);
+            instances[i]->stats->kernel = kernel->name;
+        }
+    }
+    return ARGON2_OK;
 }
 
 int validate_inputs(const argon2_context *context) {
@@ -479,7 +1185,8 @@ int validate_inputs(const argon2_context *context) {
     }
 
     /* Validate threads */
-    if (ARGON2_MIN_THREADS > context->threads) {
+    if (ARGON2_MIN_THREADS > context->threads &&
+        ARGON2_THREADS_AUTO != context->threads) {
         return ARGON2_THREADS_TOO_FEW;
     }
 
@@ -495,30 +1202,104 @@ int validate_inputs(const argon2_context *context) {
         return ARGON2_ALLOCATE_MEMORY_CBK_NULL;
     }
 
+    if (context->flags & ARGON2_FLAG_AFFINITY) {
+        if (context->affinity > ARGON2_AFFINITY_LIST ||
+            (context->affinity == ARGON2_AFFINITY_LIST &&
+             (context->cpus == NULL || context->cpu_count == 0))) {
+            return ARGON2_INCORRECT_PARAMETER;
+        }
+    }
+
     return ARGON2_OK;
 }
 
-void fill_first_blocks(uint8_t *blockhash, const argon2_instance_t *instance) {
-    uint32_t l;
-    /* Make the first and second block in each lane as G(H0||0||i) or
-       G(H0||1||i) */
-    uint8_t blockhash_bytes[ARGON2_BLOCK_SIZE];
-    for (l = 0; l < instance->lanes; ++l) {
+int prepare_instance(argon2_instance_t *instance,
+                     const argon2_context *context, argon2_type type,
+                     argon2_workspace *workspace) {
+    int result = validate_inputs(context);
+    uint32_t memory_blocks, segment_length;
+
+    if (ARGON2_OK != result) {
+        return result;
+    }
+
+    if (Argon2_d != type && Argon2_i != type && Argon2_id != type) {
+        return ARGON2_INCORRECT_TYPE;
+    }
+
+    /* Minimum memory_blocks = 8L blocks, where L is the number of lanes */
+    memory_blocks = context->m_cost;
+
+    if (memory_blocks < 2 * ARGON2_SYNC_POINTS * context->lanes) {
+        memory_blocks = 2 * ARGON2_SYNC_POINTS * context->lanes;
+    }
 
-        store32(blockhash + ARGON2_PREHASH_DIGEST_LENGTH, 0);
-        store32(blockhash + ARGON2_PREHASH_DIGEST_LENGTH + 4, l);
-        blake2b_long(blockhash_bytes, ARGON2_BLOCK_SIZE, blockhash,
-                     ARGON2_PREHASH_SEED_LENGTH);
-        load_block(&instance->memory[l * instance->lane_length + 0],
-                   blockhash_bytes);
+    segment_length = memory_blocks / (context->lanes * ARGON2_SYNC_POINTS);
+    /* Ensure that all segments have equal length */
+    memory_blocks = segment_length * (context->lanes * ARGON2_SYNC_POINTS);
+
+    instance->version = context->version;
+    instance->memory = NULL;
+    instance->passes = context->t_cost;
+    instance->memory_blocks = memory_blocks;
+    instance->segment_length = segment_length;
+    instance->lane_length = segment_length * ARGON2_SYNC_POINTS;
+    instance->lanes = context->lanes;
+    instance->threads = context->threads;
+    if (instance->threads == ARGON2_THREADS_AUTO) {
+#if defined(ARGON2_NO_THREADS)
+        instance->threads = 1;
+#else
+        instance->threads = argon2_pool_auto_threads(instance->lanes);
+#endif
+    }
+    instance->type = type;
+    instance->workspace = workspace;
+    instance->numa_nodes = 1;
 
-        store32(blockhash + ARGON2_PREHASH_DIGEST_LENGTH, 1);
-        blake2b_long(blockhash_bytes, ARGON2_BLOCK_SIZE, blockhash,
-                     ARGON2_PREHASH_SEED_LENGTH);
-        load_block(&instance->memory[l * instance->lane_length + 1],
-                   blockhash_bytes);
+    if (instance->threads > instance->lanes) {
+        instance->threads = instance->lanes;
     }
-    clear_internal_memory(blockhash_bytes, ARGON2_BLOCK_SIZE);
+
+    instance->pin_cpus = 0;
+    if ((context->flags & ARGON2_FLAG_AFFINITY) && instance->threads > 1) {
+        instance->pin_cpus = 1;
+        instance->affinity = context->affinity;
+        instance->cpus = context->cpus;
+        instance->cpu_count = context->cpu_count;
+    }
+    instance->stream_stores =
+        (context->flags & ARGON2_FLAG_STREAM_STORES) != 0;
+    instance->first_blocks_pending = 0;
+    instance->folded = 0;
+
+    instance->stats = NULL;
+#if !defined(ARGON2_NO_STATS)
+    if ((context->flags & ARGON2_FLAG_STATS) && context->stats != NULL) {
+        instance->stats = context->stats;
+        memset(instance->stats, 0, sizeof(*instance->stats));
+        /* The start time, until finalize() makes it the duration */
+        instance->stats->total_ns = argon2_clock_ns();
+        instance->stats->threads = instance->threads;
+    }
+#endif
+
+    /* A cache built for other parameters is ignored, not an error */
+    instance->index_cache = NULL;
+    if ((context->flags & ARGON2_FLAG_INDEX_CACHE) &&
+        context->index_cache != NULL &&
+        context->index_cache->type == type &&
+        context->index_cache->passes == instance->passes &&
+        context->index_cache->lanes == instance->lanes &&
+        context->index_cache->memory_blocks == memory_blocks) {
+        instance->index_cache = context->index_cache;
+    }
+
+    return ARGON2_OK;
+}
+
+void fill_first_blocks(uint8_t *blockhash, const argon2_instance_t *instance) {
+    fill_first_blocks_lanes(blockhash, instance, 0, instance->lanes, 1);
 }
 
 void initial_hash(uint8_t *blockhash, argon2_context *context,
@@ -597,18 +1378,44 @@ void initial_hash(uint8_t *blockhash, argon2_context *context,
 
 int initialize(argon2_instance_t *instance, argon2_context *context) {
     uint8_t blockhash[ARGON2_PREHASH_SEED_LENGTH];
+    argon2_stats *stats;
+    uint64_t started;
     int result = ARGON2_OK;
 
     if (instance == NULL || context == NULL)
         return ARGON2_INCORRECT_PARAMETER;
     instance->context_ptr = context;
+    instance->kernel = current_kernel();
+    stats = instance->stats;
+    started = STATS_NOW(stats);
+    if (STATS_ON(stats)) {
+        stats->kernel = instance->kernel->name;
+    }
 
-    /* 1. Memory allocation */
-    result = allocate_memory(context, (uint8_t **)&(instance->memory),
-                             instance->memory_blocks, sizeof(block));
-    if (result != ARGON2_OK) {
-        return result;
+    /* 1. Memory allocation, unless the workspace has enough */
+    if (instance->workspace != NULL &&
+        instance->memory_blocks <= instance->workspace->capacity) {
+        instance->memory = instance->workspace->memory;
+        context->memory_backing = instance->workspace->backing;
+    } else {
+        instance->workspace = NULL;
+        result = allocate_memory(context, (uint8_t **)&(instance->memory),
+                                 instance->memory_blocks, sizeof(block));
+        if (result != ARGON2_OK) {
+            return result;
+        }
+        if (STATS_ON(stats)) {
+            stats->bytes_allocated =
+                (uint64_t)instance->memory_blocks * sizeof(block);
+        }
+    }
+#if !defined(ARGON2_NO_THREADS)
+    instance->numa_nodes = 1;
+    if ((context->flags & ARGON2_FLAG_NUMA) && instance->threads > 1) {
+        bind_lanes(instance);
     }
+#endif
+    STATS_LAP(stats, allocate_ns, started);
 
     /* 2. Initial hashing */
     /* H_0 + 8 extra bytes to produce the first blocks */
@@ -619,6 +1426,7 @@ int initialize(argon2_instance_t *instance, argon2_context *context) {
     clear_internal_memory(blockhash + ARGON2_PREHASH_DIGEST_LENGTH,
                           ARGON2_PREHASH_SEED_LENGTH -
                               ARGON2_PREHASH_DIGEST_LENGTH);
+    STATS_LAP(stats, initial_hash_ns, started);
 
 #ifdef GENKAT
     initial_kat(blockhash, context, instance->type);
@@ -626,9 +1434,19 @@ int initialize(argon2_instance_t *instance, argon2_context *context) {
 
     /* 3. Creating first blocks, we always have at least two blocks in a slice
      */
-    fill_first_blocks(blockhash, instance);
+#if !defined(ARGON2_NO_THREADS)
+    if (instance->threads > 1) {
+        /* The workers make those of their lanes, see fill_lane_segments() */
+        memcpy(instance->seed, blockhash, ARGON2_PREHASH_DIGEST_LENGTH);
+        instance->first_blocks_pending = 1;
+    } else
+#endif
+    {
+        fill_first_blocks(blockhash, instance);
+    }
     /* Clearing the hash */
     clear_internal_memory(blockhash, ARGON2_PREHASH_SEED_LENGTH);
+    STATS_LAP(stats, first_blocks_ns, started);
 
     return ARGON2_OK;
 }
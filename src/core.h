@@ -39,7 +39,22 @@ enum argon2_core_constants {
 
     /* Pre-hashing digest length and its extension*/
     ARGON2_PREHASH_DIGEST_LENGTH = 64,
-    ARGON2_PREHASH_SEED_LENGTH = 72
+    ARGON2_PREHASH_SEED_LENGTH = 72,
+
+    /* How many blocks ahead reference blocks are prefetched when addressing
+       is data-independent */
+    ARGON2_PREFETCH_DISTANCE = 2,
+
+    /* Maximum number of segments a kernel fills in lockstep */
+    ARGON2_MAX_INTERLEAVE = 4,
+
+    /* Number of instances argon2_hash_batch() runs together; two already
+       hide most of the memory latency, more only add cache pressure */
+    ARGON2_BATCH_INSTANCES = 2,
+
+    /* Number of lanes of one hash a thread fills together, when it has
+       more than one lane to fill in a slice */
+    ARGON2_LANE_INTERLEAVE = 2
 };
 
 /*************************Argon2 internal data types***********************/
@@ -80,6 +95,23 @@ typedef struct Argon2_instance_t {
     argon2_type type;
     int print_internals; /* whether to print the memory blocks */
     argon2_context *context_ptr; /* points back to original context */
+    const struct Argon2_kernel_t *kernel; /* fills the segments */
+    struct Argon2_workspace *workspace; /* holds @memory, or NULL */
+    uint32_t numa_nodes; /* NUMA nodes the lanes are spread over */
+    argon2_stats *stats; /* NULL unless ARGON2_FLAG_STATS, see stats.h */
+    const struct Argon2_index_cache *index_cache; /* NULL, or matching */
+    int pin_cpus;           /* ARGON2_FLAG_AFFINITY, with threads > 1 */
+    uint32_t affinity;      /* argon2_affinity, with @pin_cpus */
+    const uint32_t *cpus;   /* ARGON2_AFFINITY_LIST */
+    uint32_t cpu_count;
+    int stream_stores; /* ARGON2_FLAG_STREAM_STORES */
+    /* With threads > 1, the workers make the first blocks of their lanes
+     * from @seed in the first slice, and after the last one XOR the last
+     * blocks of their lanes into @last_blocks and wipe the lanes */
+    int first_blocks_pending;
+    uint8_t seed[ARGON2_PREHASH_DIGEST_LENGTH]; /* H0, while pending */
+    int folded; /* @last_blocks is set and the memory wiped or deferred */
+    block last_blocks;
 } argon2_instance_t;
 
 /*
@@ -93,23 +125,103 @@ typedef struct Argon2_position_t {
     uint32_t index;
 } argon2_position_t;
 
-/*Struct that holds the inputs for thread handling FillSegment*/
+/*
+ * Fill kernel: fill_segment() built for one instruction set. Kernels
+ * without @supported run on any CPU. @fill_segments fills @count (at most
+ * ARGON2_MAX_INTERLEAVE) independent segments at once, alternating between
+ * them block by block to hide memory latency.
+ */
+typedef struct Argon2_kernel_t {
+    const char *name;
+    int (*supported)(void);
+    void (*fill_segment)(const argon2_instance_t *instance,
+                         argon2_position_t position);
+    void (*fill_segments)(const argon2_instance_t *const *instances,
+                          const argon2_position_t *positions, uint32_t count);
+    /* Writes the reference block offsets of a data-independent segment
+     * instead of filling it, for argon2_index_cache_create() */
+    void (*index_segment)(const argon2_instance_t *instance,
+                          argon2_position_t position, uint32_t *offsets);
+    /* blake2b_hash4_fn computing the first blocks, or NULL */
+    void (*blake2b_hash4)(uint8_t *const *out, const uint8_t *const *in,
+                          size_t inlen, unsigned count);
+    /* Base64 of a prefix of @src, a multiple of 3 bytes long, written to
+     * @dst without terminator; returns the prefix length. NULL if none */
+    size_t (*b64_encode)(char *dst, const uint8_t *src, size_t srclen);
+    /* Decodes a prefix of @src made of Base64 characters only, a multiple
+     * of 4 characters long, into at most @dstlen bytes of @dst; returns the
+     * prefix length. Stops early anywhere; NULL if none */
+    size_t (*b64_decode)(uint8_t *dst, size_t dstlen, const char *src,
+                         size_t srclen);
+} argon2_kernel_t;
+
+/* The kernel hashes run with, see argon2_select_kernel() */
+const argon2_kernel_t *current_kernel(void);
+
+/* Portable kernel from ref.c */
+extern const argon2_kernel_t argon2_kernel_ref;
+
+#if defined(ARGON2_KERNELS_X86)
+/* SIMD kernels from opt.c, fastest first, NULL-terminated */
+extern const argon2_kernel_t *const argon2_kernels_x86[];
+#endif
+
+#if defined(ARGON2_KERNELS_ARM)
+/* SIMD kernels from neon.c, fastest first, NULL-terminated */
+extern const argon2_kernel_t *const argon2_kernels_arm[];
+#endif
+
+/*Struct that holds the inputs for a worker of the multi-threaded fill. The
+  lane in @pos is the first lane handled by the worker*/
 typedef struct Argon2_thread_data {
     argon2_instance_t *instance_ptr;
+    struct Argon2_fill_job *job; /* state shared with the other workers */
     argon2_position_t pos;
 } argon2_thread_data;
 
+/*
+ * Workspace: a block matrix, faulted in once, and the bookkeeping of a
+ * multi-threaded fill, both kept across hashes (see argon2_workspace_create)
+ */
+struct Argon2_workspace {
+    block *memory;
+    uint32_t capacity; /* number of blocks in @memory */
+    uint32_t backing;  /* ARGON2_BACKING_* value of @memory */
+    uint32_t threads;  /* number of entries in @thr_data and @tasks */
+    uint32_t flags;    /* ARGON2_FLAG_* given at creation */
+    uint32_t dirty;    /* blocks not wiped yet, with ARGON2_FLAG_DEFER_WIPE */
+    argon2_thread_data *thr_data;
+    struct Argon2_pool_task *tasks;
+    struct Argon2_pool_task *wipe_task; /* deferred wipe on a pool worker */
+    struct Argon2_workspace_pool *owner; /* pool handing out the workspace */
+    struct Argon2_workspace *next; /* free list link of the owning pool */
+};
+
+/*
+ * Index cache: the reference block offsets of the data-independent segments
+ * of the hashes with one set of parameters, in the order (pass, slice,
+ * lane, index). Only the first two slices of pass 0 are kept for Argon2id.
+ */
+struct Argon2_index_cache {
+    argon2_type type;
+    uint32_t passes;
+    uint32_t lanes;
+    uint32_t memory_blocks; /* after rounding, as in argon2_instance_t */
+    uint32_t *offsets;
+};
+
 /*************************Argon2 core functions********************************/
 
 /* Allocates memory to the given pointer, uses the appropriate allocator as
  * specified in the context. Total allocated memory is num*size.
- * @param context argon2_context which specifies the allocator
+ * @param context argon2_context which specifies the allocator, and receives
+ * the memory_backing obtained
  * @param memory pointer to the pointer to the memory
  * @param size the size in bytes for each element to be allocated
  * @param num the number of elements to be allocated
  * @return ARGON2_OK if @memory is a valid pointer and memory is allocated
  */
-int allocate_memory(const argon2_context *context, uint8_t **memory,
+int allocate_memory(argon2_context *context, uint8_t **memory,
                     size_t num, size_t size);
 
 /*
@@ -137,6 +249,15 @@ void secure_wipe_memory(void *v, size_t n);
  */
 void clear_internal_memory(void *v, size_t n);
 
+/* Same as clear_internal_memory(), but writes the zeroes of large buffers
+ * with non-temporal stores where the instruction set has them, which saves
+ * reading @v into the cache and evicting everything else when wiping a big
+ * block matrix.
+ * @param mem Pointer to the memory
+ * @param s Memory size in bytes
+ */
+void clear_internal_memory_nt(void *v, size_t n);
+
 /*
  * Computes absolute position of reference block in the lane following a skewed
  * distribution and using a pseudo-random value as input
@@ -160,6 +281,16 @@ uint32_t index_alpha(const argon2_instance_t *instance,
  */
 int validate_inputs(const argon2_context *context);
 
+/*
+ * Validates @context and fills in @instance for it, with the memory size
+ * rounded to whole segments. The memory itself is set up by initialize().
+ * @param workspace Workspace to take the memory from if large enough, or NULL
+ * @return ARGON2_OK if @context is valid, the reason otherwise
+ */
+int prepare_instance(argon2_instance_t *instance,
+                     const argon2_context *context, argon2_type type,
+                     argon2_workspace *workspace);
+
 /*
  * Hashes all the inputs into @a blockhash[PREHASH_DIGEST_LENGTH], clears
  * password and secret if needed
@@ -183,7 +314,8 @@ void fill_first_blocks(uint8_t *blockhash, const argon2_instance_t *instance);
 
 /*
  * Function allocates memory, hashes the inputs with Blake,  and creates first
- * two blocks. Returns the pointer to the main memory with 2 blocks per lane
+ * two blocks, or leaves them to the workers of the fill with threads > 1.
+ * Returns the pointer to the main memory with 2 blocks per lane
  * initialized
  * @param  context  Pointer to the Argon2 internal structure containing memory
  * pointer, and parameters for time and space requirements.
@@ -194,8 +326,8 @@ void fill_first_blocks(uint8_t *blockhash, const argon2_instance_t *instance);
 int initialize(argon2_instance_t *instance, argon2_context *context);
 
 /*
- * XORing the last block of each lane, hashing it, making the tag. Deallocates
- * the memory.
+ * XORing the last block of each lane, unless the fill did, hashing it, making
+ * the tag. Deallocates the memory.
  * @param context Pointer to current Argon2 context (use only the out parameters
  * from it)
  * @param instance Pointer to current instance of Argon2
@@ -208,7 +340,7 @@ void finalize(const argon2_context *context, argon2_instance_t *instance);
 
 /*
  * Function that fills the segment using previous segments also from other
- * threads
+ * threads, by calling into @instance->kernel
  * @param context current context
  * @param instance Pointer to the current instance
  * @param position Current position
@@ -225,4 +357,25 @@ void fill_segment(const argon2_instance_t *instance,
  */
 int fill_memory_blocks(argon2_instance_t *instance);
 
+/*
+ * Function that fills the slices @first to @end - 1 of the memory, where
+ * slice s of pass r is number r * ARGON2_SYNC_POINTS + s
+ * @param instance Pointer to the current instance, with the slices before
+ * @first filled
+ * @param end At most passes * ARGON2_SYNC_POINTS
+ * @return ARGON2_OK if successful
+ */
+int fill_memory_slices(argon2_instance_t *instance, uint64_t first,
+                       uint64_t end);
+
+/*
+ * Function that fills the entire memory of several instances on the calling
+ * thread, interleaving their segments
+ * @param instances Instances to fill, all initialized
+ * @param count Number of instances, at most ARGON2_MAX_INTERLEAVE
+ * @return ARGON2_OK if successful
+ */
+int fill_memory_blocks_batch(argon2_instance_t *const *instances,
+                             uint32_t count);
+
 #endif
@@ -15,7 +15,6 @@
  * software. If not, they may be obtained at the above URLs.
  */
 
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
@@ -110,7 +109,7 @@ static unsigned b64_char_to_byte(int c) {
  * zero) is returned.
  */
 static size_t to_base64(char *dst, size_t dst_len, const void *src,
-                        size_t src_len) {
+                        size_t src_len, const argon2_kernel_t *kernel) {
     size_t olen;
     const unsigned char *buf;
     unsigned acc, acc_len;
@@ -130,6 +129,12 @@ static size_t to_base64(char *dst, size_t dst_len, const void *src,
     acc = 0;
     acc_len = 0;
     buf = (const unsigned char *)src;
+    if (kernel->b64_encode != NULL) {
+        size_t done = kernel->b64_encode(dst, buf, src_len);
+        dst += (done / 3) << 2;
+        buf += done;
+        src_len -= done;
+    }
     while (src_len-- > 0) {
         acc = (acc << 8) + (*buf++);
         acc_len += 8;
@@ -149,7 +154,8 @@ static size_t to_base64(char *dst, size_t dst_len, const void *src,
  * Decode Base64 chars into bytes. The '*dst_len' value must initially
  * contain the length of the output buffer '*dst'; when the decoding
  * ends, the actual number of decoded bytes is written back in
- * '*dst_len'.
+ * '*dst_len'. 'src_len' is the number of characters before the end of
+ * the source string.
  *
  * Decoding stops when a non-Base64 character is encountered, or when
  * the output buffer capacity is exceeded. If an error occurred (output
@@ -158,7 +164,8 @@ static size_t to_base64(char *dst, size_t dst_len, const void *src,
  * points to the first non-Base64 character in the source stream, which
  * may be the terminating zero.
  */
-static const char *from_base64(void *dst, size_t *dst_len, const char *src) {
+static const char *from_base64(void *dst, size_t *dst_len, const char *src,
+                               size_t src_len, const argon2_kernel_t *kernel) {
     size_t len;
     unsigned char *buf;
     unsigned acc, acc_len;
@@ -167,6 +174,12 @@ static const char *from_base64(void *dst, size_t *dst_len, const char *src) {
     len = 0;
     acc = 0;
     acc_len = 0;
+    if (kernel->b64_decode != NULL) {
+        size_t done = kernel->b64_decode(buf, *dst_len, src, src_len);
+        src += done;
+        len = (done >> 2) * 3;
+        buf += len;
+    }
     for (;;) {
         unsigned d;
 
@@ -235,6 +248,25 @@ static const char *decode_decimal(const char *str, unsigned long *v) {
     return str;
 }
 
+/*
+ * Write the decimal digits of 'v' and a terminating zero in 'dst', which
+ * must be large enough (21 characters hold any 64-bit value). This is
+ * what sprintf() with "%lu" does, without the cost of parsing a format.
+ */
+static void encode_decimal(char *dst, unsigned long v) {
+    char tmp[30];
+    size_t len = 0;
+
+    do {
+        tmp[len++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    while (len > 0) {
+        *dst++ = tmp[--len];
+    }
+    *dst = 0;
+}
+
 /* ==================================================================== */
 /*
  * Code specific to Argon2.
@@ -305,7 +337,7 @@ int decode_string(argon2_context *ctx, const char *str, argon2_type type) {
 #define BIN(buf, max_len, len)                                                 \
     do {                                                                       \
         size_t bin_len = (max_len);                                            \
-        str = from_base64(buf, &bin_len, str);                                 \
+        str = from_base64(buf, &bin_len, str, (size_t)(end - str), kernel);    \
         if (str == NULL || bin_len > UINT32_MAX) {                             \
             return ARGON2_DECODING_FAIL;                                       \
         }                                                                      \
@@ -316,6 +348,8 @@ int decode_string(argon2_context *ctx, const char *str, argon2_type type) {
     size_t maxoutlen = ctx->outlen;
     int validation_result;
     const char* type_string;
+    const char *end = str + strlen(str);
+    const argon2_kernel_t *kernel = current_kernel();
 
     /* We should start with the argon2_type we are using */
     type_string = argon2_type2string(type, 0);
@@ -372,6 +406,11 @@ int decode_string(argon2_context *ctx, const char *str, argon2_type type) {
 
 int encode_string(char *dst, size_t dst_len, argon2_context *ctx,
                   argon2_type type) {
+    return encode_string_kernel(dst, dst_len, ctx, type, current_kernel());
+}
+
+int encode_string_kernel(char *dst, size_t dst_len, argon2_context *ctx,
+                         argon2_type type, const argon2_kernel_t *kernel) {
 #define SS(str)                                                                \
     do {                                                                       \
         size_t pp_len = strlen(str);                                           \
@@ -386,13 +425,13 @@ int encode_string(char *dst, size_t dst_len, argon2_context *ctx,
 #define SX(x)                                                                  \
     do {                                                                       \
         char tmp[30];                                                          \
-        sprintf(tmp, "%lu", (unsigned long)(x));                               \
+        encode_decimal(tmp, (unsigned long)(x));                               \
         SS(tmp);                                                               \
     } while ((void)0, 0)
 
 #define SB(buf, len)                                                           \
     do {                                                                       \
-        size_t sb_len = to_base64(dst, dst_len, buf, len);                     \
+        size_t sb_len = to_base64(dst, dst_len, buf, len, kernel);             \
         if (sb_len == (size_t)-1) {                                            \
             return ARGON2_ENCODING_FAIL;                                       \
         }                                                                      \
@@ -18,6 +18,7 @@
 #ifndef ENCODING_H
 #define ENCODING_H
 #include "argon2.h"
+#include "core.h"
 
 #define ARGON2_MAX_DECODED_LANES UINT32_C(255)
 #define ARGON2_MIN_DECODED_SALT_LEN UINT32_C(8)
@@ -34,6 +35,13 @@
 int encode_string(char *dst, size_t dst_len, argon2_context *ctx,
                   argon2_type type);
 
+/*
+* encode_string() with the Base64 code of @kernel, for callers encoding many
+* strings in a row.
+*/
+int encode_string_kernel(char *dst, size_t dst_len, argon2_context *ctx,
+                         argon2_type type, const argon2_kernel_t *kernel);
+
 /*
 * Decodes an Argon2 hash string into the provided structure 'ctx'.
 * The only fields that must be set prior to this call are ctx.saltlen and
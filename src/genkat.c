@@ -202,6 +202,12 @@ int main(int argc, char *argv[]) {
         fatal("wrong Argon2 version number");
     }
 
+    /* Refuse to silently fall back when a kernel was asked for */
+    if (getenv("ARGON2_KERNEL") != NULL &&
+        strcmp(getenv("ARGON2_KERNEL"), argon2_kernel_name()) != 0) {
+        fatal("requested kernel not available");
+    }
+
     generate_testvectors(type, version);
     return ARGON2_OK;
 }
@@ -0,0 +1,223 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "argon2.h"
+#include "core.h"
+#include "pages.h"
+#include "thread.h"
+
+/* The blocks of one running hash, on the stack of argon2_ctx_governed() */
+typedef struct Argon2_lease {
+    uint32_t offset; /* first block */
+    uint32_t count;  /* number of blocks */
+    struct Argon2_lease *next;
+} argon2_lease;
+
+struct Argon2_memory_governor {
+    block *memory;
+    uint32_t capacity; /* number of blocks in @memory */
+    uint32_t backing;  /* ARGON2_BACKING_* value of @memory */
+    argon2_lease *leases; /* memory in use, sorted by offset */
+#if !defined(ARGON2_NO_THREADS)
+    uint64_t next_ticket; /* handed to the next hash that has to wait */
+    uint64_t serving;     /* ticket of the waiting hash admitted next */
+    argon2_mutex_t mutex;
+    argon2_cond_t released;
+#endif
+};
+
+/* Finds the first free run of @lease->count blocks and sets
+ * @lease->offset to it. Call with the governor mutex held.
+ * @return Where to link @lease into the list, or NULL if there is no room
+ */
+static argon2_lease **find_room(argon2_memory_governor *governor,
+                                argon2_lease *lease) {
+    argon2_lease **link = &governor->leases;
+    uint32_t start = 0;
+
+    while (*link != NULL) {
+        if ((*link)->offset - start >= lease->count) {
+            break;
+        }
+        start = (*link)->offset + (*link)->count;
+        link = &(*link)->next;
+    }
+    if (*link == NULL && governor->capacity - start < lease->count) {
+        return NULL;
+    }
+    lease->offset = start;
+    return link;
+}
+
+/* Links @lease into @governor once its blocks are free, waiting if @wait
+ * behind the hashes that were already waiting
+ * @return ARGON2_OK, or ARGON2_MEMORY_BUDGET_EXCEEDED
+ */
+static int admit(argon2_memory_governor *governor, argon2_lease *lease,
+                 int wait) {
+    argon2_lease **link;
+
+    if (lease->count > governor->capacity) {
+        return ARGON2_MEMORY_BUDGET_EXCEEDED;
+    }
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_lock(&governor->mutex);
+    if (governor->serving != governor->next_ticket) {
+        link = NULL; /* do not overtake the waiting hashes */
+    } else {
+        link = find_room(governor, lease);
+    }
+    if (link == NULL && wait) {
+        uint64_t ticket = governor->next_ticket++;
+        while (ticket != governor->serving ||
+               (link = find_room(governor, lease)) == NULL) {
+            argon2_cond_wait(&governor->released, &governor->mutex);
+        }
+        governor->serving++;
+        argon2_cond_broadcast(&governor->released); /* for the next one */
+    }
+#else
+    (void)wait;
+    link = find_room(governor, lease);
+#endif
+    if (link != NULL) {
+        lease->next = *link;
+        *link = lease;
+    }
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_unlock(&governor->mutex);
+#endif
+    return link != NULL ? ARGON2_OK : ARGON2_MEMORY_BUDGET_EXCEEDED;
+}
+
+/* Unlinks @lease from @governor and wakes up the waiting hashes */
+static void dismiss(argon2_memory_governor *governor, argon2_lease *lease) {
+    argon2_lease **link;
+
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_lock(&governor->mutex);
+#endif
+    for (link = &governor->leases; *link != lease; link = &(*link)->next) {
+    }
+    *link = lease->next;
+#if !defined(ARGON2_NO_THREADS)
+    argon2_cond_broadcast(&governor->released);
+    argon2_mutex_unlock(&governor->mutex);
+#endif
+}
+
+argon2_memory_governor *argon2_governor_create(uint32_t budget,
+                                               uint32_t flags) {
+    argon2_memory_governor *governor;
+    size_t size = (size_t)budget * sizeof(block);
+
+    if (budget == 0 || size / sizeof(block) != budget) {
+        return NULL;
+    }
+
+    governor = calloc(1, sizeof(argon2_memory_governor));
+    if (governor == NULL) {
+        return NULL;
+    }
+    governor->capacity = budget;
+    governor->backing = ARGON2_BACKING_DEFAULT;
+#if !defined(ARGON2_NO_THREADS)
+    if (argon2_mutex_init(&governor->mutex)) {
+        free(governor);
+        return NULL;
+    }
+    if (argon2_cond_init(&governor->released)) {
+        argon2_mutex_destroy(&governor->mutex);
+        free(governor);
+        return NULL;
+    }
+#endif
+
+    if (flags & ARGON2_FLAG_HUGE_PAGES) {
+        governor->memory = argon2_pages_alloc(size, &governor->backing);
+    } else {
+        governor->memory = malloc(size);
+    }
+    if (governor->memory == NULL) {
+        argon2_governor_destroy(governor);
+        return NULL;
+    }
+    /* Fault every page in now, so the budget is all the memory it takes */
+    secure_wipe_memory(governor->memory, size);
+
+    return governor;
+}
+
+void argon2_governor_destroy(argon2_memory_governor *governor) {
+    if (governor == NULL) {
+        return;
+    }
+
+    if (governor->backing != ARGON2_BACKING_DEFAULT) {
+        argon2_pages_free(governor->memory,
+                          (size_t)governor->capacity * sizeof(block),
+                          governor->backing);
+    } else {
+        free(governor->memory);
+    }
+#if !defined(ARGON2_NO_THREADS)
+    argon2_cond_destroy(&governor->released);
+    argon2_mutex_destroy(&governor->mutex);
+#endif
+    free(governor);
+}
+
+int argon2_ctx_governed(argon2_context *context, argon2_type type,
+                        argon2_memory_governor *governor, int wait) {
+    argon2_instance_t instance;
+    argon2_workspace region;
+    argon2_lease lease;
+    int result;
+
+    if (governor == NULL) {
+        return argon2_ctx(context, type);
+    }
+
+    /* Validate the inputs and size the memory before queueing for it */
+    result = prepare_instance(&instance, context, type, NULL);
+    if (ARGON2_OK != result) {
+        return result;
+    }
+    lease.count = instance.memory_blocks;
+    result = admit(governor, &lease, wait);
+    if (ARGON2_OK != result) {
+        return result;
+    }
+
+    /* The run of blocks serves the hash as a workspace would, wiped by
+     * finalize() at the end */
+    memset(&region, 0, sizeof(region));
+    region.memory = governor->memory + lease.offset;
+    region.capacity = lease.count;
+    region.backing = governor->backing;
+    result = argon2_ctx_workspace(context, type, &region);
+    if (ARGON2_OK != result) {
+        clear_internal_memory(region.memory,
+                              (size_t)lease.count * sizeof(block));
+    }
+
+    dismiss(governor, &lease);
+    return result;
+}
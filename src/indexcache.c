@@ -0,0 +1,104 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "argon2.h"
+#include "core.h"
+
+argon2_index_cache *argon2_index_cache_create(argon2_type type,
+                                              uint32_t t_cost,
+                                              uint32_t m_cost,
+                                              uint32_t lanes) {
+    const argon2_kernel_t *kernel = current_kernel();
+    argon2_index_cache *cache;
+    argon2_instance_t instance;
+    argon2_position_t position;
+    uint32_t passes, slices, segment_length;
+    size_t count;
+
+    if (type != Argon2_i && type != Argon2_id) {
+        return NULL;
+    }
+    if (ARGON2_MIN_TIME > t_cost || ARGON2_MIN_LANES > lanes ||
+        ARGON2_MAX_LANES < lanes || ARGON2_MIN_MEMORY > m_cost ||
+        ARGON2_MAX_MEMORY < m_cost || m_cost < 8 * lanes) {
+        return NULL;
+    }
+
+    /* The rounding of prepare_instance() */
+    segment_length = m_cost / (lanes * ARGON2_SYNC_POINTS);
+
+    /* Argon2id is data-independent in the first half of its first pass */
+    passes = type == Argon2_i ? t_cost : 1;
+    slices = type == Argon2_i ? ARGON2_SYNC_POINTS : ARGON2_SYNC_POINTS / 2;
+    count = (size_t)segment_length * lanes * slices;
+    if (count > (size_t)-1 / sizeof(uint32_t) / passes) {
+        return NULL;
+    }
+    count *= passes;
+
+    cache = (argon2_index_cache *)malloc(sizeof(*cache));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->offsets = (uint32_t *)malloc(count * sizeof(uint32_t));
+    if (cache->offsets == NULL) {
+        free(cache);
+        return NULL;
+    }
+    cache->type = type;
+    cache->passes = t_cost;
+    cache->lanes = lanes;
+    cache->memory_blocks = segment_length * lanes * ARGON2_SYNC_POINTS;
+
+    /* An instance without memory: the addresses only need the parameters */
+    memset(&instance, 0, sizeof(instance));
+    instance.passes = t_cost;
+    instance.memory_blocks = cache->memory_blocks;
+    instance.segment_length = segment_length;
+    instance.lane_length = segment_length * ARGON2_SYNC_POINTS;
+    instance.lanes = lanes;
+    instance.threads = 1;
+    instance.type = type;
+
+    position.index = 0;
+    for (position.pass = 0; position.pass < passes; ++position.pass) {
+        for (position.slice = 0; position.slice < slices; ++position.slice) {
+            for (position.lane = 0; position.lane < lanes; ++position.lane) {
+                kernel->index_segment(
+                    &instance, position,
+                    cache->offsets +
+                        ((size_t)(position.pass * ARGON2_SYNC_POINTS +
+                                  position.slice) *
+                             lanes +
+                         position.lane) *
+                            segment_length);
+            }
+        }
+    }
+    return cache;
+}
+
+void argon2_index_cache_destroy(argon2_index_cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    free(cache->offsets);
+    free(cache);
+}
@@ -0,0 +1,215 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#if !defined(__aarch64__) && !defined(_M_ARM64)
+#error "The NEON kernel is built for AArch64, where NEON is always present"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "argon2.h"
+#include "core.h"
+
+#include "blake2/blake2.h"
+#include "blake2/blake2-impl.h"
+#include "blake2/blamka-round-neon.h"
+
+/*
+ * Fill kernel for AArch64, the counterpart of the SSE kernel in opt.c. NEON
+ * is part of the base AArch64 instruction set, so the kernel needs no CPU
+ * check and is always preferred over the portable one.
+ */
+
+/*
+ * Function fills a new memory block and optionally XORs the old block over the new one.
+ * Memory must be initialized.
+ * @param state Pointer to the just produced block. Content will be updated(!)
+ * @param ref_block Pointer to the reference block
+ * @param next_block Pointer to the block to be XORed over. May coincide with @ref_block
+ * @param with_xor Whether to XOR into the new block (1) or just overwrite (0)
+ * @pre all block pointers must be valid
+ */
+static void fill_block_neon(uint64x2_t *state, const block *ref_block,
+                            block *next_block, int with_xor) {
+    uint64x2_t block_XY[ARGON2_OWORDS_IN_BLOCK];
+    unsigned int i;
+
+    if (with_xor) {
+        for (i = 0; i < ARGON2_OWORDS_IN_BLOCK; i++) {
+            state[i] = veorq_u64(state[i], vld1q_u64(ref_block->v + 2 * i));
+            block_XY[i] =
+                veorq_u64(state[i], vld1q_u64(next_block->v + 2 * i));
+        }
+    } else {
+        for (i = 0; i < ARGON2_OWORDS_IN_BLOCK; i++) {
+            block_XY[i] = state[i] =
+                veorq_u64(state[i], vld1q_u64(ref_block->v + 2 * i));
+        }
+    }
+
+    for (i = 0; i < 8; ++i) {
+        BLAKE2_ROUND(state[8 * i + 0], state[8 * i + 1], state[8 * i + 2],
+            state[8 * i + 3], state[8 * i + 4], state[8 * i + 5],
+            state[8 * i + 6], state[8 * i + 7]);
+    }
+
+    for (i = 0; i < 8; ++i) {
+        BLAKE2_ROUND(state[8 * 0 + i], state[8 * 1 + i], state[8 * 2 + i],
+            state[8 * 3 + i], state[8 * 4 + i], state[8 * 5 + i],
+            state[8 * 6 + i], state[8 * 7 + i]);
+    }
+
+    for (i = 0; i < ARGON2_OWORDS_IN_BLOCK; i++) {
+        state[i] = veorq_u64(state[i], block_XY[i]);
+        vst1q_u64(next_block->v + 2 * i, state[i]);
+    }
+}
+
+static void next_addresses_neon(block *address_block, block *input_block) {
+    /*Temporary zero-initialized blocks*/
+    uint64x2_t zero_block[ARGON2_OWORDS_IN_BLOCK];
+    uint64x2_t zero2_block[ARGON2_OWORDS_IN_BLOCK];
+
+    memset(zero_block, 0, sizeof(zero_block));
+    memset(zero2_block, 0, sizeof(zero2_block));
+
+    /*Increasing index counter*/
+    input_block->v[6]++;
+
+    /*First iteration of G*/
+    fill_block_neon(zero_block, input_block, address_block, 0);
+
+    /*Second iteration of G*/
+    fill_block_neon(zero2_block, address_block, address_block, 0);
+}
+
+#define KERNEL_NAME neon
+#define KERNEL_TARGET
+#define KERNEL_STATE uint64x2_t state[ARGON2_OWORDS_IN_BLOCK]
+#define KERNEL_LOAD_STATE(state, block)                                        \
+    memcpy((state), (block)->v, ARGON2_BLOCK_SIZE)
+#define KERNEL_FILL_BLOCK fill_block_neon
+#define KERNEL_NEXT_ADDRESSES next_addresses_neon
+#include "segment.h"
+
+/*
+ * Base64 codecs, the counterparts of the SSSE3 ones in opt.c: comparisons
+ * and masks rather than table lookups, so that the timing does not depend
+ * on the data. The structure loads and stores split each step into the
+ * four characters, or three bytes, of every group, so one step encodes 48
+ * bytes into 64 characters or decodes them back.
+ */
+
+/* Characters of the 6-bit values in each byte of @x */
+static uint8x16_t b64_chars_neon(uint8x16_t x) {
+    uint8x16_t off = vdupq_n_u8('A');
+
+    off = vaddq_u8(off, vandq_u8(vcgtq_u8(x, vdupq_n_u8(25)),
+                                 vdupq_n_u8('a' - 26 - 'A')));
+    off = vsubq_u8(off, vandq_u8(vcgtq_u8(x, vdupq_n_u8(51)),
+                                 vdupq_n_u8('a' - 26 - '0' + 52)));
+    off = vsubq_u8(off, vandq_u8(vcgtq_u8(x, vdupq_n_u8(61)),
+                                 vdupq_n_u8('0' - 52 - '+' + 62)));
+    off = vaddq_u8(off, vandq_u8(vcgtq_u8(x, vdupq_n_u8(62)),
+                                 vdupq_n_u8('/' - 63 - '+' + 62)));
+    return vaddq_u8(x, off);
+}
+
+/* 6-bit values of the characters in @c; @valid flags the Base64 ones */
+static uint8x16_t b64_values_neon(uint8x16_t c, uint8x16_t *valid) {
+    uint8x16_t upper, lower, digit, plus, slash, x;
+
+    /* c - lo wraps around below lo, so one unsigned compare checks both
+     * ends of the range */
+    upper = vcleq_u8(vsubq_u8(c, vdupq_n_u8('A')), vdupq_n_u8(25));
+    lower = vcleq_u8(vsubq_u8(c, vdupq_n_u8('a')), vdupq_n_u8(25));
+    digit = vcleq_u8(vsubq_u8(c, vdupq_n_u8('0')), vdupq_n_u8(9));
+    plus = vceqq_u8(c, vdupq_n_u8('+'));
+    slash = vceqq_u8(c, vdupq_n_u8('/'));
+
+    x = vandq_u8(upper, vsubq_u8(c, vdupq_n_u8('A')));
+    x = vorrq_u8(x, vandq_u8(lower, vsubq_u8(c, vdupq_n_u8('a' - 26))));
+    x = vorrq_u8(x, vandq_u8(digit, vsubq_u8(c, vdupq_n_u8('0' - 52))));
+    x = vorrq_u8(x, vandq_u8(plus, vdupq_n_u8(62)));
+    x = vorrq_u8(x, vandq_u8(slash, vdupq_n_u8(63)));
+
+    *valid = vorrq_u8(vorrq_u8(upper, lower),
+                      vorrq_u8(digit, vorrq_u8(plus, slash)));
+    return x;
+}
+
+static size_t b64_encode_neon(char *dst, const uint8_t *src, size_t srclen) {
+    size_t done = 0;
+    unsigned i;
+
+    while (srclen - done >= 48) {
+        uint8x16x3_t in = vld3q_u8(src + done);
+        uint8x16x4_t out;
+
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vorrq_u8(vshlq_n_u8(in.val[0], 4),
+                              vshrq_n_u8(in.val[1], 4));
+        out.val[2] = vorrq_u8(vshlq_n_u8(in.val[1], 2),
+                              vshrq_n_u8(in.val[2], 6));
+        out.val[3] = in.val[2];
+        for (i = 0; i < 4; ++i) {
+            out.val[i] = b64_chars_neon(vandq_u8(out.val[i], vdupq_n_u8(63)));
+        }
+        vst4q_u8((uint8_t *)dst, out);
+        dst += 64;
+        done += 48;
+    }
+    return done;
+}
+
+static size_t b64_decode_neon(uint8_t *dst, size_t dstlen, const char *src,
+                              size_t srclen) {
+    size_t done = 0, written = 0;
+    unsigned i;
+
+    while (srclen - done >= 64 && dstlen - written >= 48) {
+        uint8x16x4_t in = vld4q_u8((const uint8_t *)(src + done));
+        uint8x16x3_t out;
+        uint8x16_t valid, all = vdupq_n_u8(0xFF);
+
+        for (i = 0; i < 4; ++i) {
+            in.val[i] = b64_values_neon(in.val[i], &valid);
+            all = vandq_u8(all, valid);
+        }
+        if (vminvq_u8(all) != 0xFF) {
+            break;
+        }
+        out.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2),
+                              vshrq_n_u8(in.val[1], 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4),
+                              vshrq_n_u8(in.val[2], 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+        vst3q_u8(dst + written, out);
+        done += 64;
+        written += 48;
+    }
+    return done;
+}
+
+static const argon2_kernel_t kernel_neon = {"neon", NULL, fill_segment_neon,
+                                            fill_segments_neon,
+                                            index_segment_neon, NULL,
+                                            b64_encode_neon, b64_decode_neon};
+
+const argon2_kernel_t *const argon2_kernels_arm[] = {&kernel_neon, NULL};
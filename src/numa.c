@@ -0,0 +1,235 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE /* syscall */
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "numa.h"
+#include "thread.h"
+
+#if defined(__linux__) && defined(SYS_mbind)
+
+#define NUMA_MAX_NODES 64
+#define NUMA_MPOL_PREFERRED 1 /* from <numaif.h>, without needing libnuma */
+#define NUMA_MPOL_MF_MOVE 2
+#define MASK_WORD_BITS (8 * sizeof(unsigned long))
+
+static argon2_numa_mask node_cpus[NUMA_MAX_NODES];
+static uint32_t node_count = 0; /* 0 until probed */
+#if !defined(ARGON2_NO_THREADS)
+static argon2_mutex_t numa_lock = ARGON2_MUTEX_INITIALIZER;
+#endif
+
+/* Reads a sysfs list such as "0-3,8-11" from @path into @mask
+ * @return The highest number in the list + 1, or 0 if it could not be read
+ */
+static uint32_t read_list(const char *path, argon2_numa_mask *mask) {
+    FILE *file = fopen(path, "r");
+    unsigned first, last;
+    uint32_t end = 0;
+    int c;
+
+    memset(mask, 0, sizeof(*mask));
+    if (file == NULL) {
+        return 0;
+    }
+    while (fscanf(file, "%u", &first) == 1) {
+        last = first;
+        c = fgetc(file);
+        if (c == '-') {
+            if (fscanf(file, "%u", &last) != 1) {
+                break;
+            }
+            c = fgetc(file);
+        }
+        for (; first <= last && first < ARGON2_NUMA_MAX_CPUS; ++first) {
+            mask->bits[first / MASK_WORD_BITS] |=
+                1UL << (first % MASK_WORD_BITS);
+            if (first + 1 > end) {
+                end = first + 1;
+            }
+        }
+        if (c != ',') {
+            break;
+        }
+    }
+    fclose(file);
+    return end;
+}
+
+/* Fills in node_count and node_cpus. Call with numa_lock held. */
+static void probe_nodes(void) {
+    argon2_numa_mask online;
+    char path[64];
+    uint32_t n;
+
+    n = read_list("/sys/devices/system/node/online", &online);
+    if (n > NUMA_MAX_NODES) {
+        n = NUMA_MAX_NODES;
+    }
+    if (n < 2) {
+        node_count = 1;
+        return;
+    }
+    for (node_count = 0; node_count < n; ++node_count) {
+        sprintf(path, "/sys/devices/system/node/node%u/cpulist",
+                (unsigned)node_count);
+        read_list(path, &node_cpus[node_count]); /* CPU-less nodes stay empty */
+    }
+}
+
+uint32_t argon2_numa_nodes(void) {
+    uint32_t nodes;
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_lock(&numa_lock);
+#endif
+    if (node_count == 0) {
+        probe_nodes();
+    }
+    nodes = node_count;
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_unlock(&numa_lock);
+#endif
+    return nodes;
+}
+
+int argon2_numa_bind(void *memory, size_t size, uint32_t node) {
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t)memory + page - 1) & ~(uintptr_t)(page - 1);
+    uintptr_t end = ((uintptr_t)memory + size) & ~(uintptr_t)(page - 1);
+    unsigned long nodemask[NUMA_MAX_NODES / MASK_WORD_BITS + 1] = {0};
+
+    if (node >= NUMA_MAX_NODES) {
+        return -1;
+    }
+    if (end <= begin) {
+        return 0; /* no whole page to bind */
+    }
+    nodemask[node / MASK_WORD_BITS] = 1UL << (node % MASK_WORD_BITS);
+    return syscall(SYS_mbind, (void *)begin, (unsigned long)(end - begin),
+                   NUMA_MPOL_PREFERRED, nodemask,
+                   (unsigned long)(8 * sizeof(nodemask)),
+                   NUMA_MPOL_MF_MOVE) == 0 ? 0 : -1;
+}
+
+int argon2_numa_pin(uint32_t node, argon2_numa_mask *saved) {
+    if (node >= argon2_numa_nodes() || node >= NUMA_MAX_NODES) {
+        return -1;
+    }
+    if (syscall(SYS_sched_getaffinity, 0, sizeof(saved->bits),
+                saved->bits) < 0) {
+        return -1;
+    }
+    /* Fails, leaving the thread alone, if the node has no CPUs */
+    return syscall(SYS_sched_setaffinity, 0, sizeof(node_cpus[node].bits),
+                   node_cpus[node].bits) == 0 ? 0 : -1;
+}
+
+void argon2_numa_unpin(const argon2_numa_mask *saved) {
+    syscall(SYS_sched_setaffinity, 0, sizeof(saved->bits), saved->bits);
+}
+
+uint32_t argon2_cpu_allowed(argon2_numa_mask *mask) {
+    long bytes;
+    uint32_t count = 0;
+    size_t i;
+    unsigned long word;
+
+    memset(mask, 0, sizeof(*mask));
+    bytes = syscall(SYS_sched_getaffinity, 0, sizeof(mask->bits), mask->bits);
+    if (bytes < 0) {
+        return 0;
+    }
+    for (i = 0; i < sizeof(mask->bits) / sizeof(mask->bits[0]); ++i) {
+        for (word = mask->bits[i]; word != 0; word &= word - 1) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int argon2_cpu_pin(uint32_t cpu, argon2_numa_mask *saved) {
+    argon2_numa_mask mask;
+
+    if (cpu >= ARGON2_NUMA_MAX_CPUS) {
+        return -1;
+    }
+    if (syscall(SYS_sched_getaffinity, 0, sizeof(saved->bits),
+                saved->bits) < 0) {
+        return -1;
+    }
+    memset(&mask, 0, sizeof(mask));
+    mask.bits[cpu / MASK_WORD_BITS] = 1UL << (cpu % MASK_WORD_BITS);
+    /* Fails, leaving the thread alone, if the CPU is not allowed */
+    return syscall(SYS_sched_setaffinity, 0, sizeof(mask.bits), mask.bits) ==
+                   0 ? 0 : -1;
+}
+
+#else /* single node */
+
+uint32_t argon2_numa_nodes(void) { return 1; }
+
+int argon2_numa_bind(void *memory, size_t size, uint32_t node) {
+    (void)memory;
+    (void)size;
+    (void)node;
+    return -1;
+}
+
+int argon2_numa_pin(uint32_t node, argon2_numa_mask *saved) {
+    (void)node;
+    (void)saved;
+    return -1;
+}
+
+void argon2_numa_unpin(const argon2_numa_mask *saved) { (void)saved; }
+
+uint32_t argon2_cpu_allowed(argon2_numa_mask *mask) {
+    memset(mask, 0, sizeof(*mask));
+    return 0;
+}
+
+int argon2_cpu_pin(uint32_t cpu, argon2_numa_mask *saved) {
+    (void)cpu;
+    (void)saved;
+    return -1;
+}
+
+#endif
+
+uint32_t argon2_cpu_nth(const argon2_numa_mask *mask, uint32_t n) {
+    const uint32_t word_bits = 8 * sizeof(unsigned long);
+    uint32_t cpu;
+
+    for (cpu = 0; cpu < ARGON2_NUMA_MAX_CPUS; ++cpu) {
+        if ((mask->bits[cpu / word_bits] >> (cpu % word_bits)) & 1UL) {
+            if (n-- == 0) {
+                break;
+            }
+        }
+    }
+    return cpu;
+}
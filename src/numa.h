@@ -0,0 +1,76 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#ifndef ARGON2_NUMA_H
+#define ARGON2_NUMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+        NUMA placement of the block matrix for ARGON2_FLAG_NUMA. Each lane's
+        memory is bound to the node of the worker filling it, and each
+        worker keeps to the CPUs of its node while it fills, so that only
+        the cross-lane references travel between sockets. Only Linux is
+        supported; elsewhere the machine is treated as a single node.
+
+        The same masks pin workers to single CPUs for ARGON2_FLAG_AFFINITY.
+*/
+
+/* Largest CPU number + 1 that a CPU mask can hold */
+#define ARGON2_NUMA_MAX_CPUS 1024
+
+/* A set of CPUs, in the layout of the kernel's affinity masks */
+typedef struct Argon2_numa_mask {
+    unsigned long bits[ARGON2_NUMA_MAX_CPUS / (8 * sizeof(unsigned long))];
+} argon2_numa_mask;
+
+/* Returns the number of NUMA nodes, 1 if unknown */
+uint32_t argon2_numa_nodes(void);
+
+/* Asks for the pages within [@memory, @memory + @size) to live on @node,
+ * moving those already faulted in
+ * @return 0 on success, -1 otherwise
+ */
+int argon2_numa_bind(void *memory, size_t size, uint32_t node);
+
+/* Restricts the calling thread to the CPUs of @node
+ * @param saved Receives the previous CPUs of the thread
+ * @return 0 on success, -1 if the thread was left as it was
+ */
+int argon2_numa_pin(uint32_t node, argon2_numa_mask *saved);
+
+/* Gives back to the calling thread the CPUs saved by argon2_numa_pin() or
+ * argon2_cpu_pin() */
+void argon2_numa_unpin(const argon2_numa_mask *saved);
+
+/* Reads the CPUs the calling thread may run on into @mask
+ * @return The number of CPUs, or 0 if unknown
+ */
+uint32_t argon2_cpu_allowed(argon2_numa_mask *mask);
+
+/* Returns the CPU of the @n-th CPU set in @mask, counting from 0, which
+ * must be fewer than the CPUs in @mask */
+uint32_t argon2_cpu_nth(const argon2_numa_mask *mask, uint32_t n);
+
+/* Restricts the calling thread to CPU @cpu
+ * @param saved Receives the previous CPUs of the thread
+ * @return 0 on success, -1 if the thread was left as it was
+ */
+int argon2_cpu_pin(uint32_t cpu, argon2_numa_mask *saved);
+
+#endif
@@ -19,96 +19,385 @@
 #include <string.h>
 #include <stdlib.h>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
 #include "argon2.h"
 #include "core.h"
 
 #include "blake2/blake2.h"
+#include "blake2/blake2-impl.h"
 #include "blake2/blamka-round-opt.h"
 
 /*
- * Function fills a new memory block and optionally XORs the old block over the new one.
- * Memory must be initialized.
- * @param state Pointer to the just produced block. Content will be updated(!)
- * @param ref_block Pointer to the reference block
- * @param next_block Pointer to the block to be XORed over. May coincide with @ref_block
- * @param with_xor Whether to XOR into the new block (1) or just overwrite (0)
- * @pre all block pointers must be valid
+ * Every kernel below is compiled into the library and the fastest one the
+ * CPU supports is picked at run time (see current_kernel() in core.c). The
+ * SSE kernel uses whatever the compiler targets by default. The AVX2 and
+ * AVX-512 kernels are built with a function-level target attribute, so they
+ * exist even when the rest of the library is built for plain x86-64; with
+ * compilers lacking that attribute they are only available when enabled on
+ * the command line.
  */
+#if defined(_MSC_VER)
+#define ARGON2_TARGET(isa)
+#define ARGON2_HAVE_AVX2
+#if _MSC_VER >= 1911
+#define ARGON2_HAVE_AVX512F
+#endif
+#elif (defined(__clang__) &&                                                   \
+       (__clang_major__ > 3 ||                                                 \
+        (__clang_major__ == 3 && __clang_minor__ >= 8))) ||                    \
+    (!defined(__clang__) && defined(__GNUC__) &&                               \
+     (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define ARGON2_TARGET(isa) __attribute__((target(isa)))
+#define ARGON2_HAVE_AVX2
+#define ARGON2_HAVE_AVX512F
+#else
+#define ARGON2_TARGET(isa)
+#if defined(__AVX2__)
+#define ARGON2_HAVE_AVX2
+#endif
 #if defined(__AVX512F__)
-static void fill_block(__m512i *state, const block *ref_block,
-                       block *next_block, int with_xor) {
-    __m512i block_XY[ARGON2_512BIT_WORDS_IN_BLOCK];
-    unsigned int i;
+#define ARGON2_HAVE_AVX512F
+#endif
+#endif
 
-    if (with_xor) {
-        for (i = 0; i < ARGON2_512BIT_WORDS_IN_BLOCK; i++) {
-            state[i] = _mm512_xor_si512(
-                state[i], _mm512_loadu_si512((const __m512i *)ref_block->v + i));
-            block_XY[i] = _mm512_xor_si512(
-                state[i], _mm512_loadu_si512((const __m512i *)next_block->v + i));
+#define CPU_SSE2 0x01
+#define CPU_SSSE3 0x02
+#define CPU_XOP 0x04
+#define CPU_AVX2 0x08
+#define CPU_AVX512F 0x10
+
+/* The SSE kernel needs whatever extensions blamka-round-opt.h picked */
+#if defined(__XOP__)
+#define SSE_NAME "xop"
+#define SSE_FEATURES (CPU_SSE2 | CPU_XOP)
+#elif defined(__SSSE3__)
+#define SSE_NAME "ssse3"
+#define SSE_FEATURES (CPU_SSE2 | CPU_SSSE3)
+#else
+#define SSE_NAME "sse2"
+#define SSE_FEATURES CPU_SSE2
+#endif
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, (int)leaf, (int)subleaf);
+    regs[0] = (uint32_t)info[0];
+    regs[1] = (uint32_t)info[1];
+    regs[2] = (uint32_t)info[2];
+    regs[3] = (uint32_t)info[3];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/* Reads XCR0, the register states the OS saves on context switches */
+static uint64_t xgetbv0(void) {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    /* xgetbv, as bytes for assemblers that predate it */
+    __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0"
+                         : "=a"(eax), "=d"(edx)
+                         : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static int cpu_detect(void) {
+    uint32_t regs[4], max_leaf;
+    uint64_t xcr0 = 0;
+    int features = 0;
+
+    cpuid(0, 0, regs);
+    max_leaf = regs[0];
+
+    if (max_leaf >= 1) {
+        cpuid(1, 0, regs);
+        if (regs[3] & (1UL << 26)) {
+            features |= CPU_SSE2;
         }
-    } else {
-        for (i = 0; i < ARGON2_512BIT_WORDS_IN_BLOCK; i++) {
-            block_XY[i] = state[i] = _mm512_xor_si512(
-                state[i], _mm512_loadu_si512((const __m512i *)ref_block->v + i));
+        if (regs[2] & (1UL << 9)) {
+            features |= CPU_SSSE3;
+        }
+        /* OSXSAVE and AVX */
+        if ((regs[2] & (1UL << 27)) && (regs[2] & (1UL << 28))) {
+            xcr0 = xgetbv0();
         }
     }
 
-    for (i = 0; i < 2; ++i) {
-        BLAKE2_ROUND_1(
-            state[8 * i + 0], state[8 * i + 1], state[8 * i + 2], state[8 * i + 3],
-            state[8 * i + 4], state[8 * i + 5], state[8 * i + 6], state[8 * i + 7]);
+    /* XMM and YMM state */
+    if ((xcr0 & 0x06) == 0x06) {
+        if (max_leaf >= 7) {
+            cpuid(7, 0, regs);
+            if (regs[1] & (1UL << 5)) {
+                features |= CPU_AVX2;
+            }
+            /* Opmask and ZMM state as well */
+            if ((regs[1] & (1UL << 16)) && (xcr0 & 0xE6) == 0xE6) {
+                features |= CPU_AVX512F;
+            }
+        }
+
+        cpuid(0x80000000UL, 0, regs);
+        if (regs[0] >= 0x80000001UL) {
+            cpuid(0x80000001UL, 0, regs);
+            if (regs[2] & (1UL << 11)) {
+                features |= CPU_XOP;
+            }
+        }
     }
 
-    for (i = 0; i < 2; ++i) {
-        BLAKE2_ROUND_2(
-            state[2 * 0 + i], state[2 * 1 + i], state[2 * 2 + i], state[2 * 3 + i],
-            state[2 * 4 + i], state[2 * 5 + i], state[2 * 6 + i], state[2 * 7 + i]);
+    return features;
+}
+
+/* Only called with the kernel lock held, see current_kernel() */
+static int cpu_supports(int features) {
+    static int cpu_features = -1;
+
+    if (cpu_features < 0) {
+        cpu_features = cpu_detect();
     }
+    return (cpu_features & features) == features;
+}
+
+/*
+ * Base64 codecs behind to_base64() and from_base64() in encoding.c. Like
+ * the scalar code, they map between characters and 6-bit values with
+ * comparisons and masks instead of table lookups, so that the timing does
+ * not depend on the data. Each step encodes 12 bytes into 16 characters
+ * or decodes them back; the AVX2 codecs take two steps at once.
+ */
+#if defined(__SSSE3__) || defined(ARGON2_HAVE_AVX2)
+#define B64_SPLIT_MASK1 0x0fc0fc00
+#define B64_SPLIT_MUL1 0x04000040
+#define B64_SPLIT_MASK2 0x003f03f0
+#define B64_SPLIT_MUL2 0x01000010
+#define B64_MERGE_MUL1 0x01400140
+#define B64_MERGE_MUL2 0x00011000
+
+/* Characters of the 6-bit values in each byte of @x */
+static ARGON2_TARGET("ssse3") __m128i b64_chars_ssse3(__m128i x) {
+    __m128i off = _mm_set1_epi8('A');
+
+    off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(25)),
+                                          _mm_set1_epi8('a' - 26 - 'A')));
+    off = _mm_sub_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(51)),
+                                          _mm_set1_epi8('a' - 26 - '0' + 52)));
+    off = _mm_sub_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(61)),
+                                          _mm_set1_epi8('0' - 52 - '+' + 62)));
+    off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(62)),
+                                          _mm_set1_epi8('/' - 63 - '+' + 62)));
+    return _mm_add_epi8(x, off);
+}
+
+/* 6-bit values of the characters in @c; @valid flags the Base64 ones */
+static ARGON2_TARGET("ssse3") __m128i b64_values_ssse3(__m128i c,
+                                                       __m128i *valid) {
+    __m128i upper, lower, digit, plus, slash, x;
+
+    upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)),
+                          _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), c));
+    lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)),
+                          _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), c));
+    digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                          _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), c));
+    plus = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+    slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+
+    x = _mm_and_si128(upper, _mm_sub_epi8(c, _mm_set1_epi8('A')));
+    x = _mm_or_si128(x, _mm_and_si128(lower, _mm_sub_epi8(c, _mm_set1_epi8(
+                                                                 'a' - 26))));
+    x = _mm_or_si128(x, _mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8(
+                                                                 '0' - 52))));
+    x = _mm_or_si128(x, _mm_and_si128(plus, _mm_set1_epi8(62)));
+    x = _mm_or_si128(x, _mm_and_si128(slash, _mm_set1_epi8(63)));
+
+    *valid = _mm_or_si128(_mm_or_si128(upper, lower),
+                          _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+    return x;
+}
 
-    for (i = 0; i < ARGON2_512BIT_WORDS_IN_BLOCK; i++) {
-        state[i] = _mm512_xor_si512(state[i], block_XY[i]);
-        _mm512_storeu_si512((__m512i *)next_block->v + i, state[i]);
+static ARGON2_TARGET("ssse3") size_t
+    b64_encode_ssse3(char *dst, const uint8_t *src, size_t srclen) {
+    const __m128i spread =
+        _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    size_t done = 0;
+
+    /* 16 bytes are loaded for the 12 encoded */
+    while (srclen - done >= 16) {
+        __m128i in, x;
+
+        in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + done)),
+                              spread);
+        x = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(B64_SPLIT_MASK1)),
+                            _mm_set1_epi32(B64_SPLIT_MUL1));
+        x = _mm_or_si128(
+            x, _mm_mullo_epi16(_mm_and_si128(in,
+                                             _mm_set1_epi32(B64_SPLIT_MASK2)),
+                               _mm_set1_epi32(B64_SPLIT_MUL2)));
+        _mm_storeu_si128((__m128i *)dst, b64_chars_ssse3(x));
+        dst += 16;
+        done += 12;
     }
+    return done;
 }
-#elif defined(__AVX2__)
-static void fill_block(__m256i *state, const block *ref_block,
-                       block *next_block, int with_xor) {
-    __m256i block_XY[ARGON2_HWORDS_IN_BLOCK];
-    unsigned int i;
 
-    if (with_xor) {
-        for (i = 0; i < ARGON2_HWORDS_IN_BLOCK; i++) {
-            state[i] = _mm256_xor_si256(
-                state[i], _mm256_loadu_si256((const __m256i *)ref_block->v + i));
-            block_XY[i] = _mm256_xor_si256(
-                state[i], _mm256_loadu_si256((const __m256i *)next_block->v + i));
-        }
-    } else {
-        for (i = 0; i < ARGON2_HWORDS_IN_BLOCK; i++) {
-            block_XY[i] = state[i] = _mm256_xor_si256(
-                state[i], _mm256_loadu_si256((const __m256i *)ref_block->v + i));
+static ARGON2_TARGET("ssse3") size_t
+    b64_decode_ssse3(uint8_t *dst, size_t dstlen, const char *src,
+                     size_t srclen) {
+    const __m128i pack =
+        _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t done = 0, written = 0;
+
+    /* 16 bytes are stored for the 12 decoded */
+    while (srclen - done >= 16 && dstlen - written >= 16) {
+        __m128i x, valid;
+
+        x = b64_values_ssse3(_mm_loadu_si128((const __m128i *)(src + done)),
+                             &valid);
+        if (_mm_movemask_epi8(valid) != 0xFFFF) {
+            break;
         }
+        x = _mm_maddubs_epi16(x, _mm_set1_epi32(B64_MERGE_MUL1));
+        x = _mm_madd_epi16(x, _mm_set1_epi32(B64_MERGE_MUL2));
+        _mm_storeu_si128((__m128i *)(dst + written), _mm_shuffle_epi8(x, pack));
+        done += 16;
+        written += 12;
     }
+    return done;
+}
+#endif
 
-    for (i = 0; i < 4; ++i) {
-        BLAKE2_ROUND_1(state[8 * i + 0], state[8 * i + 4], state[8 * i + 1], state[8 * i + 5],
-                       state[8 * i + 2], state[8 * i + 6], state[8 * i + 3], state[8 * i + 7]);
-    }
+#if defined(ARGON2_HAVE_AVX2)
+static ARGON2_TARGET("avx2") __m256i b64_chars_avx2(__m256i x) {
+    __m256i off = _mm256_set1_epi8('A');
+
+    off = _mm256_add_epi8(
+        off, _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(25)),
+                              _mm256_set1_epi8('a' - 26 - 'A')));
+    off = _mm256_sub_epi8(
+        off, _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(51)),
+                              _mm256_set1_epi8('a' - 26 - '0' + 52)));
+    off = _mm256_sub_epi8(
+        off, _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(61)),
+                              _mm256_set1_epi8('0' - 52 - '+' + 62)));
+    off = _mm256_add_epi8(
+        off, _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(62)),
+                              _mm256_set1_epi8('/' - 63 - '+' + 62)));
+    return _mm256_add_epi8(x, off);
+}
 
-    for (i = 0; i < 4; ++i) {
-        BLAKE2_ROUND_2(state[ 0 + i], state[ 4 + i], state[ 8 + i], state[12 + i],
-                       state[16 + i], state[20 + i], state[24 + i], state[28 + i]);
+static ARGON2_TARGET("avx2") __m256i b64_values_avx2(__m256i c,
+                                                     __m256i *valid) {
+    __m256i upper, lower, digit, plus, slash, x;
+
+    upper = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)),
+                             _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), c));
+    lower = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('a' - 1)),
+                             _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), c));
+    digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                             _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+    plus = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('+'));
+    slash = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('/'));
+
+    x = _mm256_and_si256(upper, _mm256_sub_epi8(c, _mm256_set1_epi8('A')));
+    x = _mm256_or_si256(
+        x, _mm256_and_si256(lower, _mm256_sub_epi8(c, _mm256_set1_epi8(
+                                                          'a' - 26))));
+    x = _mm256_or_si256(
+        x, _mm256_and_si256(digit, _mm256_sub_epi8(c, _mm256_set1_epi8(
+                                                          '0' - 52))));
+    x = _mm256_or_si256(x, _mm256_and_si256(plus, _mm256_set1_epi8(62)));
+    x = _mm256_or_si256(x, _mm256_and_si256(slash, _mm256_set1_epi8(63)));
+
+    *valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+                             _mm256_or_si256(digit, _mm256_or_si256(plus,
+                                                                    slash)));
+    return x;
+}
+
+static ARGON2_TARGET("avx2") size_t
+    b64_encode_avx2(char *dst, const uint8_t *src, size_t srclen) {
+    const __m256i spread = _mm256_setr_epi8(
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5,
+        4, 7, 6, 8, 7, 10, 9, 11, 10);
+    size_t done = 0;
+
+    /* Each half loads 16 bytes for the 12 it encodes */
+    while (srclen - done >= 28) {
+        __m256i in, x;
+
+        in = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128((const __m128i *)(src + done))),
+            _mm_loadu_si128((const __m128i *)(src + done + 12)), 1);
+        in = _mm256_shuffle_epi8(in, spread);
+        x = _mm256_mulhi_epu16(
+            _mm256_and_si256(in, _mm256_set1_epi32(B64_SPLIT_MASK1)),
+            _mm256_set1_epi32(B64_SPLIT_MUL1));
+        x = _mm256_or_si256(
+            x, _mm256_mullo_epi16(
+                   _mm256_and_si256(in, _mm256_set1_epi32(B64_SPLIT_MASK2)),
+                   _mm256_set1_epi32(B64_SPLIT_MUL2)));
+        _mm256_storeu_si256((__m256i *)dst, b64_chars_avx2(x));
+        dst += 32;
+        done += 24;
     }
+    return done + b64_encode_ssse3(dst, src + done, srclen - done);
+}
 
-    for (i = 0; i < ARGON2_HWORDS_IN_BLOCK; i++) {
-        state[i] = _mm256_xor_si256(state[i], block_XY[i]);
-        _mm256_storeu_si256((__m256i *)next_block->v + i, state[i]);
+static ARGON2_TARGET("avx2") size_t
+    b64_decode_avx2(uint8_t *dst, size_t dstlen, const char *src,
+                    size_t srclen) {
+    const __m256i pack = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5,
+        4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t done = 0, written = 0;
+
+    /* Each half stores 16 bytes for the 12 it decodes */
+    while (srclen - done >= 32 && dstlen - written >= 28) {
+        __m256i x, valid;
+
+        x = b64_values_avx2(_mm256_loadu_si256((const __m256i *)(src + done)),
+                            &valid);
+        if ((uint32_t)_mm256_movemask_epi8(valid) != UINT32_C(0xFFFFFFFF)) {
+            break;
+        }
+        x = _mm256_maddubs_epi16(x, _mm256_set1_epi32(B64_MERGE_MUL1));
+        x = _mm256_madd_epi16(x, _mm256_set1_epi32(B64_MERGE_MUL2));
+        x = _mm256_shuffle_epi8(x, pack);
+        _mm_storeu_si128((__m128i *)(dst + written),
+                         _mm256_castsi256_si128(x));
+        _mm_storeu_si128((__m128i *)(dst + written + 12),
+                         _mm256_extracti128_si256(x, 1));
+        done += 32;
+        written += 24;
     }
+    return done + b64_decode_ssse3(dst + written, dstlen - written, src + done,
+                                   srclen - done);
 }
-#else
-static void fill_block(__m128i *state, const block *ref_block,
-                       block *next_block, int with_xor) {
+#endif
+
+/*
+ * Function fills a new memory block and optionally XORs the old block over the new one.
+ * Memory must be initialized.
+ * @param state Pointer to the just produced block. Content will be updated(!)
+ * @param ref_block Pointer to the reference block
+ * @param next_block Pointer to the block to be XORed over. May coincide with @ref_block
+ * @param with_xor Whether to XOR into the new block (1) or just overwrite (0)
+ * @param stream Whether to write the new block with non-temporal stores,
+ * which only needs 16-byte alignment in every kernel
+ * @pre all block pointers must be valid
+ */
+static void fill_block_sse(__m128i *state, const block *ref_block,
+                           block *next_block, int with_xor, int stream) {
     __m128i block_XY[ARGON2_OWORDS_IN_BLOCK];
     unsigned int i;
 
@@ -138,25 +427,23 @@ static void fill_block(__m128i *state, const block *ref_block,
             state[8 * 6 + i], state[8 * 7 + i]);
     }
 
-    for (i = 0; i < ARGON2_OWORDS_IN_BLOCK; i++) {
-        state[i] = _mm_xor_si128(state[i], block_XY[i]);
-        _mm_storeu_si128((__m128i *)next_block->v + i, state[i]);
+    if (stream) {
+        for (i = 0; i < ARGON2_OWORDS_IN_BLOCK; i++) {
+            state[i] = _mm_xor_si128(state[i], block_XY[i]);
+            _mm_stream_si128((__m128i *)next_block->v + i, state[i]);
+        }
+    } else {
+        for (i = 0; i < ARGON2_OWORDS_IN_BLOCK; i++) {
+            state[i] = _mm_xor_si128(state[i], block_XY[i]);
+            _mm_storeu_si128((__m128i *)next_block->v + i, state[i]);
+        }
     }
 }
-#endif
 
-static void next_addresses(block *address_block, block *input_block) {
+static void next_addresses_sse(block *address_block, block *input_block) {
     /*Temporary zero-initialized blocks*/
-#if defined(__AVX512F__)
-    __m512i zero_block[ARGON2_512BIT_WORDS_IN_BLOCK];
-    __m512i zero2_block[ARGON2_512BIT_WORDS_IN_BLOCK];
-#elif defined(__AVX2__)
-    __m256i zero_block[ARGON2_HWORDS_IN_BLOCK];
-    __m256i zero2_block[ARGON2_HWORDS_IN_BLOCK];
-#else
     __m128i zero_block[ARGON2_OWORDS_IN_BLOCK];
     __m128i zero2_block[ARGON2_OWORDS_IN_BLOCK];
-#endif
 
     memset(zero_block, 0, sizeof(zero_block));
     memset(zero2_block, 0, sizeof(zero2_block));
@@ -165,119 +452,351 @@ static void next_addresses(block *address_block, block *input_block) {
     input_block->v[6]++;
 
     /*First iteration of G*/
-    fill_block(zero_block, input_block, address_block, 0);
+    fill_block_sse(zero_block, input_block, address_block, 0, 0);
 
     /*Second iteration of G*/
-    fill_block(zero2_block, address_block, address_block, 0);
+    fill_block_sse(zero2_block, address_block, address_block, 0, 0);
 }
 
-void fill_segment(const argon2_instance_t *instance,
-                  argon2_position_t position) {
-    block *ref_block = NULL, *curr_block = NULL;
-    block address_block, input_block;
-    uint64_t pseudo_rand, ref_index, ref_lane;
-    uint32_t prev_offset, curr_offset;
-    uint32_t starting_index, i;
-#if defined(__AVX512F__)
-    __m512i state[ARGON2_512BIT_WORDS_IN_BLOCK];
-#elif defined(__AVX2__)
-    __m256i state[ARGON2_HWORDS_IN_BLOCK];
+#define KERNEL_NAME sse
+#define KERNEL_TARGET
+#define KERNEL_STATE __m128i state[ARGON2_OWORDS_IN_BLOCK]
+#define KERNEL_LOAD_STATE(state, block)                                        \
+    memcpy((state), (block)->v, ARGON2_BLOCK_SIZE)
+#define KERNEL_FILL_BLOCK(state, ref_block, next_block, with_xor)              \
+    fill_block_sse((state), (ref_block), (next_block), (with_xor), 0)
+#define KERNEL_NEXT_ADDRESSES next_addresses_sse
+#define KERNEL_STREAM_BLOCK(state, ref_block, next_block)                      \
+    fill_block_sse((state), (ref_block), (next_block), 0, 1)
+#define KERNEL_STREAM_ALIGN 16
+#define KERNEL_STREAM_FENCE _mm_sfence
+#include "segment.h"
+
+static int sse_supported(void) { return cpu_supports(SSE_FEATURES); }
+
+#if defined(__SSSE3__)
+#define KERNEL_SSE_B64_ENCODE b64_encode_ssse3
+#define KERNEL_SSE_B64_DECODE b64_decode_ssse3
 #else
-    __m128i state[ARGON2_OWORDS_IN_BLOCK];
+#define KERNEL_SSE_B64_ENCODE NULL
+#define KERNEL_SSE_B64_DECODE NULL
 #endif
-    int data_independent_addressing;
 
-    if (instance == NULL) {
-        return;
+static const argon2_kernel_t kernel_sse = {
+    SSE_NAME,          sse_supported,         fill_segment_sse,
+    fill_segments_sse, index_segment_sse,     NULL,
+    KERNEL_SSE_B64_ENCODE, KERNEL_SSE_B64_DECODE};
+
+#if defined(ARGON2_HAVE_AVX2)
+static ARGON2_TARGET("avx2") void
+fill_block_avx2(__m256i *state, const block *ref_block, block *next_block,
+                int with_xor, int stream) {
+    __m256i block_XY[ARGON2_HWORDS_IN_BLOCK];
+    unsigned int i;
+
+    if (with_xor) {
+        for (i = 0; i < ARGON2_HWORDS_IN_BLOCK; i++) {
+            state[i] = _mm256_xor_si256(
+                state[i], _mm256_loadu_si256((const __m256i *)ref_block->v + i));
+            block_XY[i] = _mm256_xor_si256(
+                state[i], _mm256_loadu_si256((const __m256i *)next_block->v + i));
+        }
+    } else {
+        for (i = 0; i < ARGON2_HWORDS_IN_BLOCK; i++) {
+            block_XY[i] = state[i] = _mm256_xor_si256(
+                state[i], _mm256_loadu_si256((const __m256i *)ref_block->v + i));
+        }
     }
 
-    data_independent_addressing =
-        (instance->type == Argon2_i) ||
-        (instance->type == Argon2_id && (position.pass == 0) &&
-         (position.slice < ARGON2_SYNC_POINTS / 2));
+    for (i = 0; i < 4; ++i) {
+        BLAKE2_ROUND_1_AVX2(state[8 * i + 0], state[8 * i + 4], state[8 * i + 1], state[8 * i + 5],
+                            state[8 * i + 2], state[8 * i + 6], state[8 * i + 3], state[8 * i + 7]);
+    }
 
-    if (data_independent_addressing) {
-        init_block_value(&input_block, 0);
+    for (i = 0; i < 4; ++i) {
+        BLAKE2_ROUND_2_AVX2(state[ 0 + i], state[ 4 + i], state[ 8 + i], state[12 + i],
+                            state[16 + i], state[20 + i], state[24 + i], state[28 + i]);
+    }
 
-        input_block.v[0] = position.pass;
-        input_block.v[1] = position.lane;
-        input_block.v[2] = position.slice;
-        input_block.v[3] = instance->memory_blocks;
-        input_block.v[4] = instance->passes;
-        input_block.v[5] = instance->type;
+    if (stream) {
+        /* In 16-byte halves, as malloc() aligns no further */
+        for (i = 0; i < ARGON2_HWORDS_IN_BLOCK; i++) {
+            state[i] = _mm256_xor_si256(state[i], block_XY[i]);
+            _mm_stream_si128((__m128i *)next_block->v + 2 * i,
+                             _mm256_castsi256_si128(state[i]));
+            _mm_stream_si128((__m128i *)next_block->v + 2 * i + 1,
+                             _mm256_extracti128_si256(state[i], 1));
+        }
+    } else {
+        for (i = 0; i < ARGON2_HWORDS_IN_BLOCK; i++) {
+            state[i] = _mm256_xor_si256(state[i], block_XY[i]);
+            _mm256_storeu_si256((__m256i *)next_block->v + i, state[i]);
+        }
     }
+}
 
-    starting_index = 0;
+static ARGON2_TARGET("avx2") void
+next_addresses_avx2(block *address_block, block *input_block) {
+    /*Temporary zero-initialized blocks*/
+    __m256i zero_block[ARGON2_HWORDS_IN_BLOCK];
+    __m256i zero2_block[ARGON2_HWORDS_IN_BLOCK];
+
+    memset(zero_block, 0, sizeof(zero_block));
+    memset(zero2_block, 0, sizeof(zero2_block));
+
+    /*Increasing index counter*/
+    input_block->v[6]++;
 
-    if ((0 == position.pass) && (0 == position.slice)) {
-        starting_index = 2; /* we have already generated the first two blocks */
+    /*First iteration of G*/
+    fill_block_avx2(zero_block, input_block, address_block, 0, 0);
 
-        /* Don't forget to generate the first block of addresses: */
-        if (data_independent_addressing) {
-            next_addresses(&address_block, &input_block);
+    /*Second iteration of G*/
+    fill_block_avx2(zero2_block, address_block, address_block, 0, 0);
+}
+
+#define KERNEL_NAME avx2
+#define KERNEL_TARGET ARGON2_TARGET("avx2")
+#define KERNEL_STATE __m256i state[ARGON2_HWORDS_IN_BLOCK]
+#define KERNEL_LOAD_STATE(state, block)                                        \
+    memcpy((state), (block)->v, ARGON2_BLOCK_SIZE)
+#define KERNEL_FILL_BLOCK(state, ref_block, next_block, with_xor)              \
+    fill_block_avx2((state), (ref_block), (next_block), (with_xor), 0)
+#define KERNEL_NEXT_ADDRESSES next_addresses_avx2
+#define KERNEL_STREAM_BLOCK(state, ref_block, next_block)                      \
+    fill_block_avx2((state), (ref_block), (next_block), 0, 1)
+#define KERNEL_STREAM_ALIGN 16
+#define KERNEL_STREAM_FENCE _mm_sfence
+#include "segment.h"
+
+static const uint64_t blake2b_iv4[8] = {
+    UINT64_C(0x6a09e667f3bcc908), UINT64_C(0xbb67ae8584caa73b),
+    UINT64_C(0x3c6ef372fe94f82b), UINT64_C(0xa54ff53a5f1d36f1),
+    UINT64_C(0x510e527fade682d1), UINT64_C(0x9b05688c2b3e6c1f),
+    UINT64_C(0x1f83d9abfb41bd6b), UINT64_C(0x5be0cd19137e2179)};
+
+static const unsigned char blake2b_sigma4[12][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+};
+
+#define G4(r, i, a, b, c, d)                                                   \
+    do {                                                                       \
+        a = _mm256_add_epi64(_mm256_add_epi64(a, b),                           \
+                             m[blake2b_sigma4[r][2 * i + 0]]);                 \
+        d = rotr32(_mm256_xor_si256(d, a));                                    \
+        c = _mm256_add_epi64(c, d);                                            \
+        b = rotr24(_mm256_xor_si256(b, c));                                    \
+        a = _mm256_add_epi64(_mm256_add_epi64(a, b),                           \
+                             m[blake2b_sigma4[r][2 * i + 1]]);                 \
+        d = rotr16(_mm256_xor_si256(d, a));                                    \
+        c = _mm256_add_epi64(c, d);                                            \
+        b = rotr63(_mm256_xor_si256(b, c));                                    \
+    } while ((void)0, 0)
+
+/* blake2b_hash4_fn with one 64-bit word of each of the four messages per
+ * vector, the compression of blake2b.c otherwise unchanged */
+static ARGON2_TARGET("avx2") void
+blake2b_hash4_avx2(uint8_t *const *out, const uint8_t *const *in,
+                   size_t inlen, unsigned count) {
+    uint8_t buffer[BLAKE2B_BLOCKBYTES];
+    uint64_t words[16][4];
+    __m256i m[16], v[16], h[8];
+    unsigned int i, j, r;
+
+    memset(words, 0, sizeof(words));
+    for (j = 0; j < count; ++j) {
+        memset(buffer, 0, sizeof(buffer));
+        memcpy(buffer, in[j], inlen);
+        for (i = 0; i < 16; ++i) {
+            words[i][j] = load64(buffer + i * sizeof(uint64_t));
         }
     }
+    for (i = 0; i < 16; ++i) {
+        m[i] = _mm256_loadu_si256((const __m256i *)words[i]);
+    }
 
-    /* Offset of the current block */
-    curr_offset = position.lane * instance->lane_length +
-                  position.slice * instance->segment_length + starting_index;
-
-    if (0 == curr_offset % instance->lane_length) {
-        /* Last block in this lane */
-        prev_offset = curr_offset + instance->lane_length - 1;
-    } else {
-        /* Previous block */
-        prev_offset = curr_offset - 1;
+    /* Unkeyed parameter block for a BLAKE2B_OUTBYTES-byte digest */
+    for (i = 0; i < 8; ++i) {
+        h[i] = _mm256_set1_epi64x((int64_t)blake2b_iv4[i]);
     }
+    h[0] = _mm256_xor_si256(
+        h[0], _mm256_set1_epi64x(UINT64_C(0x01010000) | BLAKE2B_OUTBYTES));
 
-    memcpy(state, ((instance->memory + prev_offset)->v), ARGON2_BLOCK_SIZE);
+    for (i = 0; i < 8; ++i) {
+        v[i] = h[i];
+        v[i + 8] = _mm256_set1_epi64x((int64_t)blake2b_iv4[i]);
+    }
+    v[12] = _mm256_xor_si256(v[12], _mm256_set1_epi64x((int64_t)inlen));
+    v[14] = _mm256_xor_si256(v[14], _mm256_set1_epi64x(-1)); /* last block */
+
+    for (r = 0; r < 12; ++r) {
+        G4(r, 0, v[0], v[4], v[8], v[12]);
+        G4(r, 1, v[1], v[5], v[9], v[13]);
+        G4(r, 2, v[2], v[6], v[10], v[14]);
+        G4(r, 3, v[3], v[7], v[11], v[15]);
+        G4(r, 4, v[0], v[5], v[10], v[15]);
+        G4(r, 5, v[1], v[6], v[11], v[12]);
+        G4(r, 6, v[2], v[7], v[8], v[13]);
+        G4(r, 7, v[3], v[4], v[9], v[14]);
+    }
 
-    for (i = starting_index; i < instance->segment_length;
-         ++i, ++curr_offset, ++prev_offset) {
-        /*1.1 Rotating prev_offset if needed */
-        if (curr_offset % instance->lane_length == 1) {
-            prev_offset = curr_offset - 1;
+    for (i = 0; i < 8; ++i) {
+        h[i] = _mm256_xor_si256(h[i], _mm256_xor_si256(v[i], v[i + 8]));
+        _mm256_storeu_si256((__m256i *)words[i], h[i]);
+    }
+    for (j = 0; j < count; ++j) {
+        for (i = 0; i < 8; ++i) {
+            store64(out[j] + i * sizeof(uint64_t), words[i][j]);
         }
+    }
 
-        /* 1.2 Computing the index of the reference block */
-        /* 1.2.1 Taking pseudo-random value from the previous block */
-        if (data_independent_addressing) {
-            if (i % ARGON2_ADDRESSES_IN_BLOCK == 0) {
-                next_addresses(&address_block, &input_block);
-            }
-            pseudo_rand = address_block.v[i % ARGON2_ADDRESSES_IN_BLOCK];
-        } else {
-            pseudo_rand = instance->memory[prev_offset].v[0];
-        }
+    clear_internal_memory(buffer, sizeof(buffer));
+    clear_internal_memory(words, sizeof(words));
+}
+
+#undef G4
 
-        /* 1.2.2 Computing the lane of the reference block */
-        ref_lane = ((pseudo_rand >> 32)) % instance->lanes;
+static int avx2_supported(void) { return cpu_supports(CPU_AVX2); }
 
-        if ((position.pass == 0) && (position.slice == 0)) {
-            /* Can not reference other lanes yet */
-            ref_lane = position.lane;
+static const argon2_kernel_t kernel_avx2 = {"avx2", avx2_supported,
+                                            fill_segment_avx2,
+                                            fill_segments_avx2,
+                                            index_segment_avx2,
+                                            blake2b_hash4_avx2,
+                                            b64_encode_avx2,
+                                            b64_decode_avx2};
+#endif /* ARGON2_HAVE_AVX2 */
+
+#if defined(ARGON2_HAVE_AVX512F)
+static ARGON2_TARGET("avx512f") void
+fill_block_avx512f(__m512i *state, const block *ref_block, block *next_block,
+                   int with_xor, int stream) {
+    __m512i block_XY[ARGON2_512BIT_WORDS_IN_BLOCK];
+    unsigned int i;
+
+    if (with_xor) {
+        for (i = 0; i < ARGON2_512BIT_WORDS_IN_BLOCK; i++) {
+            state[i] = _mm512_xor_si512(
+                state[i], _mm512_loadu_si512((const __m512i *)ref_block->v + i));
+            block_XY[i] = _mm512_xor_si512(
+                state[i], _mm512_loadu_si512((const __m512i *)next_block->v + i));
         }
+    } else {
+        for (i = 0; i < ARGON2_512BIT_WORDS_IN_BLOCK; i++) {
+            block_XY[i] = state[i] = _mm512_xor_si512(
+                state[i], _mm512_loadu_si512((const __m512i *)ref_block->v + i));
+        }
+    }
 
-        /* 1.2.3 Computing the number of possible reference block within the
-         * lane.
-         */
-        position.index = i;
-        ref_index = index_alpha(instance, &position, pseudo_rand & 0xFFFFFFFF,
-                                ref_lane == position.lane);
-
-        /* 2 Creating a new block */
-        ref_block =
-            instance->memory + instance->lane_length * ref_lane + ref_index;
-        curr_block = instance->memory + curr_offset;
-        if (ARGON2_VERSION_10 == instance->version) {
-            /* version 1.2.1 and earlier: overwrite, not XOR */
-            fill_block(state, ref_block, curr_block, 0);
-        } else {
-            if(0 == position.pass) {
-                fill_block(state, ref_block, curr_block, 0);
-            } else {
-                fill_block(state, ref_block, curr_block, 1);
-            }
+    for (i = 0; i < 2; ++i) {
+        BLAKE2_ROUND_1_AVX512(
+            state[8 * i + 0], state[8 * i + 1], state[8 * i + 2], state[8 * i + 3],
+            state[8 * i + 4], state[8 * i + 5], state[8 * i + 6], state[8 * i + 7]);
+    }
+
+    for (i = 0; i < 2; ++i) {
+        BLAKE2_ROUND_2_AVX512(
+            state[2 * 0 + i], state[2 * 1 + i], state[2 * 2 + i], state[2 * 3 + i],
+            state[2 * 4 + i], state[2 * 5 + i], state[2 * 6 + i], state[2 * 7 + i]);
+    }
+
+    if (stream) {
+        /* In 16-byte quarters, as malloc() aligns no further */
+        for (i = 0; i < ARGON2_512BIT_WORDS_IN_BLOCK; i++) {
+            state[i] = _mm512_xor_si512(state[i], block_XY[i]);
+            _mm_stream_si128((__m128i *)next_block->v + 4 * i,
+                             _mm512_castsi512_si128(state[i]));
+            _mm_stream_si128((__m128i *)next_block->v + 4 * i + 1,
+                             _mm512_extracti32x4_epi32(state[i], 1));
+            _mm_stream_si128((__m128i *)next_block->v + 4 * i + 2,
+                             _mm512_extracti32x4_epi32(state[i], 2));
+            _mm_stream_si128((__m128i *)next_block->v + 4 * i + 3,
+                             _mm512_extracti32x4_epi32(state[i], 3));
+        }
+    } else {
+        for (i = 0; i < ARGON2_512BIT_WORDS_IN_BLOCK; i++) {
+            state[i] = _mm512_xor_si512(state[i], block_XY[i]);
+            _mm512_storeu_si512((__m512i *)next_block->v + i, state[i]);
         }
     }
 }
+
+static ARGON2_TARGET("avx512f") void
+next_addresses_avx512f(block *address_block, block *input_block) {
+    /*Temporary zero-initialized blocks*/
+    __m512i zero_block[ARGON2_512BIT_WORDS_IN_BLOCK];
+    __m512i zero2_block[ARGON2_512BIT_WORDS_IN_BLOCK];
+
+    memset(zero_block, 0, sizeof(zero_block));
+    memset(zero2_block, 0, sizeof(zero2_block));
+
+    /*Increasing index counter*/
+    input_block->v[6]++;
+
+    /*First iteration of G*/
+    fill_block_avx512f(zero_block, input_block, address_block, 0, 0);
+
+    /*Second iteration of G*/
+    fill_block_avx512f(zero2_block, address_block, address_block, 0, 0);
+}
+
+#define KERNEL_NAME avx512f
+#define KERNEL_TARGET ARGON2_TARGET("avx512f")
+#define KERNEL_STATE __m512i state[ARGON2_512BIT_WORDS_IN_BLOCK]
+#define KERNEL_LOAD_STATE(state, block)                                        \
+    memcpy((state), (block)->v, ARGON2_BLOCK_SIZE)
+#define KERNEL_FILL_BLOCK(state, ref_block, next_block, with_xor)              \
+    fill_block_avx512f((state), (ref_block), (next_block), (with_xor), 0)
+#define KERNEL_NEXT_ADDRESSES next_addresses_avx512f
+#define KERNEL_STREAM_BLOCK(state, ref_block, next_block)                      \
+    fill_block_avx512f((state), (ref_block), (next_block), 0, 1)
+#define KERNEL_STREAM_ALIGN 16
+#define KERNEL_STREAM_FENCE _mm_sfence
+#include "segment.h"
+
+/* The AVX-512 kernel borrows the AVX2 multi-buffer BLAKE2b and Base64 */
+#if defined(ARGON2_HAVE_AVX2)
+#define KERNEL_AVX512F_FEATURES (CPU_AVX512F | CPU_AVX2)
+#define KERNEL_AVX512F_HASH4 blake2b_hash4_avx2
+#define KERNEL_AVX512F_B64_ENCODE b64_encode_avx2
+#define KERNEL_AVX512F_B64_DECODE b64_decode_avx2
+#else
+#define KERNEL_AVX512F_FEATURES CPU_AVX512F
+#define KERNEL_AVX512F_HASH4 NULL
+#define KERNEL_AVX512F_B64_ENCODE NULL
+#define KERNEL_AVX512F_B64_DECODE NULL
+#endif
+
+static int avx512f_supported(void) {
+    return cpu_supports(KERNEL_AVX512F_FEATURES);
+}
+
+static const argon2_kernel_t kernel_avx512f = {"avx512f", avx512f_supported,
+                                               fill_segment_avx512f,
+                                               fill_segments_avx512f,
+                                               index_segment_avx512f,
+                                               KERNEL_AVX512F_HASH4,
+                                               KERNEL_AVX512F_B64_ENCODE,
+                                               KERNEL_AVX512F_B64_DECODE};
+#endif /* ARGON2_HAVE_AVX512F */
+
+const argon2_kernel_t *const argon2_kernels_x86[] = {
+#if defined(ARGON2_HAVE_AVX512F)
+    &kernel_avx512f,
+#endif
+#if defined(ARGON2_HAVE_AVX2)
+    &kernel_avx2,
+#endif
+    &kernel_sse,
+    NULL
+};
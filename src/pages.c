@@ -0,0 +1,157 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE /* MAP_ANONYMOUS, MAP_HUGETLB and madvise */
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "argon2.h"
+#include "pages.h"
+
+#define PAGES_2M ((size_t)1 << 21)
+#define PAGES_1G ((size_t)1 << 30)
+
+/* Rounds @size up to a multiple of @page, a power of two */
+static size_t round_up(size_t size, size_t page) {
+    return (size + page - 1) & ~(page - 1);
+}
+
+#if defined(_WIN32)
+
+/* Large pages need SeLockMemoryPrivilege; without it the first
+ * VirtualAlloc fails and the regular one is used */
+void *argon2_pages_alloc(size_t size, uint32_t *backing) {
+    size_t large = GetLargePageMinimum();
+    void *memory;
+
+    if (large != 0 && round_up(size, large) >= size) {
+        memory = VirtualAlloc(NULL, round_up(size, large),
+                              MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                              PAGE_READWRITE);
+        if (memory != NULL) {
+            *backing = ARGON2_BACKING_HUGE_2M;
+            return memory;
+        }
+    }
+
+    memory = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    *backing = ARGON2_BACKING_PAGES;
+    return memory;
+}
+
+void argon2_pages_free(void *memory, size_t size, uint32_t backing) {
+    (void)size;
+    (void)backing;
+    VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+#else
+
+#if !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#if defined(MAP_HUGETLB) && !defined(MAP_HUGE_1GB)
+#define MAP_HUGE_1GB (30 << 26) /* log2 of the page size << MAP_HUGE_SHIFT */
+#endif
+
+static void *map(size_t size, int flags) {
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return memory == MAP_FAILED ? NULL : memory;
+}
+
+/* Length of the mapping argon2_pages_alloc() made for @size and @backing */
+static size_t mapped_size(size_t size, uint32_t backing) {
+    switch (backing) {
+    case ARGON2_BACKING_HUGE_1G:
+        return round_up(size, PAGES_1G);
+    case ARGON2_BACKING_HUGE_2M:
+    case ARGON2_BACKING_THP:
+        return round_up(size, PAGES_2M);
+    default:
+        return size;
+    }
+}
+
+void *argon2_pages_alloc(size_t size, uint32_t *backing) {
+    void *memory;
+
+    if (round_up(size, PAGES_1G) < size) {
+        return NULL; /* overflow */
+    }
+
+#if defined(MAP_HUGETLB)
+    /* Explicit huge pages, only if the administrator reserved some. 1 GiB
+     * pages are not worth rounding small sizes up to. */
+    if (size >= PAGES_1G && size % PAGES_1G == 0) {
+        memory = map(size, MAP_HUGETLB | MAP_HUGE_1GB);
+        if (memory != NULL) {
+            *backing = ARGON2_BACKING_HUGE_1G;
+            return memory;
+        }
+    }
+    memory = map(round_up(size, PAGES_2M), MAP_HUGETLB);
+    if (memory != NULL) {
+        *backing = ARGON2_BACKING_HUGE_2M;
+        return memory;
+    }
+#endif
+
+#if defined(MADV_HUGEPAGE)
+    /* Transparent huge pages: map 2 MiB more than needed, keep a 2 MiB
+     * aligned window so that every part of it can be backed by huge pages,
+     * and unmap the rest. */
+    if (size >= PAGES_2M) {
+        size_t length = round_up(size, PAGES_2M);
+        uint8_t *base = (uint8_t *)map(length + PAGES_2M, 0);
+        if (base != NULL) {
+            uint8_t *aligned =
+                base + (PAGES_2M - (size_t)((uintptr_t)base % PAGES_2M)) %
+                           PAGES_2M;
+            if (aligned != base) {
+                munmap(base, (size_t)(aligned - base));
+            }
+            munmap(aligned + length, (size_t)(base + PAGES_2M - aligned));
+            if (madvise(aligned, length, MADV_HUGEPAGE) == 0) {
+                *backing = ARGON2_BACKING_THP;
+                return aligned;
+            }
+            munmap(aligned, length);
+        }
+    }
+#endif
+
+    memory = map(size, 0);
+    *backing = ARGON2_BACKING_PAGES;
+    return memory;
+}
+
+void argon2_pages_free(void *memory, size_t size, uint32_t backing) {
+    munmap(memory, mapped_size(size, backing));
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#ifndef ARGON2_PAGES_H
+#define ARGON2_PAGES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+        Page-level allocation of the block matrix, bypassing malloc. Large
+        pages cut the TLB misses of the random reference block accesses,
+        which dominate at gigabyte memory costs. Every mapping falls back
+        to the next best kind, so the only hard failure is running out of
+        address space.
+*/
+
+/* Maps @size bytes of zeroed memory, trying the backings from
+ * ARGON2_BACKING_HUGE_1G down to ARGON2_BACKING_PAGES
+ * @param size Number of bytes
+ * @param backing Receives the ARGON2_BACKING_* value obtained
+ * @return The mapping, or NULL if none of the backings could be mapped
+ */
+void *argon2_pages_alloc(size_t size, uint32_t *backing);
+
+/* Unmaps memory returned by argon2_pages_alloc() with the same @size and
+ * @backing */
+void argon2_pages_free(void *memory, size_t size, uint32_t backing);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#include <stdlib.h>
+
+#include "argon2.h"
+#include "pool.h"
+#include "thread.h"
+
+#if !defined(ARGON2_NO_THREADS)
+
+static argon2_mutex_t pool_mutex = ARGON2_MUTEX_INITIALIZER;
+static argon2_cond_t pool_cond = ARGON2_COND_INITIALIZER;
+static argon2_pool_task *pool_head = NULL; /* FIFO of waiting tasks */
+static argon2_pool_task *pool_tail = NULL;
+static argon2_thread_handle_t *pool_handles = NULL;
+static uint32_t pool_capacity = 0; /* slots in pool_handles */
+static uint32_t pool_workers = 0;  /* live worker threads */
+static uint32_t pool_busy = 0;     /* workers running a task */
+static uint32_t pool_queued = 0;   /* tasks waiting for a worker */
+static uint32_t pool_idle = 0;     /* busy workers whose task is waiting */
+static int pool_stopping = 0;
+
+#ifdef _WIN32
+static unsigned __stdcall pool_worker(void *unused)
+#else
+static void *pool_worker(void *unused)
+#endif
+{
+    argon2_pool_task *task;
+    (void)unused;
+
+    argon2_mutex_lock(&pool_mutex);
+    for (;;) {
+        while (pool_head == NULL && !pool_stopping) {
+            argon2_cond_wait(&pool_cond, &pool_mutex);
+        }
+        if (pool_head == NULL) {
+            break; /* shutting down and nothing left to do */
+        }
+
+        task = pool_head;
+        pool_head = task->next;
+        if (pool_head == NULL) {
+            pool_tail = NULL;
+        }
+        pool_queued--;
+        pool_busy++;
+        argon2_mutex_unlock(&pool_mutex);
+
+        /* The task may be freed by its submitter as soon as this returns */
+        task->func(task->arg);
+
+        argon2_mutex_lock(&pool_mutex);
+        pool_busy--;
+    }
+    argon2_mutex_unlock(&pool_mutex);
+    return 0;
+}
+
+/* Makes sure @count more tasks can each get a worker. Call with the pool
+ * mutex held. */
+static int pool_reserve(uint32_t count) {
+    while (pool_workers - pool_busy - pool_queued < count) {
+        if (pool_workers == pool_capacity) {
+            uint32_t capacity = pool_capacity ? 2 * pool_capacity : 8;
+            argon2_thread_handle_t *handles =
+                realloc(pool_handles, capacity * sizeof(*handles));
+            if (handles == NULL) {
+                return -1;
+            }
+            pool_handles = handles;
+            pool_capacity = capacity;
+        }
+        if (argon2_thread_create(&pool_handles[pool_workers], &pool_worker,
+                                 NULL)) {
+            return -1;
+        }
+        pool_workers++;
+    }
+    return 0;
+}
+
+int argon2_pool_submit(argon2_pool_task *tasks, uint32_t count) {
+    uint32_t i;
+
+    if (count == 0) {
+        return 0;
+    }
+    if (tasks == NULL) {
+        return -1;
+    }
+
+    argon2_mutex_lock(&pool_mutex);
+    if (pool_reserve(count)) {
+        argon2_mutex_unlock(&pool_mutex);
+        return -1;
+    }
+
+    for (i = 0; i < count; ++i) {
+        tasks[i].next = (i + 1 < count) ? &tasks[i + 1] : NULL;
+    }
+    if (pool_tail != NULL) {
+        pool_tail->next = &tasks[0];
+    } else {
+        pool_head = &tasks[0];
+    }
+    pool_tail = &tasks[count - 1];
+    pool_queued += count;
+
+    if (count == 1) {
+        argon2_cond_signal(&pool_cond);
+    } else {
+        argon2_cond_broadcast(&pool_cond);
+    }
+    argon2_mutex_unlock(&pool_mutex);
+    return 0;
+}
+
+uint32_t argon2_pool_auto_threads(uint32_t lanes) {
+    uint32_t cpus = argon2_cpu_count();
+    uint32_t taken;
+
+    argon2_mutex_lock(&pool_mutex);
+    taken = pool_busy + pool_queued - pool_idle;
+    argon2_mutex_unlock(&pool_mutex);
+
+    cpus = taken < cpus ? cpus - taken : 1;
+    return cpus < lanes ? cpus : lanes;
+}
+
+void argon2_pool_idle(int idle) {
+    argon2_mutex_lock(&pool_mutex);
+    if (idle) {
+        pool_idle++;
+    } else {
+        pool_idle--;
+    }
+    argon2_mutex_unlock(&pool_mutex);
+}
+
+void argon2_pool_shutdown(void) {
+    argon2_thread_handle_t *handles;
+    uint32_t workers, i;
+
+    argon2_mutex_lock(&pool_mutex);
+    pool_stopping = 1;
+    argon2_cond_broadcast(&pool_cond);
+    handles = pool_handles;
+    workers = pool_workers;
+    pool_handles = NULL;
+    pool_capacity = 0;
+    argon2_mutex_unlock(&pool_mutex);
+
+    for (i = 0; i < workers; ++i) {
+        argon2_thread_join(handles[i]);
+    }
+    free(handles);
+
+    argon2_mutex_lock(&pool_mutex);
+    pool_workers = 0;
+    pool_stopping = 0;
+    argon2_mutex_unlock(&pool_mutex);
+}
+
+#else /* ARGON2_NO_THREADS */
+
+void argon2_pool_shutdown(void) {}
+
+#endif /* ARGON2_NO_THREADS */
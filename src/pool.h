@@ -0,0 +1,64 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#ifndef ARGON2_POOL_H
+#define ARGON2_POOL_H
+
+#if !defined(ARGON2_NO_THREADS)
+
+#include <stdint.h>
+
+/*
+        A persistent, library-global pool of worker threads. Threads are
+        created on demand and then parked on a condition variable between
+        tasks, so that multi-threaded hashes no longer pay for thread
+        creation and joining at every slice. The pool only ever grows:
+        every submitted task is guaranteed a worker of its own, hence
+        tasks of one submission may safely wait for each other (e.g. on a
+        barrier).
+*/
+
+/* A unit of work for the pool. The memory is owned by the submitter and
+ * must stay valid until @func has returned. */
+typedef struct Argon2_pool_task {
+    void (*func)(void *arg);
+    void *arg;
+    struct Argon2_pool_task *next; /* queue link, managed by the pool */
+} argon2_pool_task;
+
+/* Hands tasks to the pool, creating workers as needed
+ * @param tasks Array of @count tasks with @func set
+ * @param count Number of tasks
+ * @return 0 if all tasks were queued, -1 if workers could not be created,
+ * in which case none of the tasks is run
+ */
+int argon2_pool_submit(argon2_pool_task *tasks, uint32_t count);
+
+/* Returns the threads a hash of @lanes lanes gets with ARGON2_THREADS_AUTO:
+ * the CPUs of the process that are not taken by busy or claimed workers,
+ * between 1 and @lanes; idle tasks do not count
+ */
+uint32_t argon2_pool_auto_threads(uint32_t lanes);
+
+/* Marks the task of the calling worker as waiting for work of its own
+ * (@idle nonzero), such as an async queue worker with nothing queued, or
+ * as running again (@idle zero). Calls must alternate, starting with 1.
+ */
+void argon2_pool_idle(int idle);
+
+#endif /* ARGON2_NO_THREADS */
+#endif
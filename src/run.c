@@ -22,9 +22,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "argon2.h"
 #include "core.h"
+#include "thread.h"
 
 #define T_COST_DEF 3
 #define LOG_M_COST_DEF 12 /* 2^12 = 4 MiB */
@@ -32,6 +38,10 @@
 #define THREADS_DEF 1
 #define OUTLEN_DEF 32
 #define MAX_PASS_LEN 128
+#define JOBS_DEF 1
+#define LOG_M_COST_CALIBRATE_DEF 16 /* 2^16 = 64 MiB */
+#define BULK_MAX_FIELD 4096 /* longest password or salt of a bulk record */
+#define BULK_WINDOW 4       /* bulk records in flight per job */
 
 #define UNUSED_PARAMETER(x) (void)(x)
 
@@ -41,6 +51,14 @@ static void usage(const char *cmd) {
            "[-l hash length] [-e|-r] [-v (10|13)]\n",
            cmd);
     printf("\tPassword is read from stdin\n");
+    printf("        %s -B [-f file] [-x] [-j jobs] [options above]\n", cmd);
+    printf("\tBulk mode: hashes the records of stdin or file, writing one "
+           "encoded hash per line in input order\n");
+    printf("        %s -C milliseconds [-i|-d|-id] [-m N | -k N] [-p N] "
+           "[-e]\n", cmd);
+    printf("\tCalibration: finds the most iterations and memory, up to -m or "
+           "-k (default 2^%d KiB), that hash in the given time on up to -p "
+           "threads (default all CPUs)\n", LOG_M_COST_CALIBRATE_DEF);
     printf("Parameters:\n");
     printf("\tsalt\t\tThe salt to use, at least 8 characters\n");
     printf("\t-i\t\tUse Argon2i (this is the default)\n");
@@ -56,10 +74,19 @@ static void usage(const char *cmd) {
            THREADS_DEF);
     printf("\t-l N\t\tSets hash output length to N bytes (default %d)\n",
            OUTLEN_DEF);
-    printf("\t-e\t\tOutput only encoded hash\n");
+    printf("\t-e\t\tOutput only encoded hash; with -C, only the options "
+           "for the parameters found\n");
     printf("\t-r\t\tOutput only the raw bytes of the hash\n");
     printf("\t-v (10|13)\tArgon2 version (defaults to the most recent version, currently %x)\n",
             ARGON2_VERSION_NUMBER);
+    printf("\t-B\t\tBulk mode; records are lines holding a password, a "
+           "tab and a salt\n");
+    printf("\t-f FILE\t\tReads the bulk records from FILE instead of "
+           "stdin\n");
+    printf("\t-x\t\tBulk records are a 32-bit big-endian length and the "
+           "password, then the same for the salt\n");
+    printf("\t-j N\t\tRuns N bulk hashes at the same time (default %d)\n",
+           JOBS_DEF);
     printf("\t-h\t\tPrint %s usage\n", cmd);
 }
 
@@ -68,6 +95,41 @@ static void fatal(const char *error) {
     exit(1);
 }
 
+/* CPUs the process may use, within its affinity mask and cgroup quota */
+static uint32_t cpu_count(void) {
+#if defined(ARGON2_NO_THREADS)
+    return 1;
+#else
+    return argon2_cpu_count();
+#endif
+}
+
+/* Prints the parameters argon2_calibrate() finds, or only the options
+ * selecting them if @options_only
+ * @return 0 on success, 1 on error */
+static int calibrate(uint32_t target_ms, uint32_t m_cost, uint32_t threads,
+                     argon2_type type, int options_only) {
+    argon2_calibration params;
+    int ret = argon2_calibrate(type, target_ms, m_cost, threads, &params);
+
+    if (ret != ARGON2_OK) {
+        fprintf(stderr, "Error: %s\n", argon2_error_message(ret));
+        return 1;
+    }
+    if (options_only) {
+        printf("-%s -t %u -k %u -p %u\n",
+               type == Argon2_id ? "id" : type == Argon2_d ? "d" : "i",
+               params.t_cost, params.m_cost, params.lanes);
+    } else {
+        printf("Type:\t\t%s\n", argon2_type2string(type, 1));
+        printf("Iterations:\t%u\n", params.t_cost);
+        printf("Memory:\t\t%u KiB\n", params.m_cost);
+        printf("Parallelism:\t%u\n", params.lanes);
+        printf("%.3f seconds\n", (double)params.latency_ns * 1e-9);
+    }
+    return 0;
+}
+
 static void print_hex(uint8_t *bytes, size_t bytes_len) {
     size_t i;
     for (i = 0; i < bytes_len; ++i) {
@@ -76,6 +138,20 @@ static void print_hex(uint8_t *bytes, size_t bytes_len) {
     printf("\n");
 }
 
+/* Wall-clock time in seconds from an arbitrary origin */
+static double now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
 /*
 Runs Argon2 with certain inputs and parameters, inputs not cleared. Prints the
 Base64-encoded hash string
@@ -94,13 +170,13 @@ Base64-encoded hash string
 static void run(uint32_t outlen, char *pwd, size_t pwdlen, char *salt, uint32_t t_cost,
                 uint32_t m_cost, uint32_t lanes, uint32_t threads,
                 argon2_type type, int encoded_only, int raw_only, uint32_t version) {
-    clock_t start_time, stop_time;
+    double start_time, stop_time;
     size_t saltlen, encodedlen;
     int result;
     unsigned char * out = NULL;
     char * encoded = NULL;
 
-    start_time = clock();
+    start_time = now();
 
     if (!pwd) {
         fatal("password missing");
@@ -137,7 +213,7 @@ static void run(uint32_t outlen, char *pwd, size_t pwdlen, char *salt, uint32_t
     if (result != ARGON2_OK)
         fatal(argon2_error_message(result));
 
-    stop_time = clock();
+    stop_time = now();
 
     if (encoded_only)
         puts(encoded);
@@ -157,8 +233,7 @@ static void run(uint32_t outlen, char *pwd, size_t pwdlen, char *salt, uint32_t
 
     printf("Encoded:\t%s\n", encoded);
 
-    printf("%2.3f seconds\n",
-           ((double)stop_time - start_time) / (CLOCKS_PER_SEC));
+    printf("%2.3f seconds\n", stop_time - start_time);
 
     result = argon2_verify(encoded, pwd, pwdlen, type);
     if (result != ARGON2_OK)
@@ -167,6 +242,252 @@ static void run(uint32_t outlen, char *pwd, size_t pwdlen, char *salt, uint32_t
     free(encoded);
 }
 
+/* Input of the bulk mode, read through its own buffer */
+typedef struct bulk_reader {
+    FILE *file;
+    size_t pos, len;
+    unsigned char buf[1 << 16];
+} bulk_reader;
+
+/* One record of the bulk mode and the hash computed from it */
+typedef struct bulk_record {
+    argon2_context ctx;
+    unsigned long number; /* position in the input, from 1 */
+    const char *error;    /* why the record could not be hashed, or NULL */
+    int result;
+    int done;
+    uint8_t pwd[BULK_MAX_FIELD];
+    uint8_t salt[BULK_MAX_FIELD];
+} bulk_record;
+
+static int reader_byte(bulk_reader *reader) {
+    if (reader->pos == reader->len) {
+        reader->len = fread(reader->buf, 1, sizeof(reader->buf), reader->file);
+        reader->pos = 0;
+        if (reader->len == 0) {
+            return EOF;
+        }
+    }
+    return reader->buf[reader->pos++];
+}
+
+/* Reads a 32-bit big-endian length and that many bytes into @dst */
+static int read_field(bulk_reader *reader, uint8_t *dst, uint32_t *len) {
+    uint32_t n = 0, i;
+    int c = 0;
+
+    for (i = 0; i < 4 && (c = reader_byte(reader)) != EOF; ++i) {
+        n = (n << 8) | (uint32_t)c;
+    }
+    if (c == EOF) {
+        return i == 0 ? 0 : -1;
+    }
+    if (n > BULK_MAX_FIELD) {
+        fatal("bulk record field too long");
+    }
+    for (i = 0; i < n; ++i) {
+        if ((c = reader_byte(reader)) == EOF) {
+            return -1;
+        }
+        dst[i] = (uint8_t)c;
+    }
+    *len = n;
+    return 1;
+}
+
+/*
+Reads the next bulk record into @record: a line holding the password, a tab
+and the salt, the last tab of the line separating the two, or with @binary
+the length-prefixed password and salt. Malformed lines set record->error.
+@return 0 at the end of the input, 1 otherwise
+*/
+static int read_record(bulk_reader *reader, bulk_record *record, int binary) {
+    uint8_t *line = record->pwd;
+    size_t len = 0, tab = 0;
+    int c, has_tab = 0;
+
+    record->error = NULL;
+    if (binary) {
+        int ret = read_field(reader, record->pwd, &record->ctx.pwdlen);
+        if (ret == 0) {
+            return 0;
+        }
+        if (ret < 0 ||
+            read_field(reader, record->salt, &record->ctx.saltlen) <= 0) {
+            fatal("truncated bulk record");
+        }
+        return 1;
+    }
+
+    /* The line is read in place of the password, the salt moved out next */
+    while ((c = reader_byte(reader)) != EOF && c != '\n') {
+        if (len == BULK_MAX_FIELD) {
+            record->error = "line too long";
+            continue;
+        }
+        if (c == '\t') {
+            has_tab = 1;
+            tab = len;
+        }
+        line[len++] = (uint8_t)c;
+    }
+    if (c == EOF && len == 0 && record->error == NULL) {
+        return 0;
+    }
+    if (len > 0 && line[len - 1] == '\r') {
+        --len;
+    }
+    if (record->error == NULL && !has_tab) {
+        record->error = "no tab between password and salt";
+    }
+    if (record->error != NULL) {
+        return 1;
+    }
+    record->ctx.pwdlen = (uint32_t)tab;
+    record->ctx.saltlen = (uint32_t)(len - tab - 1);
+    memcpy(record->salt, line + tab + 1, record->ctx.saltlen);
+    return 1;
+}
+
+static void bulk_done(argon2_context *context, int result, void *user) {
+    bulk_record *record = (bulk_record *)user;
+    UNUSED_PARAMETER(context);
+    record->result = result;
+    record->done = 1;
+}
+
+/* Prints the hash of @record, or an empty line and an error on stderr
+@return 1 if the record failed, 0 otherwise */
+static int write_record(bulk_record *record, argon2_type type, int raw_only,
+                        char *encoded, size_t encodedlen) {
+    const char *error = record->error;
+    int result = record->result;
+
+    if (error == NULL && result == ARGON2_OK && !raw_only) {
+        result = argon2_encode_batch(encoded, encodedlen, &record->ctx, 1,
+                                     type, NULL);
+    }
+    if (error == NULL && result != ARGON2_OK) {
+        error = argon2_error_message(result);
+    }
+
+    if (error != NULL) {
+        fprintf(stderr, "Error: record %lu: %s\n", record->number, error);
+        putchar('\n');
+    } else if (raw_only) {
+        print_hex(record->ctx.out, record->ctx.outlen);
+    } else {
+        puts(encoded);
+    }
+
+    clear_internal_memory(record->pwd, sizeof(record->pwd));
+    clear_internal_memory(record->ctx.out, record->ctx.outlen);
+    return error != NULL;
+}
+
+/*
+Bulk mode: hashes every record of @path, or of stdin if NULL, and prints the
+hashes in input order. Up to @jobs hashes run at the same time on the
+library's worker threads and BULK_WINDOW records per job are kept in flight,
+so that reading and writing overlap with hashing.
+@return Number of records that failed
+*/
+static unsigned long bulk(const char *path, int binary, uint32_t jobs,
+                          uint32_t outlen, uint32_t t_cost, uint32_t m_cost,
+                          uint32_t lanes, uint32_t threads, argon2_type type,
+                          int raw_only, uint32_t version) {
+    static bulk_reader reader;
+    bulk_record *records;
+    uint8_t *outs;
+    argon2_async *async = NULL;
+    char *encoded;
+    size_t encodedlen;
+    uint32_t window = jobs * BULK_WINDOW, head = 0, pending = 0, i;
+    unsigned long number = 0, failed = 0;
+    int eof = 0;
+
+    reader.file = path == NULL ? stdin : fopen(path, "rb");
+    if (reader.file == NULL) {
+        fatal("could not open the bulk input");
+    }
+    records = calloc(window, sizeof(bulk_record));
+    outs = malloc((size_t)window * outlen);
+    encodedlen = argon2_encodedlen(t_cost, m_cost, lanes, BULK_MAX_FIELD,
+                                   outlen, type);
+    encoded = malloc(encodedlen);
+    if (records == NULL || outs == NULL || encoded == NULL) {
+        fatal("could not allocate memory for the bulk records");
+    }
+    /* Without threads in the library, records are hashed as they are read */
+    async = argon2_async_create(jobs, window);
+    if (async == NULL && jobs > 1) {
+        fatal("could not start the bulk jobs");
+    }
+
+    for (i = 0; i < window; ++i) {
+        argon2_context *ctx = &records[i].ctx;
+        ctx->out = outs + (size_t)i * outlen;
+        ctx->outlen = outlen;
+        ctx->pwd = records[i].pwd;
+        ctx->salt = records[i].salt;
+        ctx->t_cost = t_cost;
+        ctx->m_cost = m_cost;
+        ctx->lanes = lanes;
+        ctx->threads = threads;
+        ctx->version = version;
+        ctx->flags = ARGON2_DEFAULT_FLAGS;
+    }
+
+    while (!eof || pending > 0) {
+        while (!eof && pending < window) {
+            bulk_record *record = &records[(head + pending) % window];
+            if (!read_record(&reader, record, binary)) {
+                eof = 1;
+                break;
+            }
+            record->number = ++number;
+            record->result = ARGON2_OK;
+            record->done = 0;
+            ++pending;
+            if (record->error != NULL) {
+                record->done = 1;
+            } else if (async == NULL) {
+                bulk_done(&record->ctx, argon2_ctx(&record->ctx, type),
+                          record);
+            } else {
+                int ret = argon2_async_submit(async, &record->ctx, type,
+                                              bulk_done, record, NULL);
+                if (ret != ARGON2_OK) {
+                    bulk_done(&record->ctx, ret, record);
+                }
+            }
+        }
+
+        /* Hashes are printed in input order, as soon as they are known */
+        while (pending > 0 && records[head].done) {
+            failed += write_record(&records[head], type, raw_only, encoded,
+                                   encodedlen);
+            head = (head + 1) % window;
+            --pending;
+        }
+        if (pending > 0 && (eof || pending == window)) {
+            fflush(stdout);
+            argon2_async_poll(async, 1);
+        }
+    }
+
+    argon2_async_destroy(async);
+    fflush(stdout);
+    if (path != NULL) {
+        fclose(reader.file);
+    }
+    clear_internal_memory(records, (size_t)window * sizeof(bulk_record));
+    free(records);
+    free(outs);
+    free(encoded);
+    return failed;
+}
+
 int main(int argc, char *argv[]) {
     uint32_t outlen = OUTLEN_DEF;
     uint32_t m_cost = 1 << LOG_M_COST_DEF;
@@ -176,11 +497,16 @@ int main(int argc, char *argv[]) {
     argon2_type type = Argon2_i; /* Argon2i is the default type */
     int types_specified = 0;
     int m_cost_specified = 0;
+    int threads_specified = 0;
     int encoded_only = 0;
     int raw_only = 0;
     uint32_t version = ARGON2_VERSION_NUMBER;
+    uint32_t jobs = JOBS_DEF;
+    int bulk_mode, calibrate_mode, binary = 0;
+    uint32_t target_ms = 0;
+    const char *input_path = NULL;
     int i;
-    size_t pwdlen;
+    size_t pwdlen = 0;
     char pwd[MAX_PASS_LEN], *salt;
 
     if (argc < 2) {
@@ -191,19 +517,34 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    /* get password from stdin */
-    pwdlen = fread(pwd, 1, sizeof pwd, stdin);
-    if(pwdlen < 1) {
-        fatal("no password read");
+    /* in bulk mode, passwords and salts come from the records */
+    bulk_mode = !strcmp(argv[1], "-B");
+    /* in calibration mode, the first argument is the target time */
+    calibrate_mode = !strcmp(argv[1], "-C");
+    if (calibrate_mode) {
+        unsigned long input = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+        if (input == 0 || input > UINT32_C(0xFFFFFFFF) / 1000) {
+            fatal("bad numeric input for -C");
+        }
+        target_ms = (uint32_t)input;
+        m_cost = 1 << LOG_M_COST_CALIBRATE_DEF;
     }
-    if(pwdlen == MAX_PASS_LEN) {
-        fatal("Provided password longer than supported in command line utility");
+
+    /* get password from stdin */
+    if (!bulk_mode && !calibrate_mode) {
+        pwdlen = fread(pwd, 1, sizeof pwd, stdin);
+        if(pwdlen < 1) {
+            fatal("no password read");
+        }
+        if(pwdlen == MAX_PASS_LEN) {
+            fatal("Provided password longer than supported in command line utility");
+        }
     }
 
-    salt = argv[1];
+    salt = bulk_mode || calibrate_mode ? NULL : argv[1];
 
     /* parse options */
-    for (i = 2; i < argc; i++) {
+    for (i = calibrate_mode ? 3 : 2; i < argc; i++) {
         const char *a = argv[i];
         unsigned long input = 0;
         if (!strcmp(a, "-h")) {
@@ -248,7 +589,7 @@ int main(int argc, char *argv[]) {
             } else {
                 fatal("missing -k argument");
             }
-        } else if (!strcmp(a, "-t")) {
+        } else if (!strcmp(a, "-t") && !calibrate_mode) {
             if (i < argc - 1) {
                 i++;
                 input = strtoul(argv[i], NULL, 10);
@@ -271,11 +612,12 @@ int main(int argc, char *argv[]) {
                 }
                 threads = input;
                 lanes = threads;
+                threads_specified = 1;
                 continue;
             } else {
                 fatal("missing -p argument");
             }
-        } else if (!strcmp(a, "-l")) {
+        } else if (!strcmp(a, "-l") && !calibrate_mode) {
             if (i < argc - 1) {
                 i++;
                 input = strtoul(argv[i], NULL, 10);
@@ -293,11 +635,33 @@ int main(int argc, char *argv[]) {
         } else if (!strcmp(a, "-id")) {
             type = Argon2_id;
             ++types_specified;
+        } else if (!strcmp(a, "-j") && bulk_mode) {
+            if (i < argc - 1) {
+                i++;
+                input = strtoul(argv[i], NULL, 10);
+                if (input == 0 || input == ULONG_MAX ||
+                    input > ARGON2_MAX_THREADS) {
+                    fatal("bad numeric input for -j");
+                }
+                jobs = input;
+                continue;
+            } else {
+                fatal("missing -j argument");
+            }
+        } else if (!strcmp(a, "-f") && bulk_mode) {
+            if (i < argc - 1) {
+                input_path = argv[++i];
+                continue;
+            } else {
+                fatal("missing -f argument");
+            }
+        } else if (!strcmp(a, "-x") && bulk_mode) {
+            binary = 1;
         } else if (!strcmp(a, "-e")) {
             encoded_only = 1;
-        } else if (!strcmp(a, "-r")) {
+        } else if (!strcmp(a, "-r") && !calibrate_mode) {
             raw_only = 1;
-        } else if (!strcmp(a, "-v")) {
+        } else if (!strcmp(a, "-v") && !calibrate_mode) {
             if (i < argc - 1) {
                 i++;
                 if (!strcmp(argv[i], "10")) {
@@ -322,6 +686,17 @@ int main(int argc, char *argv[]) {
     if(encoded_only && raw_only)
         fatal("cannot provide both -e and -r");
 
+    if (calibrate_mode) {
+        return calibrate(target_ms, m_cost,
+                         threads_specified ? threads : cpu_count(), type,
+                         encoded_only);
+    }
+
+    if (bulk_mode) {
+        return bulk(input_path, binary, jobs, outlen, t_cost, m_cost, lanes,
+                    threads, type, raw_only, version) == 0 ? ARGON2_OK : 1;
+    }
+
     if(!encoded_only && !raw_only) {
         printf("Type:\t\t%s\n", argon2_type2string(type, 1));
         printf("Iterations:\t%u\n", t_cost);
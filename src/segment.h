@@ -0,0 +1,545 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+/*
+ * Template for the segment filling loop, shared by the fill kernels in ref.c
+ * and opt.c. There is deliberately no include guard: define the parameters
+ * below, then include this file once per kernel. They are #undef'd at the
+ * end.
+ *
+ * KERNEL_NAME           Suffix for the generated names, e.g. fill_segment_ref
+ * KERNEL_TARGET         Function attribute enabling the kernel's instruction
+ *                       set, may be empty
+ * KERNEL_STATE          Declaration of a member called state, carrying the
+ *                       previous block from one call of fill_block to the next
+ * KERNEL_LOAD_STATE(state, block)
+ *                       Loads the block preceding the segment into state
+ * KERNEL_FILL_BLOCK(state, ref_block, next_block, with_xor)
+ *                       Computes next_block and leaves it in state
+ * KERNEL_NEXT_ADDRESSES(address_block, input_block)
+ *                       Generates the next block of Argon2i addresses
+ *
+ * and optionally, for instances with stream_stores set:
+ *
+ * KERNEL_STREAM_BLOCK(state, ref_block, next_block)
+ *                       As KERNEL_FILL_BLOCK without XOR, but writes
+ *                       next_block with non-temporal stores; state must
+ *                       hold the block in memory order
+ * KERNEL_STREAM_ALIGN   Alignment the memory needs for those stores
+ * KERNEL_STREAM_FENCE() Orders the stores before the segment is done
+ *
+ * Whether a segment uses data-independent addressing and whether it XORs
+ * into the old blocks are fixed for the whole segment, so the step is
+ * generated once for each of the four combinations; the other pass, slice
+ * and version dependent terms are computed when the segment begins. Kernels
+ * with KERNEL_STREAM_BLOCK get a streaming variant of the first pass steps:
+ * its blocks are mostly referenced long after they are written, so they
+ * skip the read for ownership and do not evict the blocks being referenced.
+ * Data-dependent addressing then takes the pseudo-random value from the
+ * state instead of reading back the block just streamed out.
+ *
+ * The generated fill_segment_<name>() fills one segment. fill_segments_<name>()
+ * fills up to ARGON2_MAX_INTERLEAVE independent segments, one block of each
+ * in turn: a segment's next reference block is picked and prefetched as soon
+ * as its current block is done, so the fetch overlaps the other segments'
+ * BLAKE2 rounds. With data-independent addressing the reference blocks are
+ * known in advance and are prefetched ARGON2_PREFETCH_DISTANCE blocks ahead;
+ * index_segment_<name>() writes them out for an argon2_index_cache, and the
+ * segments that have one read them back instead of generating addresses.
+ */
+
+#ifndef ARGON2_SEGMENT_H_ONCE
+#define ARGON2_SEGMENT_H_ONCE
+
+#include "blake2/blake2-impl.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SEGMENT_PREFETCH(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#define SEGMENT_PREFETCH(p) _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#else
+#define SEGMENT_PREFETCH(p) ((void)(p))
+#endif
+
+#define SEGMENT_CAT_(a, b) a##_##b
+#define SEGMENT_CAT(a, b) SEGMENT_CAT_(a, b)
+
+/* Starts pulling all cache lines of @b into the cache */
+static BLAKE2_INLINE void prefetch_block(const block *b) {
+    unsigned i;
+    for (i = 0; i < ARGON2_BLOCK_SIZE; i += 64) {
+        SEGMENT_PREFETCH((const unsigned char *)b->v + i);
+    }
+}
+
+#endif /* ARGON2_SEGMENT_H_ONCE */
+
+#define SEGMENT_CURSOR SEGMENT_CAT(segment_cursor, KERNEL_NAME)
+#define SEGMENT_SETUP SEGMENT_CAT(segment_setup, KERNEL_NAME)
+#define SEGMENT_BEGIN SEGMENT_CAT(segment_begin, KERNEL_NAME)
+#define SEGMENT_LOOKUP SEGMENT_CAT(segment_lookup, KERNEL_NAME)
+#define SEGMENT_REF SEGMENT_CAT(segment_ref, KERNEL_NAME)
+#define SEGMENT_STEP SEGMENT_CAT(segment_step, KERNEL_NAME)
+#define SEGMENT_VARIANT(name) SEGMENT_CAT(SEGMENT_CAT(segment, name), KERNEL_NAME)
+
+/*
+ * Where a kernel is in filling one segment. Everything in index_alpha() that
+ * depends on the pass, the slice and the version is settled once per segment
+ * by SEGMENT_BEGIN, which also picks a step function for the segment's kind
+ * of addressing and fill.
+ */
+typedef struct SEGMENT_CAT(Segment_cursor, KERNEL_NAME) {
+    const argon2_instance_t *instance;
+    argon2_position_t position; /* index is the next block to fill */
+    uint32_t prev_offset, curr_offset;
+    uint32_t ref_lanes;   /* lanes that may be referenced, 1 in the first slice */
+    uint32_t ref_lane0;   /* lane referenced when ref_lanes is 1, else 0 */
+    uint32_t area_base;   /* finished blocks in the reference area of a lane */
+    uint32_t area_start;  /* first block of the reference area of a lane */
+    int data_independent_addressing;
+    int stream; /* writes with KERNEL_STREAM_BLOCK */
+    const uint32_t *ref_offsets; /* from the index cache, or NULL */
+    void (*step)(struct SEGMENT_CAT(Segment_cursor, KERNEL_NAME) *cursor);
+    block *ref_block; /* reference block for position.index */
+    block address_block, input_block;
+    KERNEL_STATE;
+} SEGMENT_CURSOR;
+
+/* Offset of the reference block for the block at @index, from its
+ * pseudo-random value; the arithmetic of index_alpha() with the per-segment
+ * terms precomputed */
+static BLAKE2_INLINE KERNEL_TARGET size_t
+SEGMENT_LOOKUP(const SEGMENT_CURSOR *cursor, uint32_t index,
+               uint64_t pseudo_rand) {
+    const argon2_instance_t *instance = cursor->instance;
+    uint32_t ref_lane, reference_area_size;
+    uint64_t relative_position, absolute_position;
+
+    /* 1.2.2 Computing the lane of the reference block */
+    ref_lane = cursor->ref_lane0 +
+               (uint32_t)((pseudo_rand >> 32) % cursor->ref_lanes);
+
+    /* 1.2.3 Computing the number of possible reference block within the
+     * lane: the lane being filled adds the blocks of this segment but the
+     * previous one, the others lose their last block while this segment
+     * is at its first */
+    reference_area_size = cursor->area_base;
+    if (ref_lane == cursor->position.lane) {
+        reference_area_size += index - 1;
+    } else {
+        reference_area_size -= (index == 0);
+    }
+
+    /* 1.2.4. Mapping pseudo_rand to 0..<reference_area_size-1> and produce
+     * relative position */
+    relative_position = pseudo_rand & 0xFFFFFFFF;
+    relative_position = relative_position * relative_position >> 32;
+    relative_position = reference_area_size - 1 -
+                        (reference_area_size * relative_position >> 32);
+
+    /* 1.2.5 / 1.2.6 Absolute position, wrapping around the lane once at
+     * most */
+    absolute_position = cursor->area_start + relative_position;
+    if (absolute_position >= instance->lane_length) {
+        absolute_position -= instance->lane_length;
+    }
+
+    return (size_t)instance->lane_length * ref_lane +
+           (size_t)absolute_position;
+}
+
+/* Picks the reference block for cursor->position.index and prefetches it;
+ * @independent is a constant at every call: 0 for data-dependent
+ * addressing, 1 for data-independent, 2 for offsets from the index cache;
+ * so is @stream */
+static BLAKE2_INLINE KERNEL_TARGET void
+SEGMENT_REF(SEGMENT_CURSOR *cursor, int independent, int stream) {
+    const argon2_instance_t *instance = cursor->instance;
+    uint64_t pseudo_rand;
+    uint32_t i = cursor->position.index;
+
+    if (independent == 2) {
+        /* No address block bounds how far ahead the offsets are known */
+        if (i + ARGON2_PREFETCH_DISTANCE < instance->segment_length) {
+            prefetch_block(instance->memory +
+                           cursor->ref_offsets[i + ARGON2_PREFETCH_DISTANCE]);
+        }
+        cursor->ref_block = instance->memory + cursor->ref_offsets[i];
+        prefetch_block(cursor->ref_block);
+        return;
+    }
+
+    /* 1.2 Computing the index of the reference block */
+    /* 1.2.1 Taking pseudo-random value from the previous block */
+    if (independent) {
+        uint32_t ahead;
+
+        if (i % ARGON2_ADDRESSES_IN_BLOCK == 0) {
+            KERNEL_NEXT_ADDRESSES(&cursor->address_block,
+                                  &cursor->input_block);
+        }
+        pseudo_rand = cursor->address_block.v[i % ARGON2_ADDRESSES_IN_BLOCK];
+
+        /* The rest of the address block is known too, so start fetching the
+         * reference block needed a few blocks from now */
+        ahead = i + ARGON2_PREFETCH_DISTANCE;
+        if (ahead < instance->segment_length &&
+            i % ARGON2_ADDRESSES_IN_BLOCK + ARGON2_PREFETCH_DISTANCE <
+                ARGON2_ADDRESSES_IN_BLOCK) {
+            prefetch_block(
+                instance->memory +
+                SEGMENT_LOOKUP(cursor, ahead,
+                               cursor->address_block
+                                   .v[ahead % ARGON2_ADDRESSES_IN_BLOCK]));
+        }
+    } else if (stream) {
+        /* The previous block went around the caches, but is also the state */
+        pseudo_rand = load64(&cursor->state);
+    } else {
+        /* Fetched as soon as the previous block is done, see SEGMENT_STEP */
+        pseudo_rand = instance->memory[cursor->prev_offset].v[0];
+    }
+
+    cursor->ref_block =
+        instance->memory + SEGMENT_LOOKUP(cursor, i, pseudo_rand);
+    prefetch_block(cursor->ref_block);
+}
+
+/* Fills the block at cursor->position.index and moves to the next one;
+ * @independent, @with_xor and @stream are constants at every call, and
+ * @stream is only set without @with_xor */
+static BLAKE2_INLINE KERNEL_TARGET void
+SEGMENT_STEP(SEGMENT_CURSOR *cursor, int independent, int with_xor,
+             int stream) {
+    const argon2_instance_t *instance = cursor->instance;
+    block *curr_block = instance->memory + cursor->curr_offset;
+
+    /* 2 Creating a new block: version 1.2.1 and earlier, and the first
+     * pass, overwrite instead of XOR */
+#if defined(KERNEL_STREAM_BLOCK)
+    if (stream) {
+        KERNEL_STREAM_BLOCK(cursor->state, cursor->ref_block, curr_block);
+    } else
+#endif
+    {
+        KERNEL_FILL_BLOCK(cursor->state, cursor->ref_block, curr_block,
+                          with_xor);
+    }
+
+    /* Only the first block of a lane has its predecessor elsewhere */
+    ++cursor->position.index;
+    cursor->prev_offset = cursor->curr_offset++;
+    if (cursor->position.index < instance->segment_length) {
+        SEGMENT_REF(cursor, independent, stream);
+    }
+}
+
+/* The step functions for each kind of segment */
+static KERNEL_TARGET void SEGMENT_VARIANT(step_dependent)(
+    SEGMENT_CURSOR *cursor) {
+    SEGMENT_STEP(cursor, 0, 0, 0);
+}
+
+static KERNEL_TARGET void SEGMENT_VARIANT(step_dependent_xor)(
+    SEGMENT_CURSOR *cursor) {
+    SEGMENT_STEP(cursor, 0, 1, 0);
+}
+
+static KERNEL_TARGET void SEGMENT_VARIANT(step_independent)(
+    SEGMENT_CURSOR *cursor) {
+    SEGMENT_STEP(cursor, 1, 0, 0);
+}
+
+static KERNEL_TARGET void SEGMENT_VARIANT(step_independent_xor)(
+    SEGMENT_CURSOR *cursor) {
+    SEGMENT_STEP(cursor, 1, 1, 0);
+}
+
+static KERNEL_TARGET void SEGMENT_VARIANT(step_cached)(
+    SEGMENT_CURSOR *cursor) {
+    SEGMENT_STEP(cursor, 2, 0, 0);
+}
+
+static KERNEL_TARGET void SEGMENT_VARIANT(step_cached_xor)(
+    SEGMENT_CURSOR *cursor) {
+    SEGMENT_STEP(cursor, 2, 1, 0);
+}
+
+#if defined(KERNEL_STREAM_BLOCK)
+static KERNEL_TARGET void SEGMENT_VARIANT(step_dependent_stream)(
+    SEGMENT_CURSOR *cursor) {
+    SEGMENT_STEP(cursor, 0, 0, 1);
+}
+
+static KERNEL_TARGET void SEGMENT_VARIANT(step_independent_stream)(
+    SEGMENT_CURSOR *cursor) {
+    SEGMENT_STEP(cursor, 1, 0, 1);
+}
+
+static KERNEL_TARGET void SEGMENT_VARIANT(step_cached_stream)(
+    SEGMENT_CURSOR *cursor) {
+    SEGMENT_STEP(cursor, 2, 0, 1);
+}
+#endif
+
+/* Settles the addressing and the reference area of the segment at
+ * @position, and prepares its first block of addresses if it generates
+ * them; returns the index of the first block to fill */
+static KERNEL_TARGET uint32_t SEGMENT_SETUP(SEGMENT_CURSOR *cursor,
+                                            const argon2_instance_t *instance,
+                                            argon2_position_t position) {
+    const argon2_index_cache *cache = instance->index_cache;
+    uint32_t starting_index;
+
+    cursor->instance = instance;
+    cursor->position = position;
+    cursor->data_independent_addressing =
+        (instance->type == Argon2_i) ||
+        (instance->type == Argon2_id && (position.pass == 0) &&
+         (position.slice < ARGON2_SYNC_POINTS / 2));
+    cursor->ref_offsets = NULL;
+    if (cursor->data_independent_addressing && cache != NULL) {
+        cursor->ref_offsets =
+            cache->offsets +
+            ((size_t)(position.pass * ARGON2_SYNC_POINTS + position.slice) *
+                 instance->lanes +
+             position.lane) *
+                instance->segment_length;
+    }
+
+    /*
+     * Reference area, see index_alpha(). Pass 0 references the finished
+     * segments, and only those of its own lane in the first slice; later
+     * passes the (SYNC_POINTS - 1) last segments, starting after this one.
+     */
+    if (0 == position.pass) {
+        cursor->ref_lanes = position.slice == 0 ? 1 : instance->lanes;
+        cursor->ref_lane0 = position.slice == 0 ? position.lane : 0;
+        cursor->area_base = position.slice * instance->segment_length;
+        cursor->area_start = 0;
+    } else {
+        cursor->ref_lanes = instance->lanes;
+        cursor->ref_lane0 = 0;
+        cursor->area_base = instance->lane_length - instance->segment_length;
+        cursor->area_start = (position.slice == ARGON2_SYNC_POINTS - 1)
+                                 ? 0
+                                 : (position.slice + 1) *
+                                       instance->segment_length;
+    }
+
+    if (cursor->data_independent_addressing && cursor->ref_offsets == NULL) {
+        init_block_value(&cursor->input_block, 0);
+
+        cursor->input_block.v[0] = position.pass;
+        cursor->input_block.v[1] = position.lane;
+        cursor->input_block.v[2] = position.slice;
+        cursor->input_block.v[3] = instance->memory_blocks;
+        cursor->input_block.v[4] = instance->passes;
+        cursor->input_block.v[5] = instance->type;
+    }
+
+    starting_index = 0;
+
+    if ((0 == position.pass) && (0 == position.slice)) {
+        starting_index = 2; /* we have already generated the first two blocks */
+
+        /* Don't forget to generate the first block of addresses: */
+        if (cursor->data_independent_addressing &&
+            cursor->ref_offsets == NULL) {
+            KERNEL_NEXT_ADDRESSES(&cursor->address_block,
+                                  &cursor->input_block);
+        }
+    }
+    return starting_index;
+}
+
+static KERNEL_TARGET void SEGMENT_BEGIN(SEGMENT_CURSOR *cursor,
+                                        const argon2_instance_t *instance,
+                                        argon2_position_t position) {
+    uint32_t starting_index = SEGMENT_SETUP(cursor, instance, position);
+    int with_xor =
+        ARGON2_VERSION_10 != instance->version && position.pass != 0;
+
+    cursor->stream = 0;
+#if defined(KERNEL_STREAM_BLOCK)
+    /* Later passes read every block back soon after writing it */
+    if (instance->stream_stores && position.pass == 0 &&
+        (uintptr_t)instance->memory % KERNEL_STREAM_ALIGN == 0) {
+        cursor->stream = 1;
+        if (cursor->ref_offsets != NULL) {
+            cursor->step = SEGMENT_VARIANT(step_cached_stream);
+        } else if (cursor->data_independent_addressing) {
+            cursor->step = SEGMENT_VARIANT(step_independent_stream);
+        } else {
+            cursor->step = SEGMENT_VARIANT(step_dependent_stream);
+        }
+    } else
+#endif
+    if (cursor->ref_offsets != NULL) {
+        cursor->step = with_xor ? SEGMENT_VARIANT(step_cached_xor)
+                                : SEGMENT_VARIANT(step_cached);
+    } else if (cursor->data_independent_addressing) {
+        cursor->step = with_xor ? SEGMENT_VARIANT(step_independent_xor)
+                                : SEGMENT_VARIANT(step_independent);
+    } else {
+        cursor->step = with_xor ? SEGMENT_VARIANT(step_dependent_xor)
+                                : SEGMENT_VARIANT(step_dependent);
+    }
+
+    /* Offset of the current block */
+    cursor->curr_offset = position.lane * instance->lane_length +
+                          position.slice * instance->segment_length +
+                          starting_index;
+
+    if (0 == cursor->curr_offset % instance->lane_length) {
+        /* Last block in this lane */
+        cursor->prev_offset = cursor->curr_offset + instance->lane_length - 1;
+    } else {
+        /* Previous block */
+        cursor->prev_offset = cursor->curr_offset - 1;
+    }
+
+    KERNEL_LOAD_STATE(cursor->state, instance->memory + cursor->prev_offset);
+
+    cursor->position.index = starting_index;
+    if (starting_index < instance->segment_length) {
+        /* Before any block of the segment is streamed out */
+        if (cursor->ref_offsets != NULL) {
+            SEGMENT_REF(cursor, 2, 0);
+        } else if (cursor->data_independent_addressing) {
+            SEGMENT_REF(cursor, 1, 0);
+        } else {
+            SEGMENT_REF(cursor, 0, 0);
+        }
+    }
+}
+
+/* Runs a whole segment with the step of its kind inlined */
+#define SEGMENT_RUN(cursor, independent, with_xor, stream)                     \
+    do {                                                                       \
+        while ((cursor)->position.index <                                      \
+               (cursor)->instance->segment_length) {                           \
+            SEGMENT_STEP((cursor), (independent), (with_xor), (stream));       \
+        }                                                                      \
+    } while ((void)0, 0)
+
+static KERNEL_TARGET void
+SEGMENT_CAT(fill_segment, KERNEL_NAME)(const argon2_instance_t *instance,
+                                       argon2_position_t position) {
+    SEGMENT_CURSOR cursor;
+
+    if (instance == NULL) {
+        return;
+    }
+
+    SEGMENT_BEGIN(&cursor, instance, position);
+#if defined(KERNEL_STREAM_BLOCK)
+    if (cursor.stream) {
+        if (cursor.step == SEGMENT_VARIANT(step_dependent_stream)) {
+            SEGMENT_RUN(&cursor, 0, 0, 1);
+        } else if (cursor.step == SEGMENT_VARIANT(step_independent_stream)) {
+            SEGMENT_RUN(&cursor, 1, 0, 1);
+        } else {
+            SEGMENT_RUN(&cursor, 2, 0, 1);
+        }
+        KERNEL_STREAM_FENCE();
+        return;
+    }
+#endif
+    if (cursor.step == SEGMENT_VARIANT(step_dependent)) {
+        SEGMENT_RUN(&cursor, 0, 0, 0);
+    } else if (cursor.step == SEGMENT_VARIANT(step_dependent_xor)) {
+        SEGMENT_RUN(&cursor, 0, 1, 0);
+    } else if (cursor.step == SEGMENT_VARIANT(step_independent)) {
+        SEGMENT_RUN(&cursor, 1, 0, 0);
+    } else if (cursor.step == SEGMENT_VARIANT(step_independent_xor)) {
+        SEGMENT_RUN(&cursor, 1, 1, 0);
+    } else if (cursor.step == SEGMENT_VARIANT(step_cached)) {
+        SEGMENT_RUN(&cursor, 2, 0, 0);
+    } else {
+        SEGMENT_RUN(&cursor, 2, 1, 0);
+    }
+}
+
+/* Writes the offsets of the reference blocks of the data-independent
+ * segment at @position to @offsets, from the first block it fills on,
+ * without touching the memory of @instance */
+static KERNEL_TARGET void SEGMENT_CAT(index_segment, KERNEL_NAME)(
+    const argon2_instance_t *instance, argon2_position_t position,
+    uint32_t *offsets) {
+    SEGMENT_CURSOR cursor;
+    uint32_t i = SEGMENT_SETUP(&cursor, instance, position);
+
+    for (; i < instance->segment_length; ++i) {
+        if (i % ARGON2_ADDRESSES_IN_BLOCK == 0) {
+            KERNEL_NEXT_ADDRESSES(&cursor.address_block, &cursor.input_block);
+        }
+        offsets[i] = (uint32_t)SEGMENT_LOOKUP(
+            &cursor, i, cursor.address_block.v[i % ARGON2_ADDRESSES_IN_BLOCK]);
+    }
+}
+
+static KERNEL_TARGET void SEGMENT_CAT(fill_segments, KERNEL_NAME)(
+    const argon2_instance_t *const *instances,
+    const argon2_position_t *positions, uint32_t count) {
+    SEGMENT_CURSOR cursors[ARGON2_MAX_INTERLEAVE];
+    uint32_t i, active;
+    int stream = 0;
+
+    for (i = 0; i < count; ++i) {
+        SEGMENT_BEGIN(&cursors[i], instances[i], positions[i]);
+        stream |= cursors[i].stream;
+    }
+
+    do {
+        active = 0;
+        for (i = 0; i < count; ++i) {
+            if (cursors[i].position.index <
+                cursors[i].instance->segment_length) {
+                cursors[i].step(&cursors[i]);
+                ++active;
+            }
+        }
+    } while (active != 0);
+
+#if defined(KERNEL_STREAM_BLOCK)
+    if (stream) {
+        KERNEL_STREAM_FENCE();
+    }
+#else
+    (void)stream;
+#endif
+}
+
+#undef SEGMENT_RUN
+#undef SEGMENT_VARIANT
+#undef SEGMENT_CURSOR
+#undef SEGMENT_SETUP
+#undef SEGMENT_BEGIN
+#undef SEGMENT_LOOKUP
+#undef SEGMENT_REF
+#undef SEGMENT_STEP
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef KERNEL_STATE
+#undef KERNEL_LOAD_STATE
+#undef KERNEL_FILL_BLOCK
+#undef KERNEL_NEXT_ADDRESSES
+#undef KERNEL_STREAM_BLOCK
+#undef KERNEL_STREAM_ALIGN
+#undef KERNEL_STREAM_FENCE
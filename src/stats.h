@@ -0,0 +1,58 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#ifndef ARGON2_STATS_H
+#define ARGON2_STATS_H
+
+#include <stdint.h>
+
+#include "argon2.h"
+
+/*
+        Instrumentation for ARGON2_FLAG_STATS. The hooks run at phase and
+        slice boundaries only, never inside a segment, and test a pointer
+        that is NULL unless the caller asked for stats. Building with
+        ARGON2_NO_STATS turns every hook into dead code.
+*/
+
+#if defined(ARGON2_NO_STATS)
+#define STATS_ON(stats) 0
+#else
+#define STATS_ON(stats) ((stats) != NULL)
+#endif
+
+/* Start time for STATS_LAP(), or 0 if @stats is off */
+#define STATS_NOW(stats) (STATS_ON(stats) ? argon2_clock_ns() : 0)
+
+/* Adds the time since @start to @stats->@field and restarts @start */
+#define STATS_LAP(stats, field, start)                                         \
+    do {                                                                       \
+        if (STATS_ON(stats)) {                                                 \
+            uint64_t now_ = argon2_clock_ns();                                 \
+            (stats)->field += now_ - (start);                                  \
+            (start) = now_;                                                    \
+        }                                                                      \
+    } while (0)
+
+/* Index in pass_ns of pass @r; the passes past the last slot share it */
+#define STATS_PASS(r)                                                          \
+    ((r) < ARGON2_STATS_PASSES ? (r) : ARGON2_STATS_PASSES - 1)
+
+/* Monotonic wall-clock time in nanoseconds, from an arbitrary origin */
+uint64_t argon2_clock_ns(void);
+
+#endif
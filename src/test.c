@@ -23,6 +23,7 @@
 #include <assert.h>
 
 #include "argon2.h"
+#include "thread.h"
 
 #define OUT_LEN 32
 #define ENCODED_LEN 108
@@ -34,6 +35,25 @@
  * argon2_verify() correctly verifies value
  */
 
+/* Memory callbacks that check the library wiped the memory it frees */
+static size_t unwiped_frees = 0;
+
+static int alloc_checked(uint8_t **memory, size_t bytes_to_allocate) {
+    *memory = (uint8_t *)malloc(bytes_to_allocate);
+    return *memory == NULL ? ARGON2_MEMORY_ALLOCATION_ERROR : ARGON2_OK;
+}
+
+static void free_checked(uint8_t *memory, size_t bytes_to_free) {
+    size_t i;
+    for (i = 0; i < bytes_to_free; ++i) {
+        if (memory[i] != 0) {
+            ++unwiped_frees;
+            break;
+        }
+    }
+    free(memory);
+}
+
 void hashtest(uint32_t version, uint32_t t, uint32_t m, uint32_t p, char *pwd,
               char *salt, char *hexref, char *mcfref) {
     unsigned char out[OUT_LEN];
@@ -65,6 +85,49 @@ void hashtest(uint32_t version, uint32_t t, uint32_t m, uint32_t p, char *pwd,
     printf("PASS\n");
 }
 
+/* A context hashing "password" with "somesalt" into OUT_LEN bytes, with
+ * t = 2 and one thread per lane; the output buffer is left to the caller */
+static void init_context(argon2_context *context, uint32_t lanes,
+                         uint32_t m_cost) {
+    memset(context, 0, sizeof(*context));
+    context->outlen = OUT_LEN;
+    context->pwd = (uint8_t *)"password";
+    context->pwdlen = (uint32_t)strlen("password");
+    context->salt = (uint8_t *)"somesalt";
+    context->saltlen = (uint32_t)strlen("somesalt");
+    context->t_cost = 2;
+    context->m_cost = m_cost;
+    context->lanes = lanes;
+    context->threads = lanes;
+    context->version = ARGON2_VERSION_NUMBER;
+    context->flags = ARGON2_DEFAULT_FLAGS;
+}
+
+/* Argon2id with the given lanes and number of threads, m = 1 MiB, t = 2 */
+static int lanes_hash(uint32_t lanes, uint32_t threads, unsigned char *out) {
+    argon2_context context;
+
+    init_context(&context, lanes, 1 << 10);
+    context.out = out;
+    context.threads = threads;
+
+    return argon2id_ctx(&context);
+}
+
+#if !defined(ARGON2_NO_THREADS)
+/* Counts the callbacks of argon2_async_poll() and checks their results */
+static void async_done(argon2_context *context, int result, void *user) {
+    int *calls = (int *)user;
+    (void)context;
+    assert(result == ARGON2_OK || result == ARGON2_ASYNC_CANCELLED);
+    if (result == ARGON2_OK) {
+        calls[0]++;
+    } else {
+        calls[1]++;
+    }
+}
+#endif
+
 int main() {
     int ret;
     unsigned char out[OUT_LEN];
@@ -249,5 +312,1007 @@ int main() {
     assert(ret == ARGON2_SALT_TOO_SHORT);
     printf("Fail on salt too short: PASS\n");
 
+    /* Thread pool tests */
+
+    printf("\n");
+    printf("Thread pool tests\n");
+
+    {
+        unsigned char ref[OUT_LEN];
+        uint32_t threads;
+
+        ret = argon2_hash(2, 1 << 10, 4, "password", strlen("password"),
+                          "somesalt", strlen("somesalt"), ref, OUT_LEN, NULL,
+                          0, Argon2_id, version);
+        assert(ret == ARGON2_OK);
+
+        for (threads = 1; threads <= 5; ++threads) {
+            ret = lanes_hash(4, threads, out);
+            assert(ret == ARGON2_OK);
+            assert(memcmp(out, ref, OUT_LEN) == 0);
+        }
+        printf("Same result for any thread count: PASS\n");
+
+        /* Odd lanes leave a thread a lane without a partner to fill with */
+        ret = lanes_hash(5, 5, ref);
+        assert(ret == ARGON2_OK);
+        for (threads = 1; threads <= 3; ++threads) {
+            ret = lanes_hash(5, threads, out);
+            assert(ret == ARGON2_OK);
+            assert(memcmp(out, ref, OUT_LEN) == 0);
+        }
+        ret = argon2_hash(2, 1 << 10, 4, "password", strlen("password"),
+                          "somesalt", strlen("somesalt"), ref, OUT_LEN, NULL,
+                          0, Argon2_id, version);
+        assert(ret == ARGON2_OK);
+        printf("Same result for odd lanes: PASS\n");
+
+        argon2_pool_shutdown();
+        ret = lanes_hash(4, 3, out);
+        assert(ret == ARGON2_OK);
+        assert(memcmp(out, ref, OUT_LEN) == 0);
+        argon2_pool_shutdown();
+        printf("Hash after pool shutdown: PASS\n");
+    }
+
+    /* Kernel tests */
+
+    printf("\n");
+    printf("Kernel tests\n");
+
+    {
+        unsigned char ref[3][OUT_LEN];
+        const char *name;
+        unsigned i, type;
+
+        ret = argon2_select_kernel("ref");
+        assert(ret == ARGON2_OK);
+        assert(strcmp(argon2_kernel_name(), "ref") == 0);
+        for (type = Argon2_d; type <= Argon2_id; ++type) {
+            ret = argon2_hash(2, 1 << 10, 2, "password", strlen("password"),
+                              "somesalt", strlen("somesalt"), ref[type],
+                              OUT_LEN, NULL, 0, (argon2_type)type, version);
+            assert(ret == ARGON2_OK);
+        }
+
+        /* Every kernel but ref itself */
+        for (i = 1; (name = argon2_builtin_kernel(i)) != NULL; ++i) {
+            if (argon2_select_kernel(name) != ARGON2_OK) {
+                continue;
+            }
+            assert(strcmp(argon2_kernel_name(), name) == 0);
+            for (type = Argon2_d; type <= Argon2_id; ++type) {
+                ret = argon2_hash(2, 1 << 10, 2, "password",
+                                  strlen("password"), "somesalt",
+                                  strlen("somesalt"), out, OUT_LEN, NULL, 0,
+                                  (argon2_type)type, version);
+                assert(ret == ARGON2_OK);
+                assert(memcmp(out, ref[type], OUT_LEN) == 0);
+            }
+            printf("Kernel %s matches ref: PASS\n", name);
+        }
+        assert(strcmp(argon2_builtin_kernel(0), "ref") == 0);
+
+        ret = argon2_select_kernel("nosuchkernel");
+        assert(ret == ARGON2_KERNEL_UNAVAILABLE);
+        ret = argon2_select_kernel(NULL);
+        assert(ret == ARGON2_OK);
+        printf("Kernel selection: PASS\n");
+    }
+
+    /* Batch tests */
+
+    printf("\n");
+    printf("Batch tests\n");
+
+    {
+#define BATCH 6
+        argon2_context contexts[BATCH];
+        unsigned char outs[BATCH][OUT_LEN];
+        unsigned char salts[BATCH][16];
+        int results[BATCH];
+        unsigned i, type;
+
+        for (type = Argon2_d; type <= Argon2_id; ++type) {
+            memset(contexts, 0, sizeof(contexts));
+            for (i = 0; i < BATCH; ++i) {
+                memset(salts[i], 'a' + i, sizeof(salts[i]));
+                contexts[i].out = outs[i];
+                contexts[i].outlen = OUT_LEN;
+                contexts[i].pwd = (uint8_t *)"password";
+                contexts[i].pwdlen = (uint32_t)strlen("password");
+                contexts[i].salt = salts[i];
+                contexts[i].saltlen = sizeof(salts[i]);
+                contexts[i].t_cost = 1 + i % 3;
+                contexts[i].m_cost = (1 << 8) << (i % 2);
+                contexts[i].lanes = 1 + i % 4;
+                contexts[i].threads = 1;
+                contexts[i].version = i == 4 ? ARGON2_VERSION_10
+                                             : ARGON2_VERSION_NUMBER;
+                contexts[i].flags = ARGON2_DEFAULT_FLAGS;
+            }
+            contexts[2].saltlen = 1;
+
+            ret = argon2_hash_batch(contexts, BATCH, (argon2_type)type,
+                                    results);
+            assert(ret == ARGON2_SALT_TOO_SHORT);
+            for (i = 0; i < BATCH; ++i) {
+                if (i == 2) {
+                    assert(results[i] == ARGON2_SALT_TOO_SHORT);
+                    continue;
+                }
+                assert(results[i] == ARGON2_OK);
+                contexts[i].out = out;
+                ret = argon2_ctx(&contexts[i], (argon2_type)type);
+                assert(ret == ARGON2_OK);
+                assert(memcmp(out, outs[i], OUT_LEN) == 0);
+            }
+        }
+        printf("Batch matches argon2_ctx: PASS\n");
+
+        ret = argon2_hash_batch(NULL, 0, Argon2_id, NULL);
+        assert(ret == ARGON2_OK);
+        printf("Empty batch: PASS\n");
+#undef BATCH
+    }
+
+    /* Memory backing tests */
+
+    printf("\n");
+    printf("Memory backing tests\n");
+
+    {
+        unsigned char ref[OUT_LEN];
+        argon2_context context;
+        uint32_t m_cost;
+
+        for (m_cost = 1 << 8; m_cost <= 1 << 13; m_cost <<= 5) {
+            init_context(&context, 2, m_cost);
+            context.out = ref;
+            context.t_cost = 1;
+            ret = argon2id_ctx(&context);
+            assert(ret == ARGON2_OK);
+            assert(context.memory_backing == ARGON2_BACKING_DEFAULT);
+
+            context.out = out;
+            context.flags = ARGON2_FLAG_HUGE_PAGES;
+            ret = argon2id_ctx(&context);
+            assert(ret == ARGON2_OK);
+            assert(memcmp(out, ref, OUT_LEN) == 0);
+            assert(context.memory_backing >= ARGON2_BACKING_PAGES &&
+                   context.memory_backing <= ARGON2_BACKING_HUGE_1G);
+            printf("Huge pages flag, m=%u: PASS (backing %u)\n",
+                   (unsigned)m_cost, (unsigned)context.memory_backing);
+        }
+
+        context.out = out;
+        context.m_cost = 1 << 10;
+        context.lanes = 4;
+        context.threads = 4;
+        context.flags = ARGON2_DEFAULT_FLAGS;
+        ret = argon2i_ctx(&context);
+        assert(ret == ARGON2_OK);
+        memcpy(ref, out, OUT_LEN);
+        context.flags = ARGON2_FLAG_NUMA;
+        ret = argon2i_ctx(&context);
+        assert(ret == ARGON2_OK);
+        assert(memcmp(out, ref, OUT_LEN) == 0);
+        printf("NUMA flag: PASS\n");
+    }
+
+    /* Workspace tests */
+
+    printf("\n");
+    printf("Workspace tests\n");
+
+    {
+        unsigned char ref[OUT_LEN];
+        argon2_context context;
+        argon2_workspace_pool *ws_pool;
+        argon2_workspace *workspace, *other;
+        uint32_t m_cost;
+
+        workspace = argon2_workspace_create(1 << 10, 2, ARGON2_DEFAULT_FLAGS);
+        assert(workspace != NULL);
+
+        /* The last hash needs more memory than the workspace holds */
+        for (m_cost = 1 << 8; m_cost <= 1 << 11; m_cost <<= 1) {
+            init_context(&context, 2, m_cost);
+            context.out = ref;
+            ret = argon2id_ctx(&context);
+            assert(ret == ARGON2_OK);
+
+            context.out = out;
+            ret = argon2_ctx_workspace(&context, Argon2_id, workspace);
+            assert(ret == ARGON2_OK);
+            assert(memcmp(out, ref, OUT_LEN) == 0);
+            printf("Workspace hash, m=%u: PASS\n", (unsigned)m_cost);
+        }
+        argon2_workspace_destroy(workspace);
+
+        ws_pool = argon2_workspace_pool_create(2, 1 << 8, 1,
+                                               ARGON2_DEFAULT_FLAGS);
+        assert(ws_pool != NULL);
+        workspace = argon2_workspace_acquire(ws_pool);
+        other = argon2_workspace_acquire(ws_pool);
+        assert(workspace != NULL && other != NULL && workspace != other);
+        argon2_workspace_release(ws_pool, workspace);
+        assert(argon2_workspace_acquire(ws_pool) == workspace);
+        argon2_workspace_release(ws_pool, workspace);
+        argon2_workspace_release(ws_pool, other);
+        argon2_workspace_pool_destroy(ws_pool);
+        printf("Workspace pool: PASS\n");
+
+        /* Hashes in workspaces wiped on release see the same memory */
+        ws_pool = argon2_workspace_pool_create(1, 1 << 9, 2,
+                                               ARGON2_FLAG_DEFER_WIPE);
+        assert(ws_pool != NULL);
+        for (m_cost = 1 << 8; m_cost <= 1 << 9; m_cost <<= 1) {
+            context.out = ref;
+            context.m_cost = m_cost;
+            ret = argon2id_ctx(&context);
+            assert(ret == ARGON2_OK);
+
+            context.out = out;
+            workspace = argon2_workspace_acquire(ws_pool);
+            assert(workspace != NULL);
+            ret = argon2_ctx_workspace(&context, Argon2_id, workspace);
+            assert(ret == ARGON2_OK);
+            assert(memcmp(out, ref, OUT_LEN) == 0);
+            argon2_workspace_release(ws_pool, workspace);
+        }
+        argon2_workspace_pool_destroy(ws_pool);
+        printf("Deferred wipe: PASS\n");
+
+        assert(argon2_workspace_create(0, 1, ARGON2_DEFAULT_FLAGS) == NULL);
+        assert(argon2_workspace_pool_create(0, 1 << 8, 1,
+                                            ARGON2_DEFAULT_FLAGS) == NULL);
+        printf("Empty workspace: PASS\n");
+    }
+
+    /* Async tests */
+
+#if !defined(ARGON2_NO_THREADS)
+    printf("\n");
+    printf("Async tests\n");
+
+    {
+        unsigned char outs[4][OUT_LEN];
+        unsigned char ref[OUT_LEN];
+        argon2_context contexts[5];
+        argon2_async *async;
+        uint64_t id;
+        uint32_t polled = 0;
+        int calls[2] = {0, 0};
+        unsigned i;
+
+        async = argon2_async_create(2, 4);
+        assert(async != NULL);
+        for (i = 0; i < 5; ++i) {
+            init_context(&contexts[i], 1, 1 << 8);
+            contexts[i].out = outs[i % 4];
+            contexts[i].t_cost = 1 + i;
+        }
+        for (i = 0; i < 4; ++i) {
+            ret = argon2_async_submit(async, &contexts[i], Argon2_id,
+                                      async_done, calls, &id);
+            assert(ret == ARGON2_OK);
+        }
+        /* Every slot is taken until the hashes are collected */
+        ret = argon2_async_submit(async, &contexts[4], Argon2_id, async_done,
+                                  calls, NULL);
+        assert(ret == ARGON2_ASYNC_QUEUE_FULL);
+        /* The last hash is either cancelled or already under way */
+        ret = argon2_async_cancel(async, id);
+        assert(ret == ARGON2_OK || ret == ARGON2_INCORRECT_PARAMETER);
+        while (polled < 4) {
+            polled += argon2_async_poll(async, 1);
+        }
+        assert(argon2_async_poll(async, 1) == 0);
+        assert(calls[0] + calls[1] == 4);
+        assert(calls[1] == (ret == ARGON2_OK ? 1 : 0));
+        for (i = 0; i < 3; ++i) {
+            contexts[i].out = ref;
+            ret = argon2id_ctx(&contexts[i]);
+            assert(ret == ARGON2_OK);
+            assert(memcmp(ref, outs[i], OUT_LEN) == 0);
+        }
+        printf("Async hashes: PASS\n");
+
+        calls[0] = calls[1] = 0;
+        for (i = 0; i < 4; ++i) {
+            contexts[i].out = outs[i];
+            ret = argon2_async_submit(async, &contexts[i], Argon2_id,
+                                      async_done, calls, NULL);
+            assert(ret == ARGON2_OK);
+        }
+        argon2_async_destroy(async);
+        assert(calls[0] + calls[1] == 4);
+        printf("Async destroy: PASS\n");
+
+        {
+            argon2_stats stats;
+            char pwd[] = "password";
+            uint32_t expected = argon2_cpu_count() / 2;
+
+            expected = expected == 0 ? 1 : expected < 8 ? expected : 8;
+            async = argon2_async_create(2, 2);
+            assert(async != NULL);
+            contexts[0].out = outs[0];
+            contexts[0].m_cost = 1 << 9;
+            contexts[0].lanes = 8;
+            contexts[0].threads = 8;
+            contexts[0].flags = ARGON2_FLAG_STATS;
+            contexts[0].stats = &stats;
+            calls[0] = calls[1] = 0;
+            ret = argon2_async_submit(async, &contexts[0], Argon2_id,
+                                      async_done, calls, NULL);
+            assert(ret == ARGON2_OK);
+            assert(argon2_async_poll(async, 1) == 1);
+            assert(calls[0] == 1);
+            assert(stats.threads == expected);
+            assert(contexts[0].threads == 8);
+
+            /* The same context twice at once keeps its own threads */
+            contexts[0].flags = ARGON2_DEFAULT_FLAGS;
+            for (i = 0; i < 2; ++i) {
+                ret = argon2_async_submit(async, &contexts[0], Argon2_id,
+                                          async_done, calls, NULL);
+                assert(ret == ARGON2_OK);
+            }
+            for (polled = 0; polled < 2;) {
+                polled += argon2_async_poll(async, 1);
+            }
+            assert(contexts[0].threads == 8);
+
+            /* What the hash changes in the context still reaches it */
+            contexts[1] = contexts[0];
+            contexts[1].out = outs[1];
+            contexts[1].pwd = (uint8_t *)pwd;
+            contexts[1].flags = ARGON2_FLAG_CLEAR_PASSWORD;
+            ret = argon2_async_submit(async, &contexts[1], Argon2_id,
+                                      async_done, calls, NULL);
+            assert(ret == ARGON2_OK);
+            assert(argon2_async_poll(async, 1) == 1);
+            assert(calls[0] == 4);
+            assert(contexts[1].pwdlen == 0 && pwd[0] == 0);
+            assert(contexts[1].threads == 8);
+            argon2_async_destroy(async);
+            contexts[0].out = ref;
+            ret = argon2id_ctx(&contexts[0]);
+            assert(ret == ARGON2_OK);
+            assert(memcmp(ref, outs[0], OUT_LEN) == 0);
+            printf("Async threads cap: PASS\n");
+        }
+    }
+
+    {
+        argon2_context context;
+        argon2_stats stats;
+        argon2_async *async;
+        uint32_t expected;
+        unsigned tries;
+
+        init_context(&context, 8, 1 << 9);
+        context.out = out;
+        context.threads = ARGON2_THREADS_AUTO;
+        context.flags = ARGON2_FLAG_STATS;
+        context.stats = &stats;
+        ret = argon2id_ctx(&context);
+        assert(ret == ARGON2_OK);
+        expected = stats.threads;
+        async = argon2_async_create(4, 1);
+        assert(async != NULL);
+        /* The workers are counted as claimed until they start waiting */
+        for (tries = 0; tries < 1000; ++tries) {
+            ret = argon2id_ctx(&context);
+            assert(ret == ARGON2_OK);
+            if (stats.threads == expected) {
+                break;
+            }
+        }
+        assert(stats.threads == expected);
+        argon2_async_destroy(async);
+        printf("Idle async workers: PASS\n");
+    }
+#endif
+
+    /* Encoded params tests */
+
+    printf("\n");
+    printf("Encoded params tests\n");
+
+    {
+        char enc[256];
+        uint8_t long_salt[ARGON2_ENCODED_MAX_SALT_LENGTH + 16];
+        argon2_encoded_params params, copy;
+
+        ret = argon2_hash(2, 1 << 8, 2, "password", strlen("password"),
+                          "somesalt", strlen("somesalt"), NULL, OUT_LEN, enc,
+                          sizeof(enc), Argon2_id, ARGON2_VERSION_NUMBER);
+        assert(ret == ARGON2_OK);
+        ret = argon2_encoded_parse(&params, enc, Argon2_id);
+        assert(ret == ARGON2_OK);
+        assert(params.m_cost == 1 << 8 && params.t_cost == 2 &&
+               params.lanes == 2 && params.outlen == OUT_LEN &&
+               params.saltlen == strlen("somesalt"));
+        copy = params;
+        ret = argon2_verify_params(&copy, "password", strlen("password"));
+        assert(ret == ARGON2_OK);
+        ret = argon2_verify_params(&copy, "passwore", strlen("passwore"));
+        assert(ret == ARGON2_VERIFY_MISMATCH);
+        ret = argon2_encoded_parse(&params, enc, Argon2_i);
+        assert(ret == ARGON2_DECODING_FAIL);
+        printf("Verify parsed params: PASS\n");
+
+        /* Too long for params, argon2_verify still takes it */
+        memset(long_salt, 's', sizeof(long_salt));
+        ret = argon2_hash(2, 1 << 8, 1, "password", strlen("password"),
+                          long_salt, sizeof(long_salt), NULL, OUT_LEN, enc,
+                          sizeof(enc), Argon2_id, ARGON2_VERSION_NUMBER);
+        assert(ret == ARGON2_OK);
+        ret = argon2_encoded_parse(&params, enc, Argon2_id);
+        assert(ret == ARGON2_DECODING_FAIL);
+        ret = argon2_verify(enc, "password", strlen("password"), Argon2_id);
+        assert(ret == ARGON2_OK);
+        printf("Verify long salt: PASS\n");
+    }
+
+    /* Encoding tests */
+
+    printf("\n");
+    printf("Encoding tests\n");
+
+    {
+        char ref_enc[8 * 256], enc[8 * 256], bad[256];
+        const char *name;
+        uint8_t bytes[8][ARGON2_ENCODED_MAX_OUTLEN];
+        argon2_context contexts[8];
+        argon2_encoded_params params;
+        size_t offsets[8], total = 0;
+        unsigned i, j, k;
+
+        for (i = 0; i < 8; ++i) {
+            for (j = 0; j < sizeof(bytes[i]); ++j) {
+                bytes[i][j] = (uint8_t)(i * 71 + j * 29);
+            }
+            memset(&contexts[i], 0, sizeof(contexts[i]));
+            contexts[i].out = bytes[i];
+            contexts[i].outlen = 12 + 7 * i;
+            contexts[i].salt = bytes[7 - i];
+            contexts[i].saltlen = 8 + 8 * i;
+            contexts[i].t_cost = 1;
+            contexts[i].m_cost = 8;
+            contexts[i].lanes = 1;
+            contexts[i].threads = 1;
+            contexts[i].version = ARGON2_VERSION_NUMBER;
+        }
+
+        for (k = 0; (name = argon2_builtin_kernel(k)) != NULL; ++k) {
+            if (argon2_select_kernel(name) != ARGON2_OK) {
+                continue;
+            }
+            ret = argon2_encode_batch(enc, sizeof(enc), contexts, 8,
+                                      Argon2_id, offsets);
+            assert(ret == ARGON2_OK);
+            if (k == 0) {
+                total = offsets[7] + strlen(enc + offsets[7]) + 1;
+                memcpy(ref_enc, enc, total);
+            }
+            assert(memcmp(enc, ref_enc, total) == 0);
+            for (i = 0; i < 8; ++i) {
+                ret = argon2_encoded_parse(&params, enc + offsets[i],
+                                           Argon2_id);
+                assert(ret == ARGON2_OK);
+                assert(params.outlen == contexts[i].outlen &&
+                       params.saltlen == contexts[i].saltlen);
+                assert(memcmp(params.hash, bytes[i], params.outlen) == 0);
+                assert(memcmp(params.salt, bytes[7 - i], params.saltlen) == 0);
+            }
+            /* An invalid character deep in the hash */
+            strcpy(bad, enc + offsets[7]);
+            bad[strlen(bad) - 20] = '*';
+            ret = argon2_encoded_parse(&params, bad, Argon2_id);
+            assert(ret == ARGON2_DECODING_FAIL);
+            printf("Kernel %s Base64: PASS\n", name);
+        }
+        ret = argon2_select_kernel(NULL);
+        assert(ret == ARGON2_OK);
+
+        ret = argon2_encode_batch(enc, total - 1, contexts, 8, Argon2_id,
+                                  NULL);
+        assert(ret == ARGON2_ENCODING_FAIL);
+        for (i = 0; i < 8; ++i) {
+            assert(strlen(ref_enc + offsets[i]) + 1 ==
+                   argon2_encodedlen(1, 8, 1, contexts[i].saltlen,
+                                     contexts[i].outlen, Argon2_id));
+        }
+        printf("Encode batch: PASS\n");
+    }
+
+    /* Stats tests */
+
+    printf("\n");
+    printf("Stats tests\n");
+
+    {
+        unsigned char ref[OUT_LEN];
+        argon2_context context;
+        argon2_stats stats;
+        uint64_t passes;
+        uint32_t r;
+
+        init_context(&context, 4, 1 << 10);
+        context.out = ref;
+        context.t_cost = 3;
+        context.threads = 1;
+        context.stats = &stats;
+        memset(&stats, 0xAA, sizeof(stats));
+        ret = argon2id_ctx(&context);
+        assert(ret == ARGON2_OK);
+        assert(stats.threads == 0xAAAAAAAA); /* untouched without the flag */
+
+        for (context.threads = 1; context.threads <= 4; context.threads *= 4) {
+            context.out = out;
+            context.flags = ARGON2_FLAG_STATS;
+            ret = argon2id_ctx(&context);
+            assert(ret == ARGON2_OK);
+            assert(memcmp(out, ref, OUT_LEN) == 0);
+            assert(strcmp(stats.kernel, argon2_kernel_name()) == 0);
+            assert(stats.threads == context.threads);
+            assert(stats.bytes_allocated == (uint64_t)context.m_cost * 1024);
+            assert(stats.bytes_wiped == stats.bytes_allocated);
+            assert(stats.memory_backing == context.memory_backing);
+            for (passes = 0, r = 0; r < ARGON2_STATS_PASSES; ++r) {
+                assert((r < context.t_cost) == (stats.pass_ns[r] != 0));
+                passes += stats.pass_ns[r];
+            }
+            assert(passes <= stats.fill_ns);
+            assert(stats.fill_ns + stats.finalize_ns <= stats.total_ns);
+            assert(stats.wipe_ns <= stats.finalize_ns);
+            if (context.threads == 1) {
+                assert(stats.wait_ns == 0 && stats.join_ns == 0);
+            }
+            printf("Stats, %u threads: PASS\n", (unsigned)context.threads);
+        }
+    }
+
+    /* Memory governor tests */
+
+    printf("\n");
+    printf("Memory governor tests\n");
+
+    {
+        unsigned char ref[OUT_LEN];
+        argon2_memory_governor *governor;
+        argon2_context context;
+
+        init_context(&context, 2, 1 << 9);
+        context.out = ref;
+        ret = argon2id_ctx(&context);
+        assert(ret == ARGON2_OK);
+
+        governor = argon2_governor_create(1 << 10, ARGON2_DEFAULT_FLAGS);
+        assert(governor != NULL);
+        context.out = out;
+        ret = argon2_ctx_governed(&context, Argon2_id, governor, 1);
+        assert(ret == ARGON2_OK);
+        assert(memcmp(out, ref, OUT_LEN) == 0);
+        ret = argon2_ctx_governed(&context, Argon2_id, governor, 0);
+        assert(ret == ARGON2_OK);
+        assert(memcmp(out, ref, OUT_LEN) == 0);
+        printf("Governed hash: PASS\n");
+
+        context.m_cost = 1 << 11;
+        ret = argon2_ctx_governed(&context, Argon2_id, governor, 1);
+        assert(ret == ARGON2_MEMORY_BUDGET_EXCEEDED);
+        printf("Hash over budget: PASS\n");
+        argon2_governor_destroy(governor);
+    }
+
+    /* Calibration tests */
+
+    printf("\n");
+    printf("Calibration tests\n");
+
+    {
+        argon2_calibration params;
+
+        ret = argon2_calibrate(Argon2_id, 20, 1 << 8, 2, &params);
+        assert(ret == ARGON2_OK);
+        assert(params.m_cost == 1 << 8 && params.lanes == 2 &&
+               params.threads == 2);
+        assert(params.t_cost > 1 && params.latency_ns <= 20000000);
+        printf("Calibrate to 20 ms: PASS (t=%u)\n", (unsigned)params.t_cost);
+
+        ret = argon2_calibrate(Argon2_id, 20, 1 << 8, 0, &params);
+        assert(ret == ARGON2_INCORRECT_PARAMETER);
+        ret = argon2_calibrate(Argon2_id, 20, 4, 1, &params);
+        assert(ret == ARGON2_MEMORY_TOO_LITTLE);
+        printf("Calibrate bad parameters: PASS\n");
+    }
+
+    /* Index cache tests */
+
+    printf("\n");
+    printf("Index cache tests\n");
+
+    {
+        static const argon2_type types[2] = {Argon2_i, Argon2_id};
+        unsigned char ref[OUT_LEN];
+        argon2_index_cache *cache;
+        argon2_context context;
+        int k;
+
+        init_context(&context, 4, 1000); /* m rounded down to 992 */
+        context.t_cost = 3;
+
+        for (k = 0; k < 2; ++k) {
+            cache = argon2_index_cache_create(types[k], context.t_cost,
+                                              context.m_cost, context.lanes);
+            assert(cache != NULL);
+            for (context.threads = 1; context.threads <= 4;
+                 context.threads *= 4) {
+                context.out = ref;
+                context.flags = ARGON2_DEFAULT_FLAGS;
+                context.index_cache = NULL;
+                ret = argon2_ctx(&context, types[k]);
+                assert(ret == ARGON2_OK);
+                context.out = out;
+                context.flags = ARGON2_FLAG_INDEX_CACHE;
+                context.index_cache = cache;
+                ret = argon2_ctx(&context, types[k]);
+                assert(ret == ARGON2_OK);
+                assert(memcmp(out, ref, OUT_LEN) == 0);
+            }
+            argon2_index_cache_destroy(cache);
+            printf("Cached %s: PASS\n", argon2_type2string(types[k], 0));
+        }
+
+        /* Built for other parameters, the cache is not used */
+        cache = argon2_index_cache_create(Argon2_i, 2, context.m_cost,
+                                          context.lanes);
+        assert(cache != NULL);
+        context.out = ref;
+        context.flags = ARGON2_DEFAULT_FLAGS;
+        ret = argon2i_ctx(&context);
+        assert(ret == ARGON2_OK);
+        context.out = out;
+        context.flags = ARGON2_FLAG_INDEX_CACHE;
+        context.index_cache = cache;
+        ret = argon2i_ctx(&context);
+        assert(ret == ARGON2_OK);
+        assert(memcmp(out, ref, OUT_LEN) == 0);
+        argon2_index_cache_destroy(cache);
+        printf("Mismatched cache: PASS\n");
+
+        assert(argon2_index_cache_create(Argon2_d, 3, 1 << 10, 4) == NULL);
+        assert(argon2_index_cache_create(Argon2_i, 0, 1 << 10, 4) == NULL);
+        assert(argon2_index_cache_create(Argon2_i, 3, 16, 4) == NULL);
+        printf("Cache bad parameters: PASS\n");
+    }
+
+    /* Resumable hash tests */
+
+    printf("\n");
+    printf("Resumable hash tests\n");
+
+    {
+        unsigned char ref[OUT_LEN];
+        argon2_context context;
+        argon2_state *state;
+        uint32_t budget;
+
+        init_context(&context, 4, 1 << 9);
+        context.out = ref;
+        context.t_cost = 3;
+        context.threads = 1;
+        ret = argon2id_ctx(&context);
+        assert(ret == ARGON2_OK);
+
+        context.out = out;
+        for (budget = 1; budget <= 5; budget += 2) {
+            for (context.threads = 1; context.threads <= 4;
+                 context.threads *= 4) {
+                memset(out, 0, OUT_LEN);
+                ret = argon2_begin(&state, &context, Argon2_id);
+                assert(ret == ARGON2_OK);
+                assert(argon2_slices_left(state) == 12);
+                assert(argon2_step(state, 0) == ARGON2_STEP_PENDING);
+                while ((ret = argon2_step(state, budget)) ==
+                       ARGON2_STEP_PENDING) {
+                }
+                assert(ret == ARGON2_OK);
+                assert(argon2_slices_left(state) == 0);
+                ret = argon2_finish(state);
+                assert(ret == ARGON2_OK);
+                assert(memcmp(out, ref, OUT_LEN) == 0);
+            }
+        }
+        printf("Stepped hash: PASS\n");
+
+        ret = argon2_begin(&state, &context, Argon2_id);
+        assert(ret == ARGON2_OK);
+        assert(argon2_step(state, 5) == ARGON2_STEP_PENDING);
+        assert(argon2_finish(state) == ARGON2_HASH_UNFINISHED);
+        context.t_cost = 0;
+        ret = argon2_begin(&state, &context, Argon2_id);
+        assert(ret == ARGON2_TIME_TOO_SMALL && state == NULL);
+        printf("Abandoned and invalid hashes: PASS\n");
+    }
+
+    /* One-shot workspace hash tests */
+
+    printf("\n");
+    printf("One-shot workspace hash tests\n");
+
+    {
+        unsigned char ref[OUT_LEN];
+        char enc[256], enc_ref[256];
+        argon2_workspace *workspace;
+        size_t k;
+
+        ret = argon2_hash(2, 1 << 8, 2, "password", strlen("password"),
+                          "somesalt", strlen("somesalt"), ref, OUT_LEN,
+                          enc_ref, sizeof(enc_ref), Argon2_id,
+                          ARGON2_VERSION_NUMBER);
+        assert(ret == ARGON2_OK);
+
+        workspace = argon2_workspace_create(1 << 8, 2, ARGON2_DEFAULT_FLAGS);
+        assert(workspace != NULL);
+        ret = argon2_hash_workspace(2, 1 << 8, 2, "password",
+                                    strlen("password"), "somesalt",
+                                    strlen("somesalt"), out, OUT_LEN, enc,
+                                    sizeof(enc), Argon2_id,
+                                    ARGON2_VERSION_NUMBER, workspace);
+        assert(ret == ARGON2_OK);
+        assert(memcmp(out, ref, OUT_LEN) == 0);
+        assert(strcmp(enc, enc_ref) == 0);
+
+        /* Encoded only, the tag stays on the stack */
+        memset(enc, 0, sizeof(enc));
+        ret = argon2_hash_workspace(2, 1 << 8, 2, "password",
+                                    strlen("password"), "somesalt",
+                                    strlen("somesalt"), NULL, OUT_LEN, enc,
+                                    sizeof(enc), Argon2_id,
+                                    ARGON2_VERSION_NUMBER, workspace);
+        assert(ret == ARGON2_OK);
+        assert(strcmp(enc, enc_ref) == 0);
+        printf("Hash in workspace: PASS\n");
+
+        /* Encoding fails, no raw hash is left behind */
+        memset(out, 0xff, OUT_LEN);
+        ret = argon2_hash_workspace(2, 1 << 8, 2, "password",
+                                    strlen("password"), "somesalt",
+                                    strlen("somesalt"), out, OUT_LEN, enc, 8,
+                                    Argon2_id, ARGON2_VERSION_NUMBER,
+                                    workspace);
+        assert(ret == ARGON2_ENCODING_FAIL);
+        for (k = 0; k < OUT_LEN; ++k) {
+            assert(out[k] == 0);
+        }
+        argon2_workspace_destroy(workspace);
+        printf("Encoding failure wipes hash: PASS\n");
+    }
+
+    /* Thread count tests */
+
+    printf("\n");
+    printf("Thread count tests\n");
+
+    {
+        unsigned char ref[OUT_LEN];
+        argon2_context context;
+        argon2_stats stats;
+        uint32_t threads;
+
+        ret = argon2_hash(2, 1 << 9, 4, "password", strlen("password"),
+                          "somesalt", strlen("somesalt"), ref, OUT_LEN, NULL,
+                          0, Argon2_id, ARGON2_VERSION_NUMBER);
+        assert(ret == ARGON2_OK);
+        for (threads = 0; threads <= 2; ++threads) {
+            memset(out, 0, OUT_LEN);
+            ret = argon2_hash_threads(2, 1 << 9, 4, threads, "password",
+                                      strlen("password"), "somesalt",
+                                      strlen("somesalt"), out, OUT_LEN, NULL,
+                                      0, Argon2_id, ARGON2_VERSION_NUMBER,
+                                      NULL);
+            assert(ret == ARGON2_OK);
+            assert(memcmp(out, ref, OUT_LEN) == 0);
+        }
+        printf("Lanes and threads apart: PASS\n");
+
+        init_context(&context, 4, 1 << 9);
+        context.out = out;
+        context.threads = ARGON2_THREADS_AUTO;
+        context.flags = ARGON2_FLAG_STATS;
+        context.stats = &stats;
+        ret = argon2id_ctx(&context);
+        assert(ret == ARGON2_OK);
+        assert(memcmp(out, ref, OUT_LEN) == 0);
+        assert(stats.threads >= 1 && stats.threads <= 4);
+        printf("Automatic thread count: PASS\n");
+    }
+
+    /* Affinity tests */
+
+    printf("\n");
+    printf("Affinity tests\n");
+
+    {
+        unsigned char ref[OUT_LEN];
+        const uint32_t cpus[2] = {0, 0};
+        argon2_context context;
+        uint32_t policy;
+
+        init_context(&context, 4, 1 << 9);
+        context.out = ref;
+        ret = argon2id_ctx(&context);
+        assert(ret == ARGON2_OK);
+
+        context.out = out;
+        context.flags = ARGON2_FLAG_AFFINITY;
+        context.cpus = cpus;
+        context.cpu_count = 2;
+        for (policy = ARGON2_AFFINITY_COMPACT; policy <= ARGON2_AFFINITY_LIST;
+             ++policy) {
+            memset(out, 0, OUT_LEN);
+            context.affinity = policy;
+            ret = argon2id_ctx(&context);
+            assert(ret == ARGON2_OK);
+            assert(memcmp(out, ref, OUT_LEN) == 0);
+        }
+        printf("Pinned workers: PASS\n");
+
+        context.cpu_count = 0;
+        ret = argon2id_ctx(&context);
+        assert(ret == ARGON2_INCORRECT_PARAMETER);
+        context.affinity = ARGON2_AFFINITY_LIST + 1;
+        ret = argon2id_ctx(&context);
+        assert(ret == ARGON2_INCORRECT_PARAMETER);
+        printf("Bad affinity: PASS\n");
+    }
+
+    /* Streaming store tests */
+
+    printf("\n");
+    printf("Streaming store tests\n");
+
+    {
+        unsigned char ref[OUT_LEN];
+        argon2_index_cache *cache;
+        argon2_context context;
+        const char *name;
+        uint32_t versions[2] = {ARGON2_VERSION_10, ARGON2_VERSION_13};
+        unsigned k, v, type;
+
+        init_context(&context, 4, 1 << 9);
+
+        for (k = 0; (name = argon2_builtin_kernel(k)) != NULL; ++k) {
+            if (argon2_select_kernel(name) != ARGON2_OK) {
+                continue;
+            }
+            for (v = 0; v < 2; ++v) {
+                context.version = versions[v];
+                for (type = Argon2_d; type <= Argon2_id; ++type) {
+                    /* One thread interleaves the lanes */
+                    for (context.threads = 1; context.threads <= 4;
+                         context.threads *= 4) {
+                        context.out = ref;
+                        context.flags = ARGON2_DEFAULT_FLAGS;
+                        ret = argon2_ctx(&context, (argon2_type)type);
+                        assert(ret == ARGON2_OK);
+                        context.out = out;
+                        context.flags = ARGON2_FLAG_STREAM_STORES;
+                        ret = argon2_ctx(&context, (argon2_type)type);
+                        assert(ret == ARGON2_OK);
+                        assert(memcmp(out, ref, OUT_LEN) == 0);
+                    }
+                }
+            }
+            printf("Kernel %s streamed: PASS\n", name);
+        }
+
+        context.version = ARGON2_VERSION_NUMBER;
+        cache = argon2_index_cache_create(Argon2_id, context.t_cost,
+                                          context.m_cost, context.lanes);
+        assert(cache != NULL);
+        context.out = ref;
+        context.flags = ARGON2_DEFAULT_FLAGS;
+        ret = argon2_ctx(&context, Argon2_id);
+        assert(ret == ARGON2_OK);
+        context.out = out;
+        context.flags = ARGON2_FLAG_STREAM_STORES | ARGON2_FLAG_INDEX_CACHE;
+        context.index_cache = cache;
+        ret = argon2_ctx(&context, Argon2_id);
+        assert(ret == ARGON2_OK);
+        assert(memcmp(out, ref, OUT_LEN) == 0);
+        argon2_index_cache_destroy(cache);
+        ret = argon2_select_kernel(NULL);
+        assert(ret == ARGON2_OK);
+        printf("Streamed with index cache: PASS\n");
+    }
+
+    /* Parallel first blocks and finalize tests */
+
+    printf("\n");
+    printf("Parallel first blocks and finalize tests\n");
+
+    {
+        unsigned char ref[OUT_LEN];
+        argon2_context context, contexts[2];
+        argon2_workspace *workspace;
+        uint32_t threads[3] = {2, 3, 8};
+        unsigned k, type;
+
+        init_context(&context, 8, 1 << 9);
+        context.allocate_cbk = alloc_checked;
+        context.free_cbk = free_checked;
+
+        for (type = Argon2_d; type <= Argon2_id; ++type) {
+            context.out = ref;
+            context.threads = 1;
+            context.flags = ARGON2_DEFAULT_FLAGS;
+            ret = argon2_ctx(&context, (argon2_type)type);
+            assert(ret == ARGON2_OK);
+            context.out = out;
+            /* Segments from the queue, then fixed lanes */
+            for (k = 0; k < 6; ++k) {
+                memset(out, 0, OUT_LEN);
+                context.threads = threads[k % 3];
+                context.flags = k < 3 ? ARGON2_DEFAULT_FLAGS
+                                      : ARGON2_FLAG_AFFINITY;
+                ret = argon2_ctx(&context, (argon2_type)type);
+                assert(ret == ARGON2_OK);
+                assert(memcmp(out, ref, OUT_LEN) == 0);
+            }
+        }
+        assert(unwiped_frees == 0);
+        printf("Lanes finished by their workers: PASS\n");
+
+        /* argon2_hash_batch() fills on one thread whatever the contexts say */
+        context.flags = ARGON2_DEFAULT_FLAGS;
+        context.threads = 4;
+        contexts[0] = context;
+        contexts[1] = context;
+        contexts[1].out = ref;
+        contexts[1].threads = 1;
+        ret = argon2_hash_batch(contexts, 2, Argon2_id, NULL);
+        assert(ret == ARGON2_OK);
+        assert(memcmp(out, ref, OUT_LEN) == 0);
+        assert(unwiped_frees == 0);
+        printf("Batch with threads: PASS\n");
+
+        /* Filled and finished in steps */
+        {
+            argon2_state *state;
+            memset(out, 0, OUT_LEN);
+            ret = argon2_begin(&state, &context, Argon2_id);
+            assert(ret == ARGON2_OK);
+            do {
+                ret = argon2_step(state, 3);
+            } while (ret == ARGON2_STEP_PENDING);
+            assert(ret == ARGON2_OK);
+            ret = argon2_finish(state);
+            assert(ret == ARGON2_OK);
+            assert(memcmp(out, ref, OUT_LEN) == 0);
+            assert(unwiped_frees == 0);
+        }
+        printf("Stepped with threads: PASS\n");
+
+        /* In a workspace, wiped now or later */
+        for (k = 0; k < 2; ++k) {
+            workspace = argon2_workspace_create(
+                context.m_cost, 4, k ? ARGON2_FLAG_DEFER_WIPE : 0);
+            assert(workspace != NULL);
+            memset(out, 0, OUT_LEN);
+            ret = argon2_ctx_workspace(&context, Argon2_id, workspace);
+            assert(ret == ARGON2_OK);
+            assert(memcmp(out, ref, OUT_LEN) == 0);
+            argon2_workspace_destroy(workspace);
+        }
+        printf("Workspace with threads: PASS\n");
+    }
+
     return 0;
 }
@@ -0,0 +1,94 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+/* Tests of the C++ wrapper in include/argon2.hpp against the C API */
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "argon2.hpp"
+
+#define OUT_LEN 32
+#define ENCODED_LEN 108
+
+static const char pwd[] = "password";
+static const char salt[] = "somesalt";
+
+/* The wrapper of one set of parameters against the C API */
+template <typename A> static void check(const char *name) {
+    unsigned char out[OUT_LEN], ref[OUT_LEN];
+    char enc[ENCODED_LEN], ref_enc[ENCODED_LEN], other[ENCODED_LEN];
+    A a;
+    int ret;
+
+    ret = a.hash(out, OUT_LEN, pwd, strlen(pwd), salt, strlen(salt));
+    assert(ret == ARGON2_OK);
+    ret = argon2_hash(A::t_cost, A::m_cost, A::lanes, pwd, strlen(pwd), salt,
+                      strlen(salt), ref, OUT_LEN, nullptr, 0, A::type,
+                      A::version);
+    assert(ret == ARGON2_OK);
+    assert(memcmp(out, ref, OUT_LEN) == 0);
+
+    assert(A::encoded_length(strlen(salt), OUT_LEN) ==
+           argon2_encodedlen(A::t_cost, A::m_cost, A::lanes, strlen(salt),
+                             OUT_LEN, A::type));
+    ret = a.hash_encoded(enc, sizeof(enc), OUT_LEN, pwd, strlen(pwd), salt,
+                         strlen(salt));
+    assert(ret == ARGON2_OK);
+    ret = argon2_hash(A::t_cost, A::m_cost, A::lanes, pwd, strlen(pwd), salt,
+                      strlen(salt), nullptr, OUT_LEN, ref_enc,
+                      sizeof(ref_enc), A::type, A::version);
+    assert(ret == ARGON2_OK);
+    assert(strcmp(enc, ref_enc) == 0);
+    printf("%s hash: PASS\n", name);
+
+    assert(a.verify(enc, pwd, strlen(pwd)) == ARGON2_OK);
+    assert(argon2_verify(enc, pwd, strlen(pwd), A::type) == ARGON2_OK);
+    assert(a.verify(enc, "passwore", strlen(pwd)) == ARGON2_VERIFY_MISMATCH);
+    assert(argon2_verify(enc, "passwore", strlen(pwd), A::type) ==
+           ARGON2_VERIFY_MISMATCH);
+    printf("%s verify: PASS\n", name);
+
+    /* Other parameters go through argon2_verify_params() */
+    ret = argon2_hash(A::t_cost + 1, A::m_cost * 2, A::lanes, pwd,
+                      strlen(pwd), salt, strlen(salt), nullptr, OUT_LEN,
+                      other, sizeof(other), A::type, A::version);
+    assert(ret == ARGON2_OK);
+    assert(a.verify(other, pwd, strlen(pwd)) == ARGON2_OK);
+    assert(a.verify(other, "passwore", strlen(pwd)) ==
+           ARGON2_VERIFY_MISMATCH);
+    assert(a.verify("$argon2id$v=19$m=65536", pwd, strlen(pwd)) ==
+           argon2_verify("$argon2id$v=19$m=65536", pwd, strlen(pwd),
+                         A::type));
+    printf("%s verify other parameters: PASS\n", name);
+}
+
+int main() {
+    printf("C++ wrapper tests\n");
+
+    check<argon2::Argon2<Argon2_id, 1 << 9, 2, 2>>("Argon2id");
+    check<argon2::Argon2<Argon2_i, 1 << 8, 1, 3, ARGON2_VERSION_10>>(
+        "Argon2i v1.0");
+    /* More lanes than fit evenly: the geometry rounds down per segment */
+    using odd = argon2::Argon2<Argon2_d, 100, 3, 1>;
+    static_assert(odd::segment_length == 8 && odd::memory_blocks == 96,
+                  "geometry as prepare_instance() does it");
+    check<odd>("Argon2d with 3 lanes");
+
+    return 0;
+}
@@ -17,11 +17,15 @@
 
 #if !defined(ARGON2_NO_THREADS)
 
-#include "thread.h"
-#if defined(_WIN32)
-#include <windows.h>
+#include <stdio.h>
+
+#if !defined(_WIN32)
+#include <unistd.h>
 #endif
 
+#include "numa.h"
+#include "thread.h"
+
 int argon2_thread_create(argon2_thread_handle_t *handle,
                          argon2_thread_func_t func, void *args) {
     if (NULL == handle || func == NULL) {
@@ -54,4 +58,206 @@ void argon2_thread_exit(void) {
 #endif
 }
 
+int argon2_mutex_init(argon2_mutex_t *mutex) {
+#if defined(_WIN32)
+    InitializeSRWLock(mutex);
+    return 0;
+#else
+    return pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+int argon2_mutex_destroy(argon2_mutex_t *mutex) {
+#if defined(_WIN32)
+    (void)mutex; /* SRW locks need no cleanup */
+    return 0;
+#else
+    return pthread_mutex_destroy(mutex);
+#endif
+}
+
+int argon2_mutex_lock(argon2_mutex_t *mutex) {
+#if defined(_WIN32)
+    AcquireSRWLockExclusive(mutex);
+    return 0;
+#else
+    return pthread_mutex_lock(mutex);
+#endif
+}
+
+int argon2_mutex_unlock(argon2_mutex_t *mutex) {
+#if defined(_WIN32)
+    ReleaseSRWLockExclusive(mutex);
+    return 0;
+#else
+    return pthread_mutex_unlock(mutex);
+#endif
+}
+
+int argon2_cond_init(argon2_cond_t *cond) {
+#if defined(_WIN32)
+    InitializeConditionVariable(cond);
+    return 0;
+#else
+    return pthread_cond_init(cond, NULL);
+#endif
+}
+
+int argon2_cond_destroy(argon2_cond_t *cond) {
+#if defined(_WIN32)
+    (void)cond; /* condition variables need no cleanup */
+    return 0;
+#else
+    return pthread_cond_destroy(cond);
+#endif
+}
+
+int argon2_cond_wait(argon2_cond_t *cond, argon2_mutex_t *mutex) {
+#if defined(_WIN32)
+    return SleepConditionVariableSRW(cond, mutex, INFINITE, 0) ? 0 : -1;
+#else
+    return pthread_cond_wait(cond, mutex);
+#endif
+}
+
+int argon2_cond_signal(argon2_cond_t *cond) {
+#if defined(_WIN32)
+    WakeConditionVariable(cond);
+    return 0;
+#else
+    return pthread_cond_signal(cond);
+#endif
+}
+
+int argon2_cond_broadcast(argon2_cond_t *cond) {
+#if defined(_WIN32)
+    WakeAllConditionVariable(cond);
+    return 0;
+#else
+    return pthread_cond_broadcast(cond);
+#endif
+}
+
+int argon2_barrier_init(argon2_barrier_t *barrier, unsigned total) {
+    if (barrier == NULL || total == 0) {
+        return -1;
+    }
+    if (argon2_mutex_init(&barrier->mutex)) {
+        return -1;
+    }
+    if (argon2_cond_init(&barrier->cond)) {
+        argon2_mutex_destroy(&barrier->mutex);
+        return -1;
+    }
+    barrier->count = total;
+    barrier->total = total;
+    barrier->generation = 0;
+    return 0;
+}
+
+int argon2_barrier_destroy(argon2_barrier_t *barrier) {
+    int rc = argon2_cond_destroy(&barrier->cond);
+    return argon2_mutex_destroy(&barrier->mutex) || rc;
+}
+
+int argon2_barrier_wait(argon2_barrier_t *barrier) {
+    unsigned generation;
+    int rc = 0;
+
+    argon2_mutex_lock(&barrier->mutex);
+    generation = barrier->generation;
+    if (--barrier->count == 0) {
+        /* Last one in: open the barrier and re-arm it for the next round */
+        barrier->generation++;
+        barrier->count = barrier->total;
+        rc = argon2_cond_broadcast(&barrier->cond);
+    } else {
+        /* Guard against spurious wakeups by waiting for a new generation */
+        while (generation == barrier->generation && rc == 0) {
+            rc = argon2_cond_wait(&barrier->cond, &barrier->mutex);
+        }
+    }
+    argon2_mutex_unlock(&barrier->mutex);
+    return rc;
+}
+
+#if defined(__linux__)
+/* CPUs allowed by a cgroup quota of @quota per @period, rounded up, or 0 if
+ * there is no quota */
+static uint32_t quota_cpus(long long quota, long long period) {
+    if (quota <= 0 || period <= 0) {
+        return 0;
+    }
+    return (uint32_t)((quota + period - 1) / period);
+}
+
+/* Reads the CPU quota of the process's cgroup, v2 then v1
+ * @return The CPUs it allows, or 0 if there is none */
+static uint32_t cgroup_cpus(void) {
+    FILE *file;
+    long long quota = 0, period = 0;
+
+    file = fopen("/sys/fs/cgroup/cpu.max", "r");
+    if (file != NULL) {
+        /* "200000 100000", or "max 100000" without a quota */
+        if (fscanf(file, "%lld %lld", &quota, &period) != 2) {
+            quota = 0;
+        }
+        fclose(file);
+        return quota_cpus(quota, period);
+    }
+
+    file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");
+    if (file == NULL) {
+        return 0;
+    }
+    if (fscanf(file, "%lld", &quota) != 1) {
+        quota = 0;
+    }
+    fclose(file);
+    file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+    if (file == NULL) {
+        return 0;
+    }
+    if (fscanf(file, "%lld", &period) != 1) {
+        period = 0;
+    }
+    fclose(file);
+    return quota_cpus(quota, period); /* a quota of -1 is none */
+}
+#endif
+
+static argon2_mutex_t cpu_lock = ARGON2_MUTEX_INITIALIZER;
+static uint32_t cpu_total = 0; /* 0 until probed */
+
+uint32_t argon2_cpu_count(void) {
+    uint32_t count = 0;
+
+    argon2_mutex_lock(&cpu_lock);
+    if (cpu_total == 0) {
+#if defined(__linux__)
+        argon2_numa_mask mask;
+        uint32_t quota = cgroup_cpus();
+        count = argon2_cpu_allowed(&mask);
+        if (quota != 0 && (count == 0 || quota < count)) {
+            count = quota;
+        }
+#endif
+        if (count == 0) {
+#if defined(_WIN32)
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            count = (uint32_t)info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+            long online = sysconf(_SC_NPROCESSORS_ONLN);
+            count = online > 0 ? (uint32_t)online : 0;
+#endif
+        }
+        cpu_total = count > 0 ? count : 1;
+    }
+    count = cpu_total;
+    argon2_mutex_unlock(&cpu_lock);
+    return count;
+}
+
 #endif /* ARGON2_NO_THREADS */
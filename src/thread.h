@@ -22,24 +22,47 @@
 
 /*
         Here we implement an abstraction layer for the simpĺe requirements
-        of the Argon2 code. We only require 3 primitives---thread creation,
-        joining, and termination---so full emulation of the pthreads API
-        is unwarranted. Currently we wrap pthreads and Win32 threads.
+        of the Argon2 code. We only require a handful of primitives---thread
+        creation, joining, and termination, plus a mutex, a condition
+        variable, and a barrier built from those two for the persistent
+        worker pool---so full emulation of the pthreads API is unwarranted.
+        Currently we wrap pthreads and Win32 threads (Vista or later, for
+        slim reader/writer locks and condition variables).
 
         The API defines 2 types: the function pointer type,
    argon2_thread_func_t,
         and the type of the thread handle---argon2_thread_handle_t.
 */
+#include <stdint.h>
+
 #if defined(_WIN32)
+#include <windows.h>
 #include <process.h>
 typedef unsigned(__stdcall *argon2_thread_func_t)(void *);
 typedef uintptr_t argon2_thread_handle_t;
+typedef SRWLOCK argon2_mutex_t;
+typedef CONDITION_VARIABLE argon2_cond_t;
+#define ARGON2_MUTEX_INITIALIZER SRWLOCK_INIT
+#define ARGON2_COND_INITIALIZER CONDITION_VARIABLE_INIT
 #else
 #include <pthread.h>
 typedef void *(*argon2_thread_func_t)(void *);
 typedef pthread_t argon2_thread_handle_t;
+typedef pthread_mutex_t argon2_mutex_t;
+typedef pthread_cond_t argon2_cond_t;
+#define ARGON2_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define ARGON2_COND_INITIALIZER PTHREAD_COND_INITIALIZER
 #endif
 
+/* Reusable barrier for a fixed number of participants */
+typedef struct Argon2_barrier_t {
+    argon2_mutex_t mutex;
+    argon2_cond_t cond;
+    unsigned count;      /* participants still to arrive in this round */
+    unsigned total;      /* number of participants */
+    unsigned generation; /* incremented every time the barrier opens */
+} argon2_barrier_t;
+
 /* Creates a thread
  * @param handle pointer to a thread handle, which is the output of this
  * function. Must not be NULL.
@@ -63,5 +86,45 @@ int argon2_thread_join(argon2_thread_handle_t handle);
 */
 void argon2_thread_exit(void);
 
+/* Mutex primitives. A mutex may also be initialized statically with
+ * ARGON2_MUTEX_INITIALIZER, in which case it must not be destroyed.
+ * @return 0 on success
+ */
+int argon2_mutex_init(argon2_mutex_t *mutex);
+int argon2_mutex_destroy(argon2_mutex_t *mutex);
+int argon2_mutex_lock(argon2_mutex_t *mutex);
+int argon2_mutex_unlock(argon2_mutex_t *mutex);
+
+/* Condition variable primitives. A condition variable may also be
+ * initialized statically with ARGON2_COND_INITIALIZER. @mutex must be held
+ * by the caller of argon2_cond_wait.
+ * @return 0 on success
+ */
+int argon2_cond_init(argon2_cond_t *cond);
+int argon2_cond_destroy(argon2_cond_t *cond);
+int argon2_cond_wait(argon2_cond_t *cond, argon2_mutex_t *mutex);
+int argon2_cond_signal(argon2_cond_t *cond);
+int argon2_cond_broadcast(argon2_cond_t *cond);
+
+/* Initializes a barrier for @total participants
+ * @return 0 on success
+ */
+int argon2_barrier_init(argon2_barrier_t *barrier, unsigned total);
+
+/* Destroys a barrier. No thread may be waiting on it. */
+int argon2_barrier_destroy(argon2_barrier_t *barrier);
+
+/* Blocks until all participants have called argon2_barrier_wait, after
+ * which the barrier is immediately ready for the next round.
+ * @return 0 on success
+ */
+int argon2_barrier_wait(argon2_barrier_t *barrier);
+
+/* Returns the number of CPUs the process may run on: those of its
+ * affinity mask, or fewer if its cgroup has a CPU quota. At least 1. The
+ * CPUs are counted at the first call only.
+ */
+uint32_t argon2_cpu_count(void);
+
 #endif /* ARGON2_NO_THREADS */
 #endif
@@ -0,0 +1,273 @@
+/*
+ * Argon2 reference source code package - reference C implementations
+ *
+ * Copyright 2015
+ * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
+ *
+ * You may use this work under the terms of a Creative Commons CC0 1.0
+ * License/Waiver or the Apache Public License 2.0, at your option. The terms of
+ * these licenses can be found at:
+ *
+ * - CC0 1.0 Universal : http://creativecommons.org/publicdomain/zero/1.0
+ * - Apache 2.0        : http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * You should have received a copy of both of these licenses along with this
+ * software. If not, they may be obtained at the above URLs.
+ */
+
+#include <stdlib.h>
+
+#include "argon2.h"
+#include "core.h"
+#include "pages.h"
+#include "pool.h"
+#include "thread.h"
+
+struct Argon2_workspace_pool {
+    argon2_workspace **workspaces; /* all @count workspaces */
+    uint32_t count;
+    argon2_workspace *idle; /* free list of the released workspaces */
+#if !defined(ARGON2_NO_THREADS)
+    uint32_t wiping; /* released workspaces being wiped on a pool worker */
+    argon2_mutex_t mutex;
+    argon2_cond_t released;
+#endif
+};
+
+/* Wipes what the hashes left in the memory of @workspace */
+static void wipe_workspace(argon2_workspace *workspace) {
+    clear_internal_memory_nt(workspace->memory,
+                             (size_t)workspace->dirty * sizeof(block));
+    workspace->dirty = 0;
+}
+
+/* Puts @workspace back into the free list of @pool and wakes up a thread
+ * waiting for it. Call with the pool mutex held. */
+static void push_idle(argon2_workspace_pool *pool,
+                      argon2_workspace *workspace) {
+    workspace->next = pool->idle;
+    pool->idle = workspace;
+#if !defined(ARGON2_NO_THREADS)
+    argon2_cond_broadcast(&pool->released);
+#endif
+}
+
+#if !defined(ARGON2_NO_THREADS)
+static void wipe_released(void *arg) {
+    argon2_workspace *workspace = arg;
+    argon2_workspace_pool *pool = workspace->owner;
+
+    wipe_workspace(workspace);
+
+    argon2_mutex_lock(&pool->mutex);
+    pool->wiping--;
+    push_idle(pool, workspace);
+    argon2_mutex_unlock(&pool->mutex);
+}
+#endif
+
+argon2_workspace *argon2_workspace_create(uint32_t m_cost, uint32_t threads,
+                                          uint32_t flags) {
+    argon2_workspace *workspace;
+    size_t size = (size_t)m_cost * sizeof(block);
+
+    if (m_cost == 0 || size / sizeof(block) != m_cost) {
+        return NULL;
+    }
+
+    workspace = calloc(1, sizeof(argon2_workspace));
+    if (workspace == NULL) {
+        return NULL;
+    }
+    workspace->capacity = m_cost;
+    workspace->backing = ARGON2_BACKING_DEFAULT;
+    workspace->flags = flags;
+
+    if (flags & ARGON2_FLAG_HUGE_PAGES) {
+        workspace->memory = argon2_pages_alloc(size, &workspace->backing);
+    } else {
+        workspace->memory = malloc(size);
+    }
+    if (workspace->memory == NULL) {
+        free(workspace);
+        return NULL;
+    }
+    /* Fault every page in now rather than during the first hash */
+    secure_wipe_memory(workspace->memory, size);
+
+#if !defined(ARGON2_NO_THREADS)
+    if (threads > 1) {
+        workspace->thr_data = calloc(threads, sizeof(argon2_thread_data));
+        workspace->tasks = calloc(threads, sizeof(argon2_pool_task));
+        if (workspace->thr_data == NULL || workspace->tasks == NULL) {
+            argon2_workspace_destroy(workspace);
+            return NULL;
+        }
+        workspace->threads = threads;
+    }
+    if (flags & ARGON2_FLAG_DEFER_WIPE) {
+        workspace->wipe_task = calloc(1, sizeof(argon2_pool_task));
+        if (workspace->wipe_task == NULL) {
+            argon2_workspace_destroy(workspace);
+            return NULL;
+        }
+        workspace->wipe_task->func = &wipe_released;
+        workspace->wipe_task->arg = workspace;
+    }
+#else
+    (void)threads;
+#endif
+
+    return workspace;
+}
+
+void argon2_workspace_destroy(argon2_workspace *workspace) {
+    size_t size;
+
+    if (workspace == NULL) {
+        return;
+    }
+
+    size = (size_t)workspace->capacity * sizeof(block);
+    wipe_workspace(workspace);
+    if (workspace->backing != ARGON2_BACKING_DEFAULT) {
+        argon2_pages_free(workspace->memory, size, workspace->backing);
+    } else {
+        free(workspace->memory);
+    }
+    free(workspace->thr_data);
+    free(workspace->tasks);
+    free(workspace->wipe_task);
+    free(workspace);
+}
+
+argon2_workspace_pool *argon2_workspace_pool_create(uint32_t count,
+                                                    uint32_t m_cost,
+                                                    uint32_t threads,
+                                                    uint32_t flags) {
+    argon2_workspace_pool *pool;
+    uint32_t i;
+
+    if (count == 0) {
+        return NULL;
+    }
+
+    pool = calloc(1, sizeof(argon2_workspace_pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->workspaces = calloc(count, sizeof(argon2_workspace *));
+    if (pool->workspaces == NULL) {
+        free(pool);
+        return NULL;
+    }
+#if !defined(ARGON2_NO_THREADS)
+    if (argon2_mutex_init(&pool->mutex)) {
+        free(pool->workspaces);
+        free(pool);
+        return NULL;
+    }
+    if (argon2_cond_init(&pool->released)) {
+        argon2_mutex_destroy(&pool->mutex);
+        free(pool->workspaces);
+        free(pool);
+        return NULL;
+    }
+#endif
+
+    for (i = 0; i < count; ++i) {
+        argon2_workspace *workspace =
+            argon2_workspace_create(m_cost, threads, flags);
+        if (workspace == NULL) {
+            argon2_workspace_pool_destroy(pool);
+            return NULL;
+        }
+        workspace->owner = pool;
+        workspace->next = pool->idle;
+        pool->idle = workspace;
+        pool->workspaces[pool->count++] = workspace;
+    }
+
+    return pool;
+}
+
+void argon2_workspace_pool_destroy(argon2_workspace_pool *pool) {
+    uint32_t i;
+
+    if (pool == NULL) {
+        return;
+    }
+
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_lock(&pool->mutex);
+    while (pool->wiping != 0) {
+        argon2_cond_wait(&pool->released, &pool->mutex);
+    }
+    argon2_mutex_unlock(&pool->mutex);
+#endif
+    for (i = 0; i < pool->count; ++i) {
+        argon2_workspace_destroy(pool->workspaces[i]);
+    }
+#if !defined(ARGON2_NO_THREADS)
+    argon2_cond_destroy(&pool->released);
+    argon2_mutex_destroy(&pool->mutex);
+#endif
+    free(pool->workspaces);
+    free(pool);
+}
+
+argon2_workspace *argon2_workspace_acquire(argon2_workspace_pool *pool) {
+    argon2_workspace *workspace;
+
+    if (pool == NULL) {
+        return NULL;
+    }
+
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_lock(&pool->mutex);
+    while (pool->idle == NULL) {
+        argon2_cond_wait(&pool->released, &pool->mutex);
+    }
+#endif
+    workspace = pool->idle;
+    if (workspace != NULL) {
+        pool->idle = workspace->next;
+        workspace->next = NULL;
+    }
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_unlock(&pool->mutex);
+#endif
+
+    return workspace;
+}
+
+void argon2_workspace_release(argon2_workspace_pool *pool,
+                              argon2_workspace *workspace) {
+    if (pool == NULL || workspace == NULL) {
+        return;
+    }
+
+#if !defined(ARGON2_NO_THREADS)
+    if (workspace->dirty != 0 && workspace->wipe_task != NULL) {
+        /* Let a pool worker wipe it and put it back */
+        argon2_mutex_lock(&pool->mutex);
+        pool->wiping++;
+        argon2_mutex_unlock(&pool->mutex);
+        if (argon2_pool_submit(workspace->wipe_task, 1) == 0) {
+            return;
+        }
+        argon2_mutex_lock(&pool->mutex);
+        pool->wiping--;
+        argon2_mutex_unlock(&pool->mutex);
+    }
+#endif
+    wipe_workspace(workspace);
+
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_lock(&pool->mutex);
+#endif
+    push_idle(pool, workspace);
+#if !defined(ARGON2_NO_THREADS)
+    argon2_mutex_unlock(&pool->mutex);
+#endif
+}